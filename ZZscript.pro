@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -24,25 +24,21 @@ DEFINES += QT_DEPRECATED_WARNINGS
 
 CONFIG += c++11
 
+# parser and project code, shared with the command-line tools in tools/
+include(zzscript.pri)
+
 SOURCES += \
         main.cpp \
         mainwindow.cpp \
     document.cpp \
-    tokenizer.cpp \
-    parser.cpp \
-    parser_expression.cpp \
-    parser_root.cpp \
-    parser_fields.cpp \
-    parser_methods.cpp \
-    project.cpp
+    projectwatcher.cpp \
+    projecttreemodel.cpp
 
 HEADERS += \
         mainwindow.h \
     document.h \
-    tokenizer.h \
-    tokens.h \
-    parser.h \
-    project.h
+    projectwatcher.h \
+    projecttreemodel.h
 
 FORMS += \
         mainwindow.ui
@@ -1,5 +1,6 @@
 #include "tokenizer.h"
 #include "document.h"
+#include "profiler.h"
 
 #include <QTime>
 #include <QToolTip>
@@ -7,27 +8,219 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QBoxLayout>
+#include <QTextLayout>
+#include <QtConcurrent>
+#include <algorithm>
 
 Document::Document(DocumentTab* tab)
 {
     isnew = false;
-    ownparser = true;
-    parser = nullptr;
+    syncing = false;
+    source = SourceFile::fromText(QString(), QString());
+    queries = new QueryEngine();
+    ownqueries = true;
     this->tab = tab;
+    version = 0;
+    analyzedVersion = -1;
+    lexedVersion = -1;
+    editCount = 0;
+    edit.position = edit.charsRemoved = edit.charsAdded = 0;
 }
 
 Document::~Document()
 {
-    if (parser && ownparser)
-        delete parser;
-    parser = nullptr;
+    // the analysis thread uses the engine
+    cancelAnalysis(true);
+    if (queries && ownqueries)
+        delete queries;
+    queries = nullptr;
 }
 
 void Document::parse()
 {
-    Tokenizer tok(contents);
+    // whole text, no edit to reuse
+    editCount = -1;
+    reparse();
+}
+
+void Document::noteEdit(int position, int charsRemoved, int charsAdded)
+{
+    version++;
+    QueryEngine::TextEdit newEdit = { position, charsRemoved, charsAdded };
+    // a long list only means that nothing was analyzed for a while
+    if (snapshotEdits.size() >= 256)
+    {
+        snapshotEdits.clear();
+        snapshotEditVersions.clear();
+        QueryEngine::TextEdit unknown = { -1, 0, 0 };
+        snapshotEdits.append(unknown);
+    }
+    else snapshotEdits.append(newEdit);
+    snapshotEditVersions.append(version);
+
+    if (position < 0 || editCount < 0)
+    {
+        editCount = -1;
+        return;
+    }
+    edit = editCount ? QueryEngine::mergeEdits(edit, newEdit) : newEdit;
+    editCount = 1;
+}
+
+bool Document::applyEdit(int position, int charsRemoved, const QString& added)
+{
+    if (!source->replace(position, charsRemoved, added))
+        return false;
+    noteEdit(position, charsRemoved, added.length());
+    relex(position, charsRemoved, added.length());
+    return true;
+}
+
+void Document::setText(const QString& text)
+{
+    source->setText(text);
+    noteEdit(-1, 0, 0);
+    relex();
+}
+
+void Document::relex()
+{
+    Tokenizer tok(source->text());
     tokens = tok.readAllTokens();
+    lexedVersion = version;
+}
+
+void Document::relex(int position, int charsRemoved, int charsAdded)
+{
+    // tokens before the edit are kept and tokens after it are shifted. lexing starts two tokens before the edit (a token
+    // can grow into the edited text) and stops at the first new token after the edited text that starts where an old token
+    // did: the tokenizer has no state between tokens, so from there on it would produce the old tokens again.
+    if (lexedVersion != version-1 || position < 0 || tokens.isEmpty())
+    {
+        relex();
+        return;
+    }
+
+    int delta = charsAdded - charsRemoved;
+    int first = int(std::lower_bound(tokens.begin(), tokens.end(), position, [](const Tokenizer::Token& tok, int pos) { return tok.endsAt < pos; }) - tokens.begin());
+    first = qBound(0, first-2, tokens.size()-1);
+    // first old token after the removed text
+    int next = int(std::lower_bound(tokens.begin(), tokens.end(), position+charsRemoved, [](const Tokenizer::Token& tok, int pos) { return tok.startsAt < pos; }) - tokens.begin());
+
+    // the text is lexed in chunks taken from the source, the whole text is never put together here.
+    // lines in a chunk count from its start; newlines is the number of line ends before it
+    QList<Tokenizer::Token> relexed;
+    int textLength = source->length();
+    int chunkStart = tokens[first].startsAt;
+    int chunkSize = position + charsAdded - chunkStart + 4096;
+    int newlines = 0;
+    bool lineKnown = (chunkStart == 0);
+    int resync = -1;
+    int lineDelta = 0;
+    while (resync < 0)
+    {
+        QString chunk = source->mid(chunkStart, chunkSize);
+        bool lastChunk = (chunkStart + chunk.length() >= textLength);
+        Tokenizer tokenizer(chunk);
+        QList<Tokenizer::Token> chunkTokens = tokenizer.readAllTokens();
+        // the last token of a chunk can be cut off by the end of the chunk; it is lexed again in the next one
+        int count = lastChunk ? chunkTokens.size() : chunkTokens.size()-1;
+        if (count <= 0)
+        {
+            if (lastChunk)
+                break;
+            chunkSize *= 2; // long comment or string
+            continue;
+        }
+
+        for (int i = 0; i < count && resync < 0; i++)
+        {
+            Tokenizer::Token tok = chunkTokens[i];
+            tok.startsAt += chunkStart;
+            tok.endsAt += chunkStart;
+            if (!lineKnown)
+            {
+                // the first token is before the edit, so it is the same as the old one. it tells where the lines start
+                const Tokenizer::Token& old = tokens[first];
+                if (tok.startsAt != old.startsAt || tok.endsAt != old.endsAt || tok.type != old.type)
+                {
+                    relex();
+                    return;
+                }
+                newlines = old.line - tok.line;
+                lineKnown = true;
+            }
+            tok.line += newlines;
+
+            if (tok.startsAt >= position+charsAdded)
+            {
+                while (next < tokens.size() && tokens[next].startsAt+delta < tok.startsAt)
+                    next++;
+                if (next < tokens.size() && tokens[next].startsAt+delta == tok.startsAt)
+                {
+                    resync = next;
+                    lineDelta = tok.line - tokens[next].line;
+                    break;
+                }
+            }
+            relexed.append(tok);
+        }
+
+        if (resync >= 0 || lastChunk)
+            break;
+        int nextStart = chunkTokens[count].startsAt;
+        newlines += chunk.leftRef(nextStart).count('\n');
+        chunkStart += nextStart;
+        chunkSize = 4096;
+    }
 
+    // splice the new tokens in place of the old ones between first and resync, then shift the rest
+    int replacedEnd = (resync >= 0) ? resync : tokens.size();
+    int common = qMin(replacedEnd-first, relexed.size());
+    for (int i = 0; i < common; i++)
+        tokens[first+i] = relexed[i];
+    if (replacedEnd-first > common)
+    {
+        tokens.erase(tokens.begin()+first+common, tokens.begin()+replacedEnd);
+    }
+    else if (relexed.size() > common)
+    {
+        if (relexed.size()-common <= 64)
+        {
+            for (int i = common; i < relexed.size(); i++)
+                tokens.insert(first+i, relexed[i]);
+        }
+        else
+        {
+            // large paste: one pass instead of many inserts in the middle
+            QList<Tokenizer::Token> spliced;
+            spliced.reserve(tokens.size() + relexed.size() - common);
+            for (int i = 0; i < first+common; i++)
+                spliced.append(tokens[i]);
+            for (int i = common; i < relexed.size(); i++)
+                spliced.append(relexed[i]);
+            for (int i = first+common; i < tokens.size(); i++)
+                spliced.append(tokens[i]);
+            tokens = spliced;
+        }
+    }
+
+    if (resync >= 0 && (delta || lineDelta))
+    {
+        for (int i = first+relexed.size(); i < tokens.size(); i++)
+        {
+            Tokenizer::Token& tok = tokens[i];
+            tok.startsAt += delta;
+            tok.endsAt += delta;
+            tok.line += lineDelta;
+        }
+    }
+
+    lexedVersion = version;
+}
+
+Document::Analysis Document::analyze(QueryEngine* queries, QString path, QString text, int editCount, QueryEngine::TextEdit edit, int version, QSharedPointer<QAtomicInt> cancel)
+{
     //
     // produce structure:
     // - file
@@ -39,125 +232,170 @@ void Document::parse()
     //         - code[]
     //           ...
     //     - constants[]
-    if (parser && ownparser) delete parser;
-    parser = nullptr;
-    parsedTokens.clear();
+    // only what depends on the changed text is computed again
+    Analysis result;
+    result.version = version;
+    QMutexLocker locker(queries->mutex());
+    // the text goes in even if this is cancelled already: the next analysis only has the edits made after it
+    queries->setFileText(path, text, (editCount == 1) ? &edit : nullptr);
+    queries->setCancelFlag(cancel.data());
+    queries->resetStatistics();
+    QVector<ParserToken> parsedTokens = queries->semanticTokens(path);
+    result.cancelled = queries->isCancelled();
+    queries->setCancelFlag(nullptr);
+    Parser* parser = queries->parser(path);
+    if (!result.cancelled && parser)
+    {
+        // readers get a copy of the results; the parser stays with the engine
+        result.snapshot = ParseSnapshot::build(parser, parsedTokens, path, version);
+        ProjectFile* pf = queries->projectFile(path);
+        if (pf)
+            pf->snapshot.publish(result.snapshot);
+    }
+    ZZ_PROFILE_COUNT(QueriesRecomputed, queries->recomputedCount());
+    ZZ_PROFILE_COUNT(QueriesReused, queries->reusedCount());
+    return result;
+}
 
-    ownparser = true;
-    parser = new Parser(tokens);
-    parser->parse();
-    parsedTokens = parser->parsedTokens;
+void Document::submitText()
+{
+    // files outside of the project have no one else asking
+    if (!queries || ownqueries || isnew || editCount == 0)
+        return;
+    // edits go to the engine in order
+    cancelAnalysis(true);
+    QMutexLocker locker(queries->mutex());
+    queries->setFileText(fullPath, source->text(), (editCount == 1) ? &edit : nullptr);
+    editCount = 0;
 }
 
 void Document::reparse()
 {
-    if (!parser) return;
+    if (!queries) return;
+    cancelAnalysis(true);
+    if (!isLexed())
+        relex();
+    Analysis result = analyze(queries, fullPath, source->text(), editCount, edit, version, QSharedPointer<QAtomicInt>());
+    editCount = 0;
+    applyAnalysis(result);
+}
 
-    // get current types
-    QList<QSharedPointer<ZTreeNode>> allTypes = parser->getTypeInformation();
-    QList<QSharedPointer<ZTreeNode>> ownTypes = parser->getOwnTypeInformation();
-    for (QSharedPointer<ZTreeNode> ownType : ownTypes)
-        allTypes.removeAll(ownType);
-    if (ownparser)
-        delete parser;
-    Tokenizer tok(contents);
-    tokens = tok.readAllTokens();
-    parser = new Parser(tokens);
-    ownparser = true;
-    parser->parse();
-    allTypes.append(parser->getOwnTypeInformation());
-    parser->setTypeInformation(allTypes);
-
-    // field pass
-    for (QSharedPointer<ZTreeNode> node : parser->root->children)
+QFuture<Document::Analysis> Document::reparseAsync()
+{
+    // edits are sent to the engine in order, one analysis at a time
+    if (analysis.isRunning())
+        analysis.waitForFinished();
+    analysisCancel = QSharedPointer<QAtomicInt>(new QAtomicInt(0));
+
+    QueryEngine* queries = this->queries;
+    QString path = fullPath;
+    QString text = source->text();
+    int editCount = this->editCount;
+    QueryEngine::TextEdit edit = this->edit;
+    int version = this->version;
+    QSharedPointer<QAtomicInt> cancel = analysisCancel;
+    this->editCount = 0;
+    analysis = QtConcurrent::run([=]() { return analyze(queries, path, text, editCount, edit, version, cancel); });
+    return analysis;
+}
+
+bool Document::applyAnalysis(const Analysis& result)
+{
+    if (result.cancelled || result.version != version)
+        return false;
+    currentSnapshot.publish(result.snapshot);
+    analyzedVersion = result.version;
+    // edits up to this version are in the snapshot
+    while (!snapshotEditVersions.isEmpty() && snapshotEditVersions.first() <= result.version)
     {
-        if (node->type() == ZTreeNode::Class)
-        {
-            parser->parseClassFields(node.dynamicCast<ZClass>());
-        }
-        else if (node->type() == ZTreeNode::Struct)
-        {
-            parser->parseStructFields(node.dynamicCast<ZStruct>());
-        }
+        snapshotEdits.removeFirst();
+        snapshotEditVersions.removeFirst();
     }
+    return true;
+}
 
-    // method pass
-    for (QSharedPointer<ZTreeNode> node : parser->root->children)
+bool Document::mapToSnapshot(int& from, int& to) const
+{
+    // undo the edits, last one first
+    for (int i = snapshotEdits.size()-1; i >= 0; i--)
     {
-        if (node->type() == ZTreeNode::Class)
-        {
-            parser->parseClassMethods(node.dynamicCast<ZClass>());
-        }
-        else if (node->type() == ZTreeNode::Struct)
-        {
-            parser->parseStructMethods(node.dynamicCast<ZStruct>());
-        }
+        const QueryEngine::TextEdit& edit = snapshotEdits[i];
+        if (edit.position < 0)
+            return false;
+        if (to <= edit.position)
+            continue;
+        if (from < edit.position + edit.charsAdded)
+            return false;
+        from -= edit.charsAdded - edit.charsRemoved;
+        to -= edit.charsAdded - edit.charsRemoved;
     }
+    return true;
+}
 
-    parsedTokens = parser->parsedTokens;
+void Document::cancelAnalysis(bool wait)
+{
+    if (analysisCancel)
+        analysisCancel->storeRelease(1);
+    if (wait && analysis.isRunning())
+        analysis.waitForFinished();
 }
 
-void Document::save()
+Document::SaveResult Document::save()
 {
     // take contents, save to disk
-    if (isnew) return; // do nothing for now.. later make a popup window asking for save path
+    SaveResult result;
+    if (isnew)
+    {
+        // later make a popup window asking for save path
+        result.error = "the document has no file name yet";
+        return result;
+    }
+    // the file is about to be truncated, so it can't stay mapped
+    source->unmap();
     QFile f(fullPath);
-    if (f.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Truncate))
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Truncate))
     {
-        //
-        f.write(contents.toUtf8());
-        // and once done, force reparse for all the types
-        // note: this is not very good coding. need to retrieve parser in some more direct way
-        // also, later we need to check that only current project (and below) is reloaded.
-        // we don't need to reparse gzdoom.pk3 just because some user code was modified.
-        //
-        QList<QSharedPointer<ZTreeNode>> allTypes = parser->getTypeInformation();
-        QList<Parser*> parsers;
-        for (QSharedPointer<ZTreeNode> node : allTypes)
-        {
-            QSharedPointer<ZTreeNode> nodeParent = node->parent.toStrongRef();
-            QSharedPointer<ZFileRoot> root = nodeParent.dynamicCast<ZFileRoot>();
-            if (!root) continue;
-            Parser* ownParser = root->parser;
-            if (!parsers.contains(ownParser))
-                parsers.append(ownParser);
-        }
-        for (Parser* p : parsers)
-        {
-            p->parse();
-            p->setTypeInformation(allTypes);
-
-            // field pass
-            for (QSharedPointer<ZTreeNode> node : parser->root->children)
-            {
-                if (node->type() == ZTreeNode::Class)
-                {
-                    parser->parseClassFields(node.dynamicCast<ZClass>());
-                }
-                else if (node->type() == ZTreeNode::Struct)
-                {
-                    parser->parseStructFields(node.dynamicCast<ZStruct>());
-                }
-            }
-
-            // method pass
-            for (QSharedPointer<ZTreeNode> node : parser->root->children)
-            {
-                if (node->type() == ZTreeNode::Class)
-                {
-                    parser->parseClassMethods(node.dynamicCast<ZClass>());
-                }
-                else if (node->type() == ZTreeNode::Struct)
-                {
-                    parser->parseStructMethods(node.dynamicCast<ZStruct>());
-                }
-            }
-        }
+        result.error = f.errorString();
+        return result;
     }
-    else
+    QByteArray data = source->text().toUtf8();
+    if (f.write(data) != data.size())
     {
-        qDebug("could not save into %s", fullPath.toUtf8().data());
+        result.error = f.errorString();
+        return result;
     }
+    f.close();
+    result.saved = true;
+
+    // only this file is parsed again, and only the edited body if the edits stayed inside one. other files are
+    // affected only if that changed the class graph or the members of a type they can look into
+    if (!queries || ownqueries)
+        return result;
+    submitText();
+    QMutexLocker locker(queries->mutex());
+    queries->resetStatistics();
+    result.declarationsChanged = queries->updateDeclarations(fullPath, &result.dependents);
+    qDebug("save: %s, %d queries recomputed%s", fullPath.toUtf8().data(), queries->recomputedCount(), result.declarationsChanged ? ", declarations changed" : "");
+    return result;
+}
+
+void Document::invalidateAnalysis()
+{
+    if (!queries || ownqueries)
+        return;
+    analyzedVersion = -1;
+    if (tab)
+        tab->getEditor()->scheduleAnalysis();
+}
+
+void Document::resubmitText()
+{
+    if (!queries || ownqueries)
+        return;
+    // the running analysis edits the text the engine had before
+    cancelAnalysis();
+    editCount = -1;
+    invalidateAnalysis();
 }
 
 void Document::setTab(DocumentTab* tab)
@@ -171,53 +409,73 @@ DocumentTab* Document::getTab()
     return tab;
 }
 
-void Document::syncFromSource(ProjectFile* pf)
+void Document::syncFromSource(ProjectFile* pf, QueryEngine* queries)
 {
     if (isnew) return;
 
-    if (parser && ownparser)
-        delete parser;
+    cancelAnalysis(true);
+    if (this->queries && ownqueries)
+        delete this->queries;
+    currentSnapshot.publish(nullptr);
 
-    if (pf && pf->parser)
+    bool projectFile = false;
+    bool textParsed = false;
+    bool analyzed = false;
+    if (pf && pf->source && queries)
     {
-        contents = pf->contents;
-        parser = pf->parser;
-        ownparser = false;
+        QMutexLocker locker(queries->mutex());
+        projectFile = queries->hasFile(pf->fullPath);
+        // the engine has this text, so edits can be passed on from the first one. and if every method body is parsed
+        // already, the project's snapshot is all there is to show: nothing to analyze until the text changes
+        textParsed = projectFile && queries->fileText(pf->fullPath) == pf->source->text();
+        analyzed = textParsed && pf->parser && !pf->parser->hasPendingMethodBodies() && pf->snapshot.load() && !pf->snapshot.isOutdated();
+    }
 
-        if (parser) parsedTokens = parser->parsedTokens;
-        else parsedTokens.clear();
+    if (projectFile)
+    {
+        source = pf->source;
+        fullPath = pf->fullPath;
+        this->queries = queries;
+        ownqueries = false;
+        // results from the project load are shown until the first analysis, which also parses the method bodies
+        currentSnapshot.publish(pf->snapshot.load());
 
         if (tab)
         {
             DocumentEditor* editor = tab->getEditor();
-            editor->setPlainText(contents);
+            syncing = true;
+            editor->setPlainText(source->text());
+            syncing = false;
+            // the project snapshot is for exactly this text
+            snapshotEdits.clear();
+            snapshotEditVersions.clear();
+            if (textParsed)
+                editCount = 0;
+            if (analyzed)
+                analyzedVersion = version;
             editor->textChanged();
         }
         return;
     }
 
-    ownparser = true;
-    parser = nullptr;
+    this->queries = new QueryEngine();
+    ownqueries = true;
 
     qDebug("path = %s", fullPath.toUtf8().data());
-    QFileInfo fi(fullPath);
-    if (!fi.isFile())
-        return;
-
-    //
-    QFile f(fullPath);
-    if (f.open(QIODevice::ReadOnly|QIODevice::Text))
+    QSharedPointer<SourceFile> newSource = SourceFile::open(fullPath);
+    if (newSource)
     {
-        contents = f.readAll();
+        source = newSource;
 
         if (tab)
         {
             DocumentEditor* editor = tab->getEditor();
-            editor->setPlainText(contents);
+            syncing = true;
+            editor->setPlainText(source->text());
+            syncing = false;
             editor->textChanged();
         }
 
-        f.close();
         return;
     }
 
@@ -225,6 +483,30 @@ void Document::syncFromSource(ProjectFile* pf)
     qDebug("failed to sync with source: %s", fullPath.toUtf8().data());
 }
 
+void Document::detachFromProject()
+{
+    if (ownqueries)
+        return;
+    cancelAnalysis(true);
+    queries = new QueryEngine();
+    ownqueries = true;
+    // the new engine has never seen the text
+    editCount = -1;
+    analyzedVersion = -1;
+    if (tab)
+        tab->getEditor()->scheduleAnalysis();
+}
+
+bool Document::showSnapshot(ParseSnapshotPtr snapshot)
+{
+    if (!snapshot || !isAnalyzed() || !snapshotEdits.isEmpty() || source->isEdited())
+        return false;
+    currentSnapshot.publish(snapshot);
+    if (tab)
+        tab->getEditor()->textChanged();
+    return true;
+}
+
 DocumentEditor* DocumentTab::getEditor()
 {
     return editor;
@@ -236,7 +518,10 @@ DocumentEditor::DocumentEditor(QWidget* parent) : QPlainTextEdit(parent)
     // for now, any text change should cause reparse
 
     connect(this, SIGNAL(textChanged()), this, SLOT(onTextChanged()));
-    setUndoRedoEnabled(false);
+    // contentsChange comes before textChanged, this is used to tell user edits apart from highlighting and syncing
+    connect(document(), SIGNAL(contentsChange(int,int,int)), this, SLOT(onContentsChange(int,int,int)));
+    // highlighting doesn't change the text, so undo only has user edits
+    setUndoRedoEnabled(true);
     setMouseTracking(true);
 
     //
@@ -244,10 +529,23 @@ DocumentEditor::DocumentEditor(QWidget* parent) : QPlainTextEdit(parent)
 
     QFont f(font());
     f.setFamily("Courier");
+    setFont(f);
     QFontMetricsF metrics(f);
     setTabStopDistance(metrics.width(' ')*tabStop);
 
     processing = false;
+    highlightGeneration = 0;
+    highlightQueued = false;
+    // scrolling and repaints bring new blocks on screen
+    connect(this, SIGNAL(updateRequest(QRect,int)), this, SLOT(scheduleHighlighting()));
+
+    // semantic analysis runs once typing pauses for this long
+    analysisTimer = new QTimer(this);
+    analysisTimer->setSingleShot(true);
+    analysisTimer->setInterval(150);
+    connect(analysisTimer, SIGNAL(timeout()), this, SLOT(startAnalysis()));
+    analysisWatcher = new QFutureWatcher<Document::Analysis>(this);
+    connect(analysisWatcher, SIGNAL(finished()), this, SLOT(onAnalysisFinished()));
 }
 
 DocumentTab::DocumentTab(QWidget* parent, Document* doc) : QWidget(parent)
@@ -263,6 +561,15 @@ DocumentTab::DocumentTab(QWidget* parent, Document* doc) : QWidget(parent)
     editor->textChanged();
 }
 
+Document* DocumentEditor::currentDocument()
+{
+    DocumentTab* tab = qobject_cast<DocumentTab*>(parentWidget());
+    assert(tab != nullptr);
+    Document* doc = tab->document();
+    assert(doc != nullptr);
+    return doc;
+}
+
 void DocumentEditor::onTextChanged()
 {
     if (processing)
@@ -270,221 +577,337 @@ void DocumentEditor::onTextChanged()
 
     //setFontFamily("Courier");
 
-    QString newText = toPlainText();
-    DocumentTab* tab = qobject_cast<DocumentTab*>(parentWidget());
-    assert(tab != nullptr);
-    Document* doc = tab->document();
-    assert(doc != nullptr);
-    doc->contents = newText;
-    /*
-    QTime elTimer;
-    elTimer.start();
-    doc->parse();
-    qDebug("parsing done in %d ms", elTimer.elapsed());*/
-    // reparse this document
-    doc->reparse();
-
-    this->setUpdatesEnabled(false);
-    processing = true;
-    QTextCursor tcur = this->textCursor();
-    tcur.beginEditBlock();
-    tcur.setPosition(0);
-    tcur.setPosition(newText.length(), QTextCursor::KeepAnchor);
-    QTextCharFormat format_base;
-    format_base.setBackground(QColor(0, 0, 0, 0));
-    format_base.setFontFamily("Courier");
-    tcur.setCharFormat(format_base);
-    // do syntax highlighting
-    bool primitiveHL = false;
-    if (primitiveHL)
-    {
-        for (QList<Tokenizer::Token>::iterator it = doc->tokens.begin(); it != doc->tokens.end(); ++it)
-        {
-            Tokenizer::Token& tok = (*it);
+    Document* doc = currentDocument();
 
-            tcur.setPosition(tok.startsAt);
-            tcur.setPosition(tok.endsAt, QTextCursor::KeepAnchor);
+    // edited lines are coloured lexically right away (on the next paint); semantic colouring once the analysis is done
+    invalidateHighlighting();
 
-            QTextCharFormat format;
-            format.setFontFamily("Courier");
+    doc->cancelAnalysis();
+    scheduleAnalysis();
+}
 
-            if (tok.type == Tokenizer::Identifier)
-            {
-                if (tok.value == "if" ||
-                    tok.value == "for" ||
-                    tok.value == "while" ||
-                    tok.value == "else" ||
-                    tok.value == "break" ||
-                    tok.value == "continue")
-                {
-                    format.setFontWeight(QFont::Bold);
-                    QBrush blue(QColor(0, 0, 255));
-                    format.setForeground(blue);
-                }
-                if (tok.value == "true" ||
-                    tok.value == "false" ||
-                    tok.value == "null")
-                {
-                    QBrush brown(QColor(127, 0, 0));
-                    format.setForeground(brown);
-                }
-            }
-            else if (tok.type == Tokenizer::LineComment || tok.type == Tokenizer::BlockComment)
-            {
-                QBrush gray(QColor(127, 127, 127));
-                format.setForeground(gray);
-                format.setFontItalic(true);
-            }
-            else if (tok.type == Tokenizer::String || tok.type == Tokenizer::Name)
-            {
-                QBrush green(QColor(0, 127, 0));
-                format.setForeground(green);
-                format.setFontWeight(QFont::Bold);
-            }
-            else if (tok.type == Tokenizer::Integer || tok.type == Tokenizer::Double)
-            {
-                QBrush pink(QColor(164, 0, 164));
-                format.setForeground(pink);
-            }
-            else if (tok.type == Tokenizer::Invalid)
-            {
-                QBrush red(QColor(255, 0, 0));
-                format.setBackground(red);
-            }
-            else
-            {
-                QBrush red(QColor(255, 0, 0));
-                format.setForeground(red);
-            }
+void DocumentEditor::scheduleAnalysis()
+{
+    if (isVisible())
+        analysisTimer->start();
+}
 
-            tcur.setCharFormat(format);
-        }
-    }
-    else
+void DocumentEditor::startAnalysis()
+{
+    Document* doc = currentDocument();
+    // one analysis at a time; the next one is started when it finishes
+    if (analysisWatcher->isRunning() || !isVisible())
+        return;
+    if (doc->isAnalyzed())
+        return;
+    analysisWatcher->setFuture(doc->reparseAsync());
+}
+
+void DocumentEditor::onAnalysisFinished()
+{
+    Document* doc = currentDocument();
+    if (doc->applyAnalysis(analysisWatcher->result()))
+        invalidateHighlighting();
+    else if (!analysisTimer->isActive())
+        startAnalysis(); // the text changed while analyzing
+}
+
+// colour of a token
+static QTextCharFormat tokenFormat(const ParserToken& ptok, const QTextCharFormat& format_base)
+{
+    QTextCharFormat format = format_base;
+
+    switch (ptok.type)
     {
-        for (QList<ParserToken>::iterator it = doc->parsedTokens.begin(); it != doc->parsedTokens.end(); ++it)
+        case ParserToken::Comment:
         {
-            ParserToken& ptok = (*it);
+            QBrush gray(QColor(0x00, 0x80, 0x00));
+            format.setForeground(gray);
+            format.setFontItalic(true);
+            break;
+        }
 
-            if (ptok.type == ParserToken::Invalid)
-            {
-                for (int i = ptok.startsAt; i < ptok.endsAt; i++)
-                {
-                    tcur.setPosition(i);
-                    tcur.setPosition(i+1, QTextCursor::KeepAnchor);
-                    QTextCharFormat lfmt = tcur.charFormat();
-                    lfmt.setUnderlineColor(QColor(255, 0, 0));
-                    lfmt.setUnderlineStyle(QTextCharFormat::SpellCheckUnderline);
-                    tcur.setCharFormat(lfmt);
-                }
+        case ParserToken::Preprocessor:
+        {
+            QBrush blue(QColor(0x00, 0x00, 0x80));
+            format.setForeground(blue);
+            format.setFontWeight(QFont::Bold);
+            break;
+        }
 
-                continue;
-            }
+        case ParserToken::Keyword:
+        {
+            QBrush blue(QColor(0x80, 0x80, 0x00));
+            format.setForeground(blue);
+            break;
+        }
 
-            tcur.setPosition(ptok.startsAt);
-            tcur.setPosition(ptok.endsAt, QTextCursor::KeepAnchor);
+        case ParserToken::TypeName:
+        {
+            QBrush green(QColor(0x80, 0x00, 0x80));
+            QBrush system(QColor(0x80, 0x80, 0x00));
+            if (ptok.modifiers & ParserToken::SystemType)
+                format.setForeground(system);
+            else format.setForeground(green);
+            break;
+        }
 
-            QTextCharFormat format = format_base;
+        case ParserToken::String:
+        {
+            QBrush green(QColor(0x00, 0x80, 0x00));
+            format.setForeground(green);
+            format.setFontWeight(QFont::Bold);
+            break;
+        }
 
-            switch (ptok.type)
-            {
-                case ParserToken::Comment:
-                {
-                    QBrush gray(QColor(0x00, 0x80, 0x00));
-                    format.setForeground(gray);
-                    format.setFontItalic(true);
-                    break;
-                }
+        case ParserToken::ConstantName:
+        {
+            QBrush brown(QColor(0x80, 0x00, 0x80));
+            format.setForeground(brown);
+            break;
+        }
 
-                case ParserToken::Preprocessor:
-                {
-                    QBrush blue(QColor(0x00, 0x00, 0x80));
-                    format.setForeground(blue);
-                    format.setFontWeight(QFont::Bold);
-                    break;
-                }
+        case ParserToken::Number:
+        {
+            QBrush pink(QColor(0x00, 0x00, 0x80));
+            format.setForeground(pink);
+            break;
+        }
 
-                case ParserToken::Keyword:
-                {
-                    QBrush blue(QColor(0x80, 0x80, 0x00));
-                    format.setForeground(blue);
-                    break;
-                }
+        case ParserToken::SpecialToken:
+        case ParserToken::Operator:
+        {
+            QBrush red(QColor(0x00, 0x00, 0x00));
+            format.setForeground(red);
+            break;
+        }
 
-                case ParserToken::TypeName:
-                {
-                    QBrush green(QColor(0x80, 0x00, 0x80));
-                    QBrush system(QColor(0x80, 0x80, 0x00));
-                    if (ptok.reference && ptok.reference->type() == ZTreeNode::SystemType)
-                        format.setForeground(system);
-                    else format.setForeground(green);
-                    break;
-                }
+        case ParserToken::Argument:
+        case ParserToken::Local:
+        {
+            QBrush local(QColor(0x09, 0x2e, 0x64));
+            format.setForeground(local);
+            break;
+        }
 
-                case ParserToken::String:
-                {
-                    QBrush green(QColor(0x00, 0x80, 0x00));
-                    format.setForeground(green);
-                    format.setFontWeight(QFont::Bold);
-                    break;
-                }
+        case ParserToken::Field:
+        {
+            QBrush field(QColor(0x80, 0x00, 0x00));
+            format.setForeground(field);
+            break;
+        }
 
-                case ParserToken::ConstantName:
-                {
-                    QBrush brown(QColor(0x80, 0x00, 0x80));
-                    format.setForeground(brown);
-                    break;
-                }
+        case ParserToken::Method:
+        {
+            QBrush method(QColor(0x00, 0x67, 0x7c));
+            format.setForeground(method);
+            break;
+        }
 
-                case ParserToken::Number:
-                {
-                    QBrush pink(QColor(0x00, 0x00, 0x80));
-                    format.setForeground(pink);
-                    break;
-                }
+        default:
+            break;
+    }
 
-                case ParserToken::SpecialToken:
-                case ParserToken::Operator:
-                {
-                    QBrush red(QColor(0x00, 0x00, 0x00));
-                    format.setForeground(red);
-                    break;
-                }
+    return format;
+}
 
-                case ParserToken::Argument:
-                case ParserToken::Local:
-                {
-                    QBrush local(QColor(0x09, 0x2e, 0x64));
-                    format.setForeground(local);
-                    break;
-                }
+// what a token looks like before the parser has seen it. identifiers stay plain until the analysis knows what they are
+static ParserToken::TokenType lexicalTokenType(Tokenizer::TokenType type)
+{
+    switch (type)
+    {
+    case Tokenizer::LineComment:
+    case Tokenizer::BlockComment:
+        return ParserToken::Comment;
+    case Tokenizer::String:
+    case Tokenizer::Name:
+        return ParserToken::String;
+    case Tokenizer::Integer:
+    case Tokenizer::Double:
+        return ParserToken::Number;
+    case Tokenizer::Preprocessor:
+        return ParserToken::Preprocessor;
+    case Tokenizer::Identifier:
+    case Tokenizer::Whitespace:
+    case Tokenizer::Newline:
+    case Tokenizer::Invalid:
+        return ParserToken::Text;
+    default:
+        return ParserToken::Operator;
+    }
+}
 
-                case ParserToken::Field:
-                {
-                    QBrush field(QColor(0x80, 0x00, 0x00));
-                    format.setForeground(field);
-                    break;
-                }
+void DocumentEditor::invalidateHighlighting()
+{
+    highlightGeneration++;
+    scheduleHighlighting();
+}
 
-                case ParserToken::Method:
-                {
-                    QBrush method(QColor(0x00, 0x67, 0x7c));
-                    format.setForeground(method);
-                    break;
-                }
+void DocumentEditor::resizeEvent(QResizeEvent* event)
+{
+    QPlainTextEdit::resizeEvent(event);
+    scheduleHighlighting();
+}
 
-                default:
-                    break;
+void DocumentEditor::scheduleHighlighting()
+{
+    if (highlightQueued)
+        return;
+    highlightQueued = true;
+    QMetaObject::invokeMethod(this, "highlightVisibleBlocks", Qt::QueuedConnection);
+}
+
+void DocumentEditor::highlightVisibleBlocks()
+{
+    // blocks that get new formats are repainted; their update requests find everything up to date
+    highlightQueued = false;
+    // blocks on screen, and a few around them so that scrolling by a line doesn't show plain text
+    static const int nearbyBlocks = 16;
+    QTextBlock block = firstVisibleBlock();
+    for (int i = 0; i < nearbyBlocks && block.previous().isValid(); i++)
+        block = block.previous();
+    int bottom = viewport()->rect().bottom();
+    int after = nearbyBlocks;
+    for (; block.isValid() && after > 0; block = block.next())
+    {
+        if (block.isVisible() && blockBoundingGeometry(block).translated(contentOffset()).top() > bottom)
+            after--;
+        if (block.userState() != highlightGeneration)
+            highlightBlock(block);
+    }
+}
+
+void DocumentEditor::highlightBlock(QTextBlock block)
+{
+    ZZ_PROFILE_SCOPE(Highlight);
+    Document* doc = currentDocument();
+    int from = block.position();
+    int to = from + block.length();
+    QTextCharFormat format_base;
+    QVector<QTextLayout::FormatRange> formats;
+
+    ParseSnapshotPtr snapshot = doc->snapshot();
+    if (snapshot != indexedSnapshot)
+    {
+        // split once per analysis, blocks are then looked up by position
+        indexedSnapshot = snapshot;
+        semanticIndex.clear();
+        invalidTokens.clear();
+        if (snapshot)
+        {
+            for (const ParserToken& ptok : snapshot->parsedTokens)
+            {
+                if (ptok.type == ParserToken::Invalid)
+                    invalidTokens.append(ptok);
+                else semanticIndex.append(ptok); // snapshot tokens are sorted already
             }
+        }
+    }
 
-            tcur.setCharFormat(format);
+    // text edited since the analysis is coloured lexically until the next one
+    int snapshotFrom = from;
+    int snapshotTo = to;
+    if (snapshot && doc->mapToSnapshot(snapshotFrom, snapshotTo))
+    {
+        // valid tokens don't overlap, so ends are sorted too
+        QVector<ParserToken>::const_iterator it = std::lower_bound(semanticIndex.constBegin(), semanticIndex.constEnd(), snapshotFrom,
+                                                                   [](const ParserToken& tok, int pos) { return tok.endsAt() <= pos; });
+        for (; it != semanticIndex.constEnd() && it->startsAt < snapshotTo; ++it)
+        {
+            QTextLayout::FormatRange range;
+            range.start = qMax(it->startsAt, snapshotFrom) - snapshotFrom;
+            range.length = qMin(it->endsAt(), snapshotTo) - snapshotFrom - range.start;
+            range.format = tokenFormat(*it, format_base);
+            formats.append(range);
+        }
+        for (const ParserToken& ptok : invalidTokens)
+        {
+            if (ptok.endsAt() <= snapshotFrom || ptok.startsAt >= snapshotTo)
+                continue;
+            QTextLayout::FormatRange range;
+            range.start = qMax(ptok.startsAt, snapshotFrom) - snapshotFrom;
+            range.length = qMin(ptok.endsAt(), snapshotTo) - snapshotFrom - range.start;
+            range.format.setUnderlineColor(QColor(255, 0, 0));
+            range.format.setUnderlineStyle(QTextCharFormat::SpellCheckUnderline);
+            formats.append(range);
+        }
+    }
+    else
+    {
+        if (!doc->isLexed())
+            doc->relex();
+        // lexical tokens are sorted and don't overlap
+        QList<Tokenizer::Token>::const_iterator it = std::lower_bound(doc->tokens.constBegin(), doc->tokens.constEnd(), from,
+                                                                      [](const Tokenizer::Token& tok, int pos) { return tok.endsAt <= pos; });
+        for (; it != doc->tokens.constEnd() && it->startsAt < to; ++it)
+        {
+            ParserToken::TokenType type = lexicalTokenType(it->type);
+            if (type == ParserToken::Text)
+                continue;
+            QTextLayout::FormatRange range;
+            range.start = qMax(it->startsAt, from) - from;
+            range.length = qMin(it->endsAt, to) - from - range.start;
+            range.format = tokenFormat(ParserToken(*it, type), format_base);
+            formats.append(range);
         }
     }
-    tcur.endEditBlock();
-    this->setUpdatesEnabled(true);
+
+    ZZ_PROFILE_SCOPE(ApplyFormats);
+    block.layout()->setFormats(formats);
+    block.setUserState(highlightGeneration);
+    // relayout of this block only. reported as a format change, which is ignored while processing
+    processing = true;
+    document()->markContentsDirty(from, block.length());
     processing = false;
 }
 
+// part of the text of a QTextDocument, same as the corresponding part of toPlainText()
+static QString plainText(QTextDocument* document, int from, int to)
+{
+    QTextCursor cursor(document);
+    cursor.setPosition(from);
+    cursor.setPosition(to, QTextCursor::KeepAnchor);
+    QString text = cursor.selectedText();
+    for (QChar& c : text)
+    {
+        if (c == QChar::ParagraphSeparator || c == QChar::LineSeparator)
+            c = '\n';
+        else if (c == QChar::Nbsp)
+            c = ' ';
+    }
+    return text;
+}
+
+void DocumentEditor::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    if (processing)
+        return; // highlighting
+
+    DocumentTab* tab = qobject_cast<DocumentTab*>(parentWidget());
+    if (!tab || !tab->document())
+        return;
+    if (tab->document()->syncing)
+    {
+        // whole text replaced
+        tab->document()->noteEdit(-1, 0, 0);
+        return;
+    }
+
+    // format-only changes report the same amount of removed and added characters, but we don't do those outside of processing
+    if (charsRemoved || charsAdded)
+    {
+        Document* doc = tab->document();
+        // only the added characters are copied out of the editor
+        int textLength = document()->characterCount()-1; // without the final paragraph separator
+        QString added;
+        if (charsAdded > 0)
+            added = plainText(document(), position, qMin(position+charsAdded, textLength));
+        // contentsChange sometimes reports a range that includes the final paragraph separator. then the text is taken as a whole
+        if (!doc->applyEdit(position, charsRemoved, added) || doc->source->length() != textLength)
+            doc->setText(toPlainText());
+    }
+}
+
 void DocumentEditor::contextMenuEvent(QContextMenuEvent* event)
 {
 
@@ -504,20 +927,12 @@ bool DocumentEditor::event(QEvent* event)
         cursor.select(QTextCursor::WordUnderCursor);
         if (!cursor.selectedText().isEmpty())
         {
-            int anchor = cursor.anchor();
-            ParserToken* tok = nullptr;
-            for (ParserToken& ptok : doc->parsedTokens)
-            {
-                if (ptok.startsAt <= anchor && ptok.endsAt > anchor)
-                {
-                    tok = &ptok;
-                    break;
-                }
-            }
-
+            // the snapshot stays valid while the analysis thread reparses the file
+            ParseSnapshotPtr snapshot = doc->snapshot();
+            const ParserToken* tok = snapshot ? snapshot->tokenAt(cursor.anchor()) : nullptr;
             if (tok)
             {
-                QToolTip::showText(helpEvent->globalPos(), makeTokenTooltip(tok));
+                QToolTip::showText(helpEvent->globalPos(), makeTokenTooltip(*snapshot, tok));
             }
             else
             {
@@ -533,78 +948,57 @@ bool DocumentEditor::event(QEvent* event)
     return QPlainTextEdit::event(event);
 }
 
-QString DocumentEditor::makeTokenTooltip(ParserToken* tok)
+static QString typeClassName(ZTreeNode::NodeType type, const QString& defaultName)
+{
+    switch (type)
+    {
+    case ZTreeNode::Class:
+        return "class";
+    case ZTreeNode::Struct:
+        return "struct";
+    case ZTreeNode::Enum:
+        return "enum";
+    case ZTreeNode::SystemType:
+        return "system";
+    default:
+        return defaultName;
+    }
+}
+
+QString DocumentEditor::makeTokenTooltip(const ParseSnapshot& snapshot, const ParserToken* tok)
 {
+    const ParseSnapshot::Symbol* symbol = snapshot.tokenSymbol(*tok);
+    bool resolved = symbol && symbol->referenceType != ZTreeNode::Generic;
+    QString referencePath = symbol ? symbol->referencePath : QString();
     if (tok->type == ParserToken::TypeName)
     {
-        if (tok->reference)
+        if (resolved)
         {
-            QString typeclass = "class";
-            switch (tok->reference->type())
-            {
-            case ZTreeNode::Struct:
-                typeclass = "struct";
-                break;
-            case ZTreeNode::Enum:
-                typeclass = "enum";
-                break;
-            case ZTreeNode::SystemType:
-                typeclass = "system";
-                break;
-            default:
-                break;
-            }
-            return "<b>Type</b> " + typeclass + " <i>" + tok->referencePath + "</i>";
+            return "<b>Type</b> " + typeClassName(symbol->referenceType, "class") + " <i>" + referencePath + "</i>";
         }
         else
         {
-            return "<b>Unresolved type</b> <i>" + tok->referencePath + "</i>";
+            return "<b>Unresolved type</b> <i>" + referencePath + "</i>";
         }
     }
     else if (tok->type == ParserToken::Local)
     {
-        if (tok->reference)
+        if (resolved)
         {
-            QString typelocal = "<b>Local</b>";
-            QSharedPointer<ZLocalVariable> local = tok->reference.dynamicCast<ZLocalVariable>();
-            QString addauto = local->hasType ? "" : "auto ";
+            QString typelocal = symbol->isArgument ? "<b>Argument</b>" : "<b>Local</b>";
+            QString addauto = symbol->hasType ? "" : "auto ";
             QString typeclass = " (unresolved "+addauto+"type) ";
-            QSharedPointer<ZTreeNode> localParent = local->parent.toStrongRef();
-            if (localParent && localParent->type() == ZTreeNode::Method)
-                typelocal = "<b>Argument</b>";
             // get type of variable if present
-            ZCompoundType vtype = local->varType;
-            if (!local->hasType && local->children.size() && local->children[0]->type() == ZTreeNode::Expression)
-            {
-                ZExpression* localExpr = reinterpret_cast<ZExpression*>(local->children[0].get());
-                vtype = localExpr->resultType;
-            }
-            QSharedPointer<ZTreeNode> vtypeReference = vtype.reference.toStrongRef();
-            if (vtypeReference)
-            {
-                switch (vtypeReference->type())
-                {
-                case ZTreeNode::Class:
-                    typeclass = " "+addauto+"class ";
-                    break;
-                case ZTreeNode::Struct:
-                    typeclass = " "+addauto+"struct ";
-                    break;
-                case ZTreeNode::Enum:
-                    typeclass = " "+addauto+"enum ";
-                    break;
-                case ZTreeNode::SystemType:
-                    typeclass = " "+addauto+"";
-                    break;
-                default:
-                    break;
-                }
-            }
-            return typelocal + typeclass + vtype.type + " <i>" + tok->referencePath + "</i>";
+            QString typeName = typeClassName(symbol->typeReferenceType, QString());
+            if (symbol->typeReferenceType == ZTreeNode::SystemType)
+                typeclass = " "+addauto+"";
+            else if (!typeName.isEmpty())
+                typeclass = " "+addauto+typeName+" ";
+            return typelocal + typeclass + symbol->typeName + " <i>" + referencePath + "</i>";
         }
         else
         {
-            return "<b>Unresolved local</b> <i>" + tok->referencePath + "</i>";
+            return "<b>Unresolved local</b> <i>" + referencePath + "</i>";
         }
     }
 
@@ -613,5 +1007,18 @@ QString DocumentEditor::makeTokenTooltip(ParserToken* tok)
 
 void DocumentEditor::showEvent(QShowEvent* event)
 {
-    onTextChanged();
+    QPlainTextEdit::showEvent(event);
+    // switching back to a tab costs nothing if its text didn't change. blocks keep their formats from before
+    if (!currentDocument()->isAnalyzed())
+        scheduleAnalysis();
+}
+
+void DocumentEditor::hideEvent(QHideEvent* event)
+{
+    QPlainTextEdit::hideEvent(event);
+    analysisTimer->stop();
+    // also sent while the tab is being closed
+    DocumentTab* tab = qobject_cast<DocumentTab*>(parentWidget());
+    if (tab && tab->document())
+        tab->document()->submitText();
 }
@@ -5,9 +5,17 @@
 #include <QWidget>
 #include <QPlainTextEdit>
 #include <QContextMenuEvent>
+#include <QTextBlock>
+#include <QTimer>
+#include <QFuture>
+#include <QFutureWatcher>
+#include <QAtomicInt>
 #include "tokenizer.h"
 #include "parser.h"
 #include "project.h"
+#include "sourcefile.h"
+#include "queryengine.h"
+#include "parsesnapshot.h"
 
 class DocumentTab;
 class Document
@@ -16,26 +24,122 @@ public:
     Document(DocumentTab* tab = nullptr);
     ~Document();
 
+    // result of an analysis. taken by applyAnalysis only if the text didn't change since
+    struct Analysis
+    {
+        int version;
+        bool cancelled;
+        ParseSnapshotPtr snapshot;
+
+        Analysis()
+        {
+            version = -1;
+            cancelled = false;
+        }
+    };
+
     void parse();
+    // synchronous analysis, on the calling thread
     void reparse();
+    // analysis of the current text on a worker thread. waits for the previous one, which should be cancelled first
+    QFuture<Analysis> reparseAsync();
+    // returns false if the results are outdated or cancelled
+    bool applyAnalysis(const Analysis& analysis);
+    // the running analysis stops at the next query; its results are then dropped by applyAnalysis
+    void cancelAnalysis(bool wait = false);
+    bool isAnalyzing() const { return analysis.isRunning(); }
+    // version is the content version, analyzedVersion the version of the last applied analysis
+    bool isAnalyzed() const { return analyzedVersion == version; }
+    // hands the text to the engine without analyzing it, i.e. when the tab is hidden. the engine then has the current
+    // declarations for other files' queries; the semantic tokens of this one wait until it is shown again
+    void submitText();
+    // lexical tokens of the whole current text. done on demand: a document opened from the project is
+    // coloured from the project's semantic tokens, and lexed only once the user edits it
+    void relex();
+    bool isLexed() const { return lexedVersion == version; }
     void setTab(DocumentTab* tab);
-    void save();
+    // result of save. if the declarations changed, the dependents have to be analyzed again (see invalidateAnalysis)
+    struct SaveResult
+    {
+        bool saved;
+        // set only for files of the project
+        bool declarationsChanged;
+        QSet<QString> dependents;
+        // why the file was not saved
+        QString error;
+
+        SaveResult()
+        {
+            saved = false;
+            declarationsChanged = false;
+        }
+    };
+
+    // writes the file and invalidates only this file in the engine
+    SaveResult save();
+    // the results are outdated because another file changed. files outside of the project are not affected
+    void invalidateAnalysis();
+    // the engine was given the text on disk while this was being edited (see MainWindow::projectChangesApplied).
+    // the edits stay; the next analysis sends the whole text
+    void resubmitText();
     DocumentTab* getTab();
 
-    void syncFromSource(ProjectFile* pf = nullptr);
+    // queries is the project's engine if the file is part of the project
+    void syncFromSource(ProjectFile* pf = nullptr, QueryEngine* queries = nullptr);
+    // the project is about to be replaced: the document keeps its text, and is analyzed by an engine of its own
+    // until it's synced with the new project
+    void detachFromProject();
+    bool hasOwnEngine() const { return ownqueries; }
+    // results of the project load for the same text, shown over the document's own analysis while the project is
+    // loading. returns false if the text was edited, or the document's own analysis is not done yet
+    bool showSnapshot(ParseSnapshotPtr snapshot);
+    // edit since the last reparse, from QTextDocument::contentsChange. position < 0 means the whole text changed
+    void noteEdit(int position, int charsRemoved, int charsAdded);
+    // user edit: applied to the source and the lexical tokens right away. returns false if it doesn't fit the current text
+    bool applyEdit(int position, int charsRemoved, const QString& added);
+    // whole text replaced
+    void setText(const QString& text);
 
     bool isnew;
     QString fullPath;
     QString location;
-    QString contents;
+    // shared with ProjectFile if the document was opened from the project
+    QSharedPointer<SourceFile> source;
+    // true while the editor text is being replaced from the source; such changes are not user edits
+    bool syncing;
     QList<Tokenizer::Token> tokens;
-    QList<ParserToken> parsedTokens;
+    // incremented on every change of the text
+    int version;
+
+    // results of the last applied analysis (semantic tokens, symbols, diagnostics). nullptr before the first one
+    ParseSnapshotPtr snapshot() const { return currentSnapshot.load(); }
+    // maps a range of the current text to the text of snapshot(). returns false if the range was edited since
+    bool mapToSnapshot(int& from, int& to) const;
 
 private:
-    // parsed tokens and such are valid until reparse
-    Parser* parser;
-    bool ownparser;
+    ParseSnapshotSlot currentSnapshot;
+    // files outside of a project get an engine of their own
+    QueryEngine* queries;
+    bool ownqueries;
     DocumentTab* tab;
+    int lexedVersion;
+    // relexes only around an edit that was just noted
+    void relex(int position, int charsRemoved, int charsAdded);
+
+    // edits since the last analysis are merged into one and passed on to the engine, which can then reparse
+    // one method body. 1 if edit is valid, -1 if unknown
+    int editCount;
+    QueryEngine::TextEdit edit;
+
+    // edits made after the text of the current snapshot, each in the coordinates of the text right after it.
+    // position < 0 is an unknown change
+    QList<QueryEngine::TextEdit> snapshotEdits;
+    QList<int> snapshotEditVersions;
+
+    QFuture<Analysis> analysis;
+    QSharedPointer<QAtomicInt> analysisCancel;
+    int analyzedVersion;
+    static Analysis analyze(QueryEngine* queries, QString path, QString text, int editCount, QueryEngine::TextEdit edit, int version, QSharedPointer<QAtomicInt> cancel);
 };
 
 class DocumentEditor;
@@ -74,14 +178,46 @@ public:
     void contextMenuEvent(QContextMenuEvent *event) override;
     bool event(QEvent* event) override;
     void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
+
+    // starts the analysis once typing pauses, if the tab is visible. hidden tabs are analyzed when shown
+    void scheduleAnalysis();
 
 public slots:
     void onTextChanged();
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+
+protected:
+    void resizeEvent(QResizeEvent* event) override;
+
+private slots:
+    void startAnalysis();
+    void onAnalysisFinished();
+    // queues highlightVisibleBlocks, once
+    void scheduleHighlighting();
+    void highlightVisibleBlocks();
 
 private:
     bool processing;
-
-    QString makeTokenTooltip(ParserToken* tok);
+    // semantic analysis starts once typing pauses
+    QTimer* analysisTimer;
+    QFutureWatcher<Document::Analysis>* analysisWatcher;
+
+    // highlighting is applied to the blocks on screen as additional layout formats (not part of the text, so not in
+    // the undo stack), after a scroll or update and outside of the paint event: applying formats relayouts the block.
+    // a block is up to date if its userState is highlightGeneration
+    int highlightGeneration;
+    bool highlightQueued;
+    // semantic tokens of indexedSnapshot sorted by position, and its Invalid tokens (drawn over the others)
+    ParseSnapshotPtr indexedSnapshot;
+    QVector<ParserToken> semanticIndex;
+    QVector<ParserToken> invalidTokens;
+
+    Document* currentDocument();
+    void highlightBlock(QTextBlock block);
+    void invalidateHighlighting();
+
+    QString makeTokenTooltip(const ParseSnapshot& snapshot, const ParserToken* tok);
 };
 
 #endif // DOCUMENT_H
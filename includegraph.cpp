@@ -0,0 +1,154 @@
+#include "includegraph.h"
+#include "project.h"
+
+QString IncludeGraph::key(const QString& path)
+{
+    return Project::fixPath(path).toLower();
+}
+
+void IncludeGraph::addFile(ProjectFile* file)
+{
+    files.insert(key(file->relativePath), file);
+}
+
+void IncludeGraph::removeFile(const QString& path)
+{
+    QString k = key(path);
+    setIncludes(path, QList<ProjectFile*>());
+    // files that include this one keep their edge to it, so that the file is picked up again if it reappears.
+    // only the index entry goes away
+    files.remove(k);
+}
+
+ProjectFile* IncludeGraph::file(const QString& path) const
+{
+    return files.value(key(path), nullptr);
+}
+
+void IncludeGraph::setIncludes(const QString& path, const QList<ProjectFile*>& included)
+{
+    QString k = key(path);
+    // drop old reverse edges
+    QSet<QString> old = forward.take(k);
+    for (const QString& target : old)
+    {
+        QHash<QString, QSet<QString>>::iterator it = reverse.find(target);
+        if (it == reverse.end())
+            continue;
+        it->remove(k);
+        if (it->isEmpty())
+            reverse.erase(it);
+    }
+
+    if (included.isEmpty())
+        return;
+
+    QSet<QString>& edges = forward[k];
+    for (ProjectFile* f : included)
+    {
+        QString target = key(f->relativePath);
+        edges.insert(target);
+        reverse[target].insert(k);
+    }
+}
+
+void IncludeGraph::clearIncludes()
+{
+    forward.clear();
+    reverse.clear();
+}
+
+QList<ProjectFile*> IncludeGraph::includes(const QString& path) const
+{
+    QList<ProjectFile*> out;
+    for (const QString& target : forward.value(key(path)))
+    {
+        ProjectFile* f = files.value(target, nullptr);
+        if (f) out.append(f);
+    }
+    return out;
+}
+
+QList<ProjectFile*> IncludeGraph::affectedBy(const QString& path) const
+{
+    // breadth-first walk over reverse edges. every file is visited once
+    QList<ProjectFile*> out;
+    QSet<QString> visited;
+    QStringList queue;
+    QString k = key(path);
+    visited.insert(k);
+    queue.append(k);
+    for (int i = 0; i < queue.size(); i++)
+    {
+        ProjectFile* f = files.value(queue[i], nullptr);
+        if (f) out.append(f);
+        QHash<QString, QSet<QString>>::const_iterator it = reverse.constFind(queue[i]);
+        if (it == reverse.constEnd())
+            continue;
+        for (const QString& source : *it)
+        {
+            if (visited.contains(source))
+                continue;
+            visited.insert(source);
+            queue.append(source);
+        }
+    }
+    return out;
+}
+
+QList<QStringList> IncludeGraph::cycles() const
+{
+    QList<QStringList> out;
+    QHash<QString, int> state; // 1 = on stack, 2 = done
+    for (QHash<QString, QSet<QString>>::const_iterator it = forward.constBegin(); it != forward.constEnd(); ++it)
+    {
+        if (!state.contains(it.key()))
+            findCycles(it.key(), state, out);
+    }
+    return out;
+}
+
+void IncludeGraph::findCycles(const QString& start, QHash<QString, int>& state, QList<QStringList>& out) const
+{
+    // depth-first walk with an explicit stack, so that a long include chain can't overflow the call stack.
+    // stack holds the files on the current path, targets and next the edges of each of them still to follow
+    QStringList stack;
+    QList<QStringList> targets;
+    QList<int> next;
+    state.insert(start, 1);
+    stack.append(start);
+    targets.append(forward.value(start).values());
+    next.append(0);
+    while (!stack.isEmpty())
+    {
+        int top = stack.size() - 1;
+        if (next[top] >= targets[top].size())
+        {
+            state.insert(stack[top], 2);
+            stack.removeLast();
+            targets.removeLast();
+            next.removeLast();
+            continue;
+        }
+        QString target = targets[top][next[top]++];
+        int targetState = state.value(target, 0);
+        if (targetState == 1)
+        {
+            // back edge: everything on the stack from the target up to here is the cycle
+            QStringList cycle = stack.mid(stack.lastIndexOf(target));
+            for (QString& p : cycle)
+            {
+                ProjectFile* f = files.value(p, nullptr);
+                if (f) p = f->relativePath;
+            }
+            out.append(cycle);
+        }
+        else if (targetState == 0)
+        {
+            state.insert(target, 1);
+            stack.append(target);
+            targets.append(forward.value(target).values());
+            next.append(0);
+        }
+    }
+}
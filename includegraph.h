@@ -0,0 +1,48 @@
+#ifndef INCLUDEGRAPH_H
+#define INCLUDEGRAPH_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QHash>
+#include <QSet>
+
+struct ProjectFile;
+
+// Path index and include edges of a project.
+// Paths are project-relative (i.e. "Reference/zscript/actor.txt") and compared case-insensitively, same as GZDoom lump lookup.
+// Lookups are O(1); affectedBy() is O(affected files).
+class IncludeGraph
+{
+public:
+    // normalized lookup key for a path
+    static QString key(const QString& path);
+
+    // path index
+    void addFile(ProjectFile* file);
+    void removeFile(const QString& path);
+    ProjectFile* file(const QString& path) const;
+    int fileCount() const { return files.size(); }
+
+    // edges. setIncludes replaces all outgoing edges of a file and updates the reverse edges of the targets
+    void setIncludes(const QString& path, const QList<ProjectFile*>& included);
+    void clearIncludes();
+    QList<ProjectFile*> includes(const QString& path) const;
+
+    // the file itself and every file that includes it, directly or through other files.
+    // this is what has to be invalidated when the file changes
+    QList<ProjectFile*> affectedBy(const QString& path) const;
+
+    // every include cycle, as a list of paths where the last one includes the first one
+    QList<QStringList> cycles() const;
+
+private:
+    QHash<QString, ProjectFile*> files;
+    QHash<QString, QSet<QString>> forward;
+    QHash<QString, QSet<QString>> reverse;
+
+    // cycles reachable from start that were not found yet
+    void findCycles(const QString& start, QHash<QString, int>& state, QList<QStringList>& out) const;
+};
+
+#endif // INCLUDEGRAPH_H
@@ -0,0 +1,127 @@
+#include "libraryindex.h"
+#include "project.h"
+
+#include <QElapsedTimer>
+
+LibraryIndex::LibraryIndex()
+{
+    //
+}
+
+LibraryIndex::~LibraryIndex()
+{
+    // not needed anymore
+}
+
+QSharedPointer<const LibraryIndex> LibraryIndex::load(QString path)
+{
+    QElapsedTimer timer;
+    timer.start();
+    Project* project = new Project(path);
+    // nobody edits the library, so its method bodies are only needed for the parse cache. they are parsed here,
+    // before the library is frozen: the cache is written on the first load and nothing touches the library afterwards
+    project->lazyMethodBodies = false;
+    if (!project->parseProject())
+        qDebug("LibraryIndex: %s parsed with errors", path.toUtf8().data());
+    if (!project->findFile(project->projectName + "/zscript.txt"))
+    {
+        delete project;
+        return nullptr;
+    }
+    QSharedPointer<const LibraryIndex> index = build(project);
+    qDebug("LibraryIndex: %s loaded in %lld ms, %d types", path.toUtf8().data(), timer.elapsed(), index->typeIndex.size());
+    return index;
+}
+
+QSharedPointer<const LibraryIndex> LibraryIndex::build(Project* project)
+{
+    QSharedPointer<LibraryIndex> index = QSharedPointer<LibraryIndex>(new LibraryIndex());
+    index->libProject.reset(project);
+
+    for (ProjectFile& f : project->files)
+    {
+        if (!f.parser || !f.parser->root)
+            continue;
+        QList<QSharedPointer<ZTreeNode>> ownTypes = f.parser->getOwnTypeInformation();
+        index->allTypes.append(ownTypes);
+        for (QSharedPointer<ZTreeNode> type : ownTypes)
+        {
+            index->frozenTypes.insert(type.data());
+            index->indexType(type);
+        }
+    }
+
+    return index;
+}
+
+void LibraryIndex::indexType(QSharedPointer<ZTreeNode> type)
+{
+    // first one wins, same as a search through the types in order (see Parser::resolveType and resolveSymbol)
+    QString key = type->identifier.toLower();
+    if (type->type() == ZTreeNode::Constant)
+    {
+        if (!constantIndex.contains(key))
+            constantIndex.insert(key, type);
+        return;
+    }
+    if (type->type() != ZTreeNode::Class && type->type() != ZTreeNode::Struct && type->type() != ZTreeNode::Enum)
+        return;
+
+    // extend classes are found through the class they extend, but their members are looked up separately
+    if (type->type() != ZTreeNode::Class || type.dynamicCast<ZClass>()->extendName.isEmpty())
+    {
+        if (!typeIndex.contains(key))
+            typeIndex.insert(key, type);
+    }
+
+    if (type->type() == ZTreeNode::Enum)
+    {
+        for (QSharedPointer<ZTreeNode> enode : type->children)
+        {
+            QString ekey = enode->identifier.toLower();
+            if (enode->type() == ZTreeNode::Constant && !constantIndex.contains(ekey))
+                constantIndex.insert(ekey, enode);
+        }
+        return;
+    }
+
+    QHash<QString, QSharedPointer<ZTreeNode>>& members = memberIndex[type.data()];
+    for (QSharedPointer<ZTreeNode> member : type->children)
+    {
+        if (member->type() == ZTreeNode::Field || member->type() == ZTreeNode::Method || member->type() == ZTreeNode::Constant)
+        {
+            QString mkey = member->identifier.toLower();
+            if (!members.contains(mkey))
+                members.insert(mkey, member);
+        }
+        else if (member->type() == ZTreeNode::Enum)
+        {
+            for (QSharedPointer<ZTreeNode> enode : member->children)
+            {
+                QString ekey = enode->identifier.toLower();
+                if (enode->type() == ZTreeNode::Constant && !members.contains(ekey))
+                    members.insert(ekey, enode);
+            }
+        }
+    }
+}
+
+QString LibraryIndex::name() const
+{
+    return libProject->projectName;
+}
+
+QByteArray LibraryIndex::contextHash() const
+{
+    return libProject->contextHash;
+}
+
+QSharedPointer<ZClassOverlay> LibraryIndex::classOverlay() const
+{
+    QSharedPointer<ZClassOverlay> overlay = QSharedPointer<ZClassOverlay>(new ZClassOverlay());
+    overlay->frozen = frozenTypes;
+    overlay->libraryTypes = typeIndex;
+    overlay->libraryConstants = constantIndex;
+    overlay->libraryMembers = memberIndex;
+    return overlay;
+}
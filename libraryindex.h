@@ -0,0 +1,54 @@
+#ifndef LIBRARYINDEX_H
+#define LIBRARYINDEX_H
+
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QSet>
+#include <QScopedPointer>
+#include <QSharedPointer>
+#include "parser.h"
+
+class Project;
+
+// Read-only index of a base library (the gzdoom Reference).
+// The library is parsed once, then frozen: nothing modifies its AST afterwards, so one index is shared
+// by every user project and document. User classes that extend, inherit or replace library classes
+// keep these edges in their own ZClassOverlay (see classOverlay()).
+// The parsers of a project look up library types, members and constants through hashes in the overlay.
+class LibraryIndex
+{
+public:
+    ~LibraryIndex();
+
+    // parses the project at path and freezes it. returns nullptr if the project could not be parsed at all
+    static QSharedPointer<const LibraryIndex> load(QString path);
+    // freezes an already parsed project. the index takes ownership of it
+    static QSharedPointer<const LibraryIndex> build(Project* project);
+
+    QString name() const;
+    const Project* project() const { return libProject.data(); }
+    // project context hash (see Project::contextHash). user projects include it in their own
+    QByteArray contextHash() const;
+
+    // top-level types, in the form expected by Parser::setTypeInformation
+    const QList<QSharedPointer<ZTreeNode>>& types() const { return allTypes; }
+    bool isLibraryType(const ZTreeNode* node) const { return frozenTypes.contains(node); }
+
+    // new overlay for a user project on top of this library. the lookup tables of the library are shared with it
+    QSharedPointer<ZClassOverlay> classOverlay() const;
+
+private:
+    LibraryIndex();
+    void indexType(QSharedPointer<ZTreeNode> type);
+
+    QScopedPointer<Project> libProject;
+    QList<QSharedPointer<ZTreeNode>> allTypes;
+    QSet<const ZTreeNode*> frozenTypes;
+    // see ZClassOverlay
+    QHash<QString, QSharedPointer<ZTreeNode>> typeIndex;
+    QHash<QString, QSharedPointer<ZTreeNode>> constantIndex;
+    QHash<const ZTreeNode*, QHash<QString, QSharedPointer<ZTreeNode>>> memberIndex;
+};
+
+#endif // LIBRARYINDEX_H
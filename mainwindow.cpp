@@ -2,15 +2,27 @@
 #include <QBoxLayout>
 #include <QSplitter>
 
-#include <QTreeWidget>
-#include <QTreeWidgetItem>
+#include <QTreeView>
 
 #include <QDir>
+#include <QFileInfo>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QStatusBar>
+#include <QMessageBox>
+#include <QMenuBar>
+#include <QPushButton>
+#include <QFontDatabase>
+#include <QtConcurrent>
 
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include "profiler.h"
 
 MainWindow* MainWindow::ptr = nullptr;
+// gzdoom Reference, loaded with the first project that isn't the Reference itself
+static const char* libraryPath = "../ZZscript/Reference"; // todo: unhardcode this
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
@@ -21,14 +33,69 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->setupUi(this);
 
     project = nullptr;
+    projectSerial = 0;
+
+    // zero interval: runs whenever the event queue is empty
+    bodyTimer = new QTimer(this);
+    bodyTimer->setInterval(0);
+    connect(bodyTimer, SIGNAL(timeout()), this, SLOT(parseMethodBodiesIdle()));
+
+    watcher = new ProjectWatcher(this);
+    connect(watcher, SIGNAL(changed(QStringList)), this, SLOT(projectFilesChanged(QStringList)));
+
+    loadWatcher = new QFutureWatcher<void>(this);
+    connect(loadWatcher, SIGNAL(finished()), this, SLOT(projectLoaded()));
+    loadProgressTimer = new QTimer(this);
+    loadProgressTimer->setInterval(100);
+    connect(loadProgressTimer, SIGNAL(timeout()), this, SLOT(showLoadProgress()));
+    changeWatcher = new QFutureWatcher<ChangeBatch>(this);
+    connect(changeWatcher, SIGNAL(finished()), this, SLOT(projectChangesApplied()));
 
     //createDocument();
-    connect(ui->currentProjectTree, SIGNAL(itemDoubleClicked(QTreeWidgetItem*,int)), this, SLOT(projectTreeDoubleClicked(QTreeWidgetItem*,int)));
-    loadProject("../ZZscript/Reference"); // todo: unhardcode this
+    treeModel = new ProjectTreeModel(this);
+    ui->currentProjectTree->setModel(treeModel);
+    // all rows have the same height; the view doesn't have to lay out every row to scroll
+    ui->currentProjectTree->setUniformRowHeights(true);
+    connect(ui->currentProjectTree, SIGNAL(doubleClicked(QModelIndex)), this, SLOT(projectTreeDoubleClicked(QModelIndex)));
+
+    // hidden until opened from the View menu. refreshed while visible
+    statsDock = new QDockWidget("Statistics", this);
+    statsDock->setObjectName("statsDock");
+    QWidget* statsWidget = new QWidget(statsDock);
+    QVBoxLayout* statsLayout = new QVBoxLayout(statsWidget);
+    statsText = new QPlainTextEdit(statsWidget);
+    statsText->setReadOnly(true);
+    statsText->setLineWrapMode(QPlainTextEdit::NoWrap);
+    statsText->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    QPushButton* statsReset = new QPushButton("Reset", statsWidget);
+    connect(statsReset, SIGNAL(clicked()), this, SLOT(resetStatistics()));
+    statsLayout->addWidget(statsText);
+    statsLayout->addWidget(statsReset);
+    statsDock->setWidget(statsWidget);
+    addDockWidget(Qt::RightDockWidgetArea, statsDock);
+    statsDock->hide();
+    QMenu* menuView = menuBar()->addMenu("&View");
+    menuView->addAction(statsDock->toggleViewAction());
+    statsTimer = new QTimer(this);
+    statsTimer->setInterval(1000);
+    connect(statsTimer, SIGNAL(timeout()), this, SLOT(showStatistics()));
+    statsTimer->start();
+
+    // the project is the first command line argument. without one, the Reference itself is opened
+    QStringList arguments = QCoreApplication::arguments();
+    loadProject(arguments.size() > 1 ? arguments[1] : QString(libraryPath));
 }
 
 MainWindow::~MainWindow()
 {
+    // the load thread uses the project
+    if (loadWatcher->isRunning())
+    {
+        project->cancelLoad();
+        loadWatcher->waitForFinished();
+    }
+    // and so does a change batch. it can't be cancelled halfway
+    changeWatcher->waitForFinished();
     assert (ptr == this);
     ptr = nullptr;
     delete ui;
@@ -86,80 +153,259 @@ void MainWindow::unloadDocument(Document* doc)
         }
     }
 
+    documents.removeAll(doc);
     delete doc;
 }
 
-static QTreeWidgetItem* makeItem(QTreeWidget* w, QString path)
+void MainWindow::reloadTreeFromProject()
 {
-    QStringList p = path.split('/');
-    QTreeWidgetItem* parent = nullptr;
-    for (int i = 0; i < p.size(); i++)
+    // directories that were open stay open when the file list changes
+    QStringList expanded;
+    for (const QString& path : treeModel->fetchedDirectories())
     {
-        if (!i)
-        {
-            QList<QTreeWidgetItem*> items = w->findItems(p[i], Qt::MatchExactly);
-            if (items.size() > 1)
-                return nullptr; // wtf?
-            if (!items.size())
-            {
-                if (parent)
-                    parent = new QTreeWidgetItem(parent);
-                else parent = new QTreeWidgetItem(w);
-                parent->setText(0, p[i]);
-            }
-            else parent = items[0];
-        }
-        else if (parent)
+        if (ui->currentProjectTree->isExpanded(treeModel->indexForPath(path)))
+            expanded.append(path);
+    }
+
+    treeModel->setProject(project);
+    if (!project) return;
+
+    // rows are created as directories are expanded. a new project starts with its top level open
+    bool restored = false;
+    for (const QString& path : expanded)
+    {
+        QModelIndex index = treeModel->indexForPath(path);
+        if (!index.isValid())
+            continue;
+        ui->currentProjectTree->expand(index);
+        restored = true;
+    }
+    if (!restored)
+        ui->currentProjectTree->expand(treeModel->indexForPath(project->projectName));
+}
+
+void MainWindow::loadProject(QString path)
+{
+    loadTimer.start();
+    // a load that is still running is for the project being replaced
+    if (loadWatcher->isRunning())
+    {
+        project->cancelLoad();
+        loadWatcher->waitForFinished();
+    }
+    changeWatcher->waitForFinished();
+    changesWaiting.clear();
+    projectSerial++;
+    // open documents may be analyzing with the old project's engine
+    for (Document* doc : documents)
+        doc->detachFromProject();
+    watcher->clear();
+    bodyTimer->stop();
+    if (project) delete project;
+    // the Reference is parsed once and frozen; projects are layered on top of it. the Reference itself is opened
+    // as a plain project, its types would be there twice otherwise
+    bool isLibrary = (QFileInfo(path).canonicalFilePath() == QFileInfo(libraryPath).canonicalFilePath());
+    project = new Project(path, isLibrary ? nullptr : library);
+    // only declarations are parsed here. bodies are parsed when a file is opened, or in the background
+    project->lazyMethodBodies = true;
+    reloadTreeFromProject();
+    qDebug("loadProject: %s scanned in %lld ms, parsing in the background", path.toUtf8().data(), loadTimer.elapsed());
+
+    Project* loading = project;
+    QSharedPointer<const LibraryIndex> library = this->library;
+    loadWatcher->setFuture(QtConcurrent::run([loading, library, isLibrary]()
+    {
+        if (!isLibrary)
+            loading->setLibrary(library ? library : LibraryIndex::load(libraryPath));
+        loading->parseProject();
+    }));
+    loadProgressTimer->start();
+    showLoadProgress();
+}
+
+void MainWindow::projectLoaded()
+{
+    // finished() of a load that was replaced
+    if (loadWatcher->isRunning() || !project)
+        return;
+    loadProgressTimer->stop();
+    statusBar()->clearMessage();
+    if (project->library)
+        library = project->library;
+    qDebug("loadProject: %s parsed in %lld ms", project->projectName.toUtf8().data(), loadTimer.elapsed());
+
+    joinOpenDocuments();
+    loadWaiting.clear();
+    watcher->watch(project);
+    bodyTimer->start();
+}
+
+void MainWindow::joinOpenDocuments()
+{
+    // documents opened meanwhile join the project, unless their text is not what was parsed (edited, or saved
+    // after the file was read): those keep their own engine
+    for (Document* doc : documents)
+    {
+        if (doc->isnew || !doc->hasOwnEngine())
+            continue;
+        ProjectFile* pf = project->findFileByFullPath(doc->fullPath);
+        if (pf && pf->source && pf->source->text() == doc->source->text())
+            doc->syncFromSource(pf, &project->queries);
+    }
+}
+
+void MainWindow::showStatistics()
+{
+    if (!statsDock->isVisible())
+        return;
+    statsText->setPlainText(Profiler::report());
+}
+
+void MainWindow::resetStatistics()
+{
+    Profiler::reset();
+    statsText->setPlainText(Profiler::report());
+}
+
+void MainWindow::showLoadProgress()
+{
+    if (!project)
+        return;
+    int done = project->loadDone.loadAcquire();
+    int total = project->loadTotal.loadAcquire();
+    switch (project->loadPhase.loadAcquire())
+    {
+        case Project::LoadPending:
+            statusBar()->showMessage(QString("Loading %1: reading the Reference...").arg(project->projectName));
+            break;
+        case Project::LoadDeclarations:
+            statusBar()->showMessage(QString("Loading %1: declarations, %2 of %3 files").arg(project->projectName).arg(done).arg(total));
+            break;
+        case Project::LoadClasses:
+            statusBar()->showMessage(QString("Loading %1: classes, %2 of %3 files").arg(project->projectName).arg(done).arg(total));
+            break;
+        default:
+            break;
+    }
+
+    // files opened while loading show the project's results as soon as their class passes are done
+    for (Document* doc : documents)
+    {
+        if (!loadWaiting.contains(doc->fullPath))
+            continue;
+        ProjectFile* pf = project->findFileByFullPath(doc->fullPath);
+        ParseSnapshotPtr snapshot = pf ? pf->snapshot.load() : nullptr;
+        if (!snapshot)
+            continue;
+        if (doc->showSnapshot(snapshot) || doc->source->isEdited())
+            loadWaiting.removeAll(doc->fullPath);
+    }
+}
+
+void MainWindow::projectFilesChanged(QStringList paths)
+{
+    if (!project)
+        return;
+    if (project->archive)
+    {
+        // archives are read as a whole
+        loadProject(project->basePath);
+        return;
+    }
+
+    // one batch at a time; what changes meanwhile is the next one
+    if (changeWatcher->isRunning())
+    {
+        for (const QString& path : paths)
         {
-            QTreeWidgetItem* child = nullptr;
-            for (int j = 0; j < parent->childCount(); j++)
-            {
-                if (!parent->child(j)->text(0).compare(p[i], Qt::CaseInsensitive))
-                {
-                    child = parent->child(j);
-                    break;
-                }
-            }
-            if (!child)
-            {
-                child = new QTreeWidgetItem(parent);
-                child->setText(0, p[i]);
-            }
-            parent = child;
+            if (!changesWaiting.contains(path))
+                changesWaiting.append(path);
         }
-        else return nullptr; // wtf?
+        return;
     }
 
-    return parent;
+    // a branch switch can reread hundreds of files: the window stays responsive while that runs. analyses stop at
+    // their next query, the batch takes the engine after them. edits made meanwhile are analyzed after the batch
+    changeTimer.start();
+    for (Document* doc : documents)
+        doc->cancelAnalysis();
+    bodyTimer->stop();
+    Project* changing = project;
+    int serial = projectSerial;
+    changeWatcher->setFuture(QtConcurrent::run([changing, serial, paths]()
+    {
+        ChangeBatch batch;
+        batch.serial = serial;
+        batch.paths = paths;
+        QMutexLocker locker(changing->queries.mutex());
+        batch.fileListRevision = changing->fileListRevision;
+        changing->applyChanges(paths, batch.reread, batch.outdated);
+        return batch;
+    }));
 }
 
-void MainWindow::reloadTreeFromProject()
+void MainWindow::projectChangesApplied()
 {
-    ui->currentProjectTree->clear();
-    if (!project) return;
+    ChangeBatch batch = changeWatcher->result();
+    // loadProject waited for this batch, then replaced the project
+    if (!project || batch.serial != projectSerial)
+        return;
+    {
+        QMutexLocker locker(project->queries.mutex());
+        watcher->watch(project);
+    }
+    if (project->fileListRevision != batch.fileListRevision)
+        reloadTreeFromProject();
 
-    QTreeWidgetItem* root = makeItem(ui->currentProjectTree, project->projectName);
-    for (const QString& dir : project->directories)
+    // open documents show the new text, unless they have unsaved edits (applyChanges keeps those)
+    for (Document* doc : documents)
     {
-        QTreeWidgetItem* dirItem = makeItem(ui->currentProjectTree, dir);
-        // todo mark directory
+        if (batch.reread.contains(doc->fullPath))
+        {
+            ProjectFile* pf = project->findFileByFullPath(doc->fullPath);
+            if (!pf || !doc->source->isEdited() || doc->hasOwnEngine())
+            {
+                doc->syncFromSource(pf, &project->queries);
+                continue;
+            }
+            // edited while the batch was reading it: the edits are kept, like the ones applyChanges saw
+            {
+                QMutexLocker locker(project->queries.mutex());
+                pf->source = doc->source;
+            }
+            doc->resubmitText();
+        }
+        else if (batch.outdated.contains(doc->fullPath))
+            doc->invalidateAnalysis();
     }
-    for (const ProjectFile& pf : project->files)
+    // opened while the batch was running
+    joinOpenDocuments();
+    // new files may have method bodies to parse
+    bodyTimer->start();
+    qDebug("projectFilesChanged: %d paths in %lld ms", batch.paths.size(), changeTimer.elapsed());
+
+    if (!changesWaiting.isEmpty())
     {
-        QTreeWidgetItem* fileItem = makeItem(ui->currentProjectTree, pf.relativePath);
-        // todo mark file type
-        fileItem->setData(0, Qt::UserRole, pf.fullPath);
+        QStringList paths = changesWaiting;
+        changesWaiting.clear();
+        projectFilesChanged(paths);
     }
-    // expand all
-    ui->currentProjectTree->expandAll();
 }
 
-void MainWindow::loadProject(QString path)
+void MainWindow::parseMethodBodiesIdle()
 {
-    if (project) delete project;
-    project = new Project(path);
-    reloadTreeFromProject();
-    project->parseProject();
+    // small batches, so that input is never blocked for long. the library parses its bodies while it loads
+    static const int batchSize = 32;
+    // the parsers belong to the engine while an analysis runs; try again on the next tick
+    if (project && !project->queries.mutex()->tryLock())
+        return;
+    bool done = !project || project->parseMethodBodies(batchSize);
+    if (project)
+        project->queries.mutex()->unlock();
+    if (!done)
+        return;
+    qDebug("parseMethodBodiesIdle: all method bodies parsed");
+    bodyTimer->stop();
 }
 
 Project* MainWindow::getProject()
@@ -167,9 +413,9 @@ Project* MainWindow::getProject()
     return project;
 }
 
-void MainWindow::projectTreeDoubleClicked(QTreeWidgetItem* item, int column)
+void MainWindow::projectTreeDoubleClicked(const QModelIndex& index)
 {
-    QString filePath = item->data(column, Qt::UserRole).toString();
+    QString filePath = treeModel->filePath(index);
     if (filePath.isEmpty() || filePath.isNull())
         return; // do nothing
     // check if already open
@@ -184,15 +430,16 @@ void MainWindow::projectTreeDoubleClicked(QTreeWidgetItem* item, int column)
         }
     }
 
-    // get project file
-    ProjectFile* pf = nullptr;
-    for (ProjectFile& spf : project->files)
+    // get project file. while a change batch runs, the project's files are being replaced: the file is analyzed on its
+    // own, and joins the project when the batch is done
+    bool applying = changeWatcher->isRunning();
+    ProjectFile* pf = (project && !applying) ? project->findFileByFullPath(filePath) : nullptr;
+    // while the project is loading, the file is analyzed on its own, and its class passes are moved to the front
+    bool loading = loadWatcher->isRunning();
+    if (loading && pf)
     {
-        if (spf.fullPath == filePath)
-        {
-            pf = &spf;
-            break;
-        }
+        project->prioritize(filePath);
+        loadWaiting.append(filePath);
     }
 
     Document* doc = createDocument();
@@ -200,7 +447,9 @@ void MainWindow::projectTreeDoubleClicked(QTreeWidgetItem* item, int column)
     QStringList pathSep = filePath.split('/');
     doc->location = pathSep.last();
     doc->fullPath = filePath;
-    doc->syncFromSource(pf);
+    if (loading || applying)
+        doc->syncFromSource();
+    else doc->syncFromSource(pf, project ? &project->queries : nullptr);
     // now, if there is a project, this means we can pull parsed data from there
     DocumentTab* tab = doc->getTab();
     ui->editorTabs->setTabText(ui->editorTabs->indexOf(tab), doc->location);
@@ -218,7 +467,26 @@ void MainWindow::on_actionSave_File_triggered()
     // get current tab and store to filesystem
     DocumentTab* tab = qobject_cast<DocumentTab*>(ui->editorTabs->currentWidget());
     if (!tab) return;
-    tab->document()->save();
+    Document::SaveResult result = tab->document()->save();
+    if (!result.saved)
+    {
+        QMessageBox::warning(this, "Save File", QString("Could not save %1: %2").arg(tab->document()->fullPath, result.error));
+        return;
+    }
+    if (!result.declarationsChanged || !project)
+        return;
+    // only the files that include this one or read its declarations show outdated results
+    QStringList outdated;
+    {
+        // a change batch may be running, it changes the include graph
+        QMutexLocker locker(project->queries.mutex());
+        outdated = project->markDependentsOutdated(tab->document()->fullPath, result.dependents);
+    }
+    for (Document* doc : documents)
+    {
+        if (outdated.contains(doc->fullPath))
+            doc->invalidateAnalysis();
+    }
 }
 
 void MainWindow::on_actionClose_File_triggered()
@@ -227,6 +495,7 @@ void MainWindow::on_actionClose_File_triggered()
     DocumentTab* tab = qobject_cast<DocumentTab*>(ui->editorTabs->currentWidget());
     if (!tab) return;
     Document* doc = tab->document();
+    documents.removeAll(doc);
     delete tab;
     delete doc;
 }
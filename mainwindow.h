@@ -3,9 +3,17 @@
 
 #include <QMainWindow>
 #include <QList>
-#include <QTreeWidgetItem>
+#include <QModelIndex>
+#include <QTimer>
+#include <QFutureWatcher>
+#include <QElapsedTimer>
+#include <QDockWidget>
+#include <QPlainTextEdit>
 #include "document.h"
 #include "project.h"
+#include "libraryindex.h"
+#include "projectwatcher.h"
+#include "projecttreemodel.h"
 
 namespace Ui {
 class MainWindow;
@@ -30,7 +38,7 @@ public:
     void loadProject(QString path);
 
 public slots:
-    void projectTreeDoubleClicked(QTreeWidgetItem* item, int column);
+    void projectTreeDoubleClicked(const QModelIndex& index);
 
 private slots:
     void on_actionQuit_triggered();
@@ -39,6 +47,21 @@ private slots:
 
     void on_actionClose_File_triggered();
 
+    // low-priority pass over lazy method bodies
+    void parseMethodBodiesIdle();
+
+    // batch of changes made outside of the editor. applied on a worker, the results are taken over when it is done
+    void projectFilesChanged(QStringList paths);
+    void projectChangesApplied();
+
+    // background project load
+    void projectLoaded();
+    void showLoadProgress();
+
+    // Profiler totals, in the statistics dock
+    void showStatistics();
+    void resetStatistics();
+
 private:
     Ui::MainWindow *ui;
     static MainWindow *ptr;
@@ -48,9 +71,43 @@ private:
     //
     void makeTabForDocument(Document* doc);
     void reloadTreeFromProject();
+    // documents that are analyzed on their own join the project's engine if the project parsed the same text
+    void joinOpenDocuments();
 
     //
     Project* project;
+    ProjectTreeModel* treeModel;
+    // gzdoom Reference, shared by every project
+    QSharedPointer<const LibraryIndex> library;
+    QTimer* bodyTimer;
+    ProjectWatcher* watcher;
+    // parseProject runs here. the tree is shown and files can be opened meanwhile; they are analyzed on their own
+    // until the project is done
+    QFutureWatcher<void>* loadWatcher;
+    QTimer* loadProgressTimer;
+    QElapsedTimer loadTimer;
+    // opened while loading, still showing their own analysis
+    QStringList loadWaiting;
+    // counts loadProject calls. a change batch that finishes after its project was replaced is dropped
+    int projectSerial;
+    // results of Project::applyChanges, see projectFilesChanged
+    struct ChangeBatch
+    {
+        ChangeBatch() : serial(0), fileListRevision(0) {}
+        int serial;
+        int fileListRevision;
+        QStringList paths;
+        QStringList reread;
+        QStringList outdated;
+    };
+    // applyChanges runs here, with the engine's mutex held. files opened meanwhile are analyzed on their own
+    QFutureWatcher<ChangeBatch>* changeWatcher;
+    QElapsedTimer changeTimer;
+    // changes that came in while a batch was running; they are the next batch
+    QStringList changesWaiting;
+    QDockWidget* statsDock;
+    QPlainTextEdit* statsText;
+    QTimer* statsTimer;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,383 @@
+#include "parsecache.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <cstring>
+
+// on-disk layout. everything is native endian; this is a local cache, not an exchange format
+enum CacheSection
+{
+    CacheStrings, // CacheStringRecord
+    CacheStringData, // UTF-16 code units
+    CacheTokens, // CacheTokenRecord
+    CacheSemanticTokens, // ParserToken
+    CacheSymbols, // string index
+    CacheDiagnostics, // CacheDiagnosticRecord
+    CacheSectionCount
+};
+
+static const quint32 cacheMagic = 0x43505a5a; // "ZZPC"
+static const int cacheHashSize = 20; // sha1
+
+struct CacheSectionInfo
+{
+    quint32 offset; // from the start of the file, 8-aligned
+    quint32 count; // records
+};
+
+struct CacheHeader
+{
+    quint32 magic;
+    quint32 formatVersion;
+    quint32 parserVersion;
+    quint32 reserved;
+    quint8 contentHash[cacheHashSize];
+    quint8 contextHash[cacheHashSize]; // all zeroes if there are no semantic results
+    CacheSectionInfo sections[CacheSectionCount];
+};
+
+struct CacheStringRecord
+{
+    quint32 offset; // in UTF-16 code units
+    quint32 length;
+};
+
+struct CacheTokenRecord
+{
+    quint64 type;
+    qint64 valueInt;
+    double valueDouble;
+    qint32 startsAt;
+    qint32 endsAt;
+    qint32 line;
+    quint32 value;
+    quint32 isValid;
+    quint32 reserved;
+};
+
+struct CacheDiagnosticRecord
+{
+    quint32 severity;
+    qint32 line;
+    quint32 message;
+    quint32 reserved;
+};
+
+Q_STATIC_ASSERT(sizeof(CacheHeader) % 8 == 0);
+Q_STATIC_ASSERT(sizeof(CacheTokenRecord) == 48);
+
+static const quint32 cacheRecordSizes[CacheSectionCount] =
+{
+    sizeof(CacheStringRecord),
+    sizeof(ushort),
+    sizeof(CacheTokenRecord),
+    sizeof(ParserToken),
+    sizeof(quint32),
+    sizeof(CacheDiagnosticRecord)
+};
+
+// string table used while writing. equal strings are stored once
+struct CacheStringTable
+{
+    QHash<QString, quint32> index;
+    QVector<CacheStringRecord> records;
+    QVector<ushort> data;
+
+    quint32 add(const QString& s)
+    {
+        QHash<QString, quint32>::const_iterator it = index.constFind(s);
+        if (it != index.constEnd())
+            return it.value();
+        CacheStringRecord rec;
+        rec.offset = quint32(data.size());
+        rec.length = quint32(s.length());
+        data.resize(data.size() + s.length());
+        if (s.length())
+            memcpy(data.data() + rec.offset, s.utf16(), s.length() * sizeof(ushort));
+        quint32 i = quint32(records.size());
+        records.append(rec);
+        index.insert(s, i);
+        return i;
+    }
+};
+
+static void appendSection(QByteArray& out, CacheHeader& header, CacheSection section, const void* records, int count)
+{
+    // keep every section 8-aligned, so records can be read in place from the mapping
+    while (out.size() % 8)
+        out.append('\0');
+    header.sections[section].offset = quint32(out.size());
+    header.sections[section].count = quint32(count);
+    if (count)
+        out.append(reinterpret_cast<const char*>(records), int(count * cacheRecordSizes[section]));
+}
+
+static QString findCacheDirectory()
+{
+    QByteArray env = qgetenv("ZZSCRIPT_CACHE_DIR");
+    QString dir;
+    if (!env.isEmpty())
+    {
+        dir = QFile::decodeName(env);
+    }
+    else
+    {
+        QString base = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+        if (base.isEmpty())
+            return QString();
+        dir = base + "/parsecache";
+    }
+
+    if (!QDir().mkpath(dir))
+    {
+        qDebug("ParseCache: cannot create %s, cache disabled", dir.toUtf8().data());
+        return QString();
+    }
+    return dir;
+}
+
+QString ParseCache::directory()
+{
+    // resolved once; function-local static init is thread-safe
+    static const QString cacheDirectory = findCacheDirectory();
+    return cacheDirectory;
+}
+
+QString ParseCache::entryPath(const QByteArray& contentHash)
+{
+    QString dir = directory();
+    if (dir.isEmpty() || contentHash.size() != cacheHashSize)
+        return QString();
+    return QString("%1/%2.v%3.zzc").arg(dir, QString::fromLatin1(contentHash.toHex()), QString::number(Parser::version));
+}
+
+QByteArray ParseCache::contentHash(const QByteArray& data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+}
+
+QSharedPointer<ParseCacheEntry> ParseCache::load(const QByteArray& contentHash)
+{
+    QString path = entryPath(contentHash);
+    if (path.isEmpty())
+        return nullptr;
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return nullptr; // not cached
+
+    quint64 size = quint64(file.size());
+    if (size < sizeof(CacheHeader))
+        return nullptr;
+
+    QByteArray readData;
+    const uchar* data = file.map(0, qint64(size));
+    if (!data)
+    {
+        readData = file.readAll();
+        if (quint64(readData.size()) != size)
+            return nullptr;
+        data = reinterpret_cast<const uchar*>(readData.constData());
+    }
+
+    QSharedPointer<ParseCacheEntry> entry;
+    const CacheHeader* header = reinterpret_cast<const CacheHeader*>(data);
+    bool valid = (header->magic == cacheMagic &&
+                  header->formatVersion == formatVersion &&
+                  header->parserVersion == Parser::version &&
+                  !memcmp(header->contentHash, contentHash.constData(), cacheHashSize));
+    for (int i = 0; valid && i < CacheSectionCount; i++)
+    {
+        const CacheSectionInfo& sec = header->sections[i];
+        if (sec.offset % 8 || quint64(sec.offset) + quint64(sec.count) * cacheRecordSizes[i] > size)
+            valid = false;
+    }
+
+    if (valid)
+    {
+        entry = QSharedPointer<ParseCacheEntry>(new ParseCacheEntry());
+        entry->contentHash = contentHash;
+        static const quint8 noContext[cacheHashSize] = { 0 };
+        if (memcmp(header->contextHash, noContext, cacheHashSize))
+            entry->contextHash = QByteArray(reinterpret_cast<const char*>(header->contextHash), cacheHashSize);
+
+        // strings first, everything else references them by index
+        const CacheSectionInfo& stringSec = header->sections[CacheStrings];
+        const CacheSectionInfo& stringDataSec = header->sections[CacheStringData];
+        const CacheStringRecord* stringRecs = reinterpret_cast<const CacheStringRecord*>(data + stringSec.offset);
+        const QChar* stringData = reinterpret_cast<const QChar*>(data + stringDataSec.offset);
+        QVector<QString> strings(int(stringSec.count));
+        for (quint32 i = 0; valid && i < stringSec.count; i++)
+        {
+            if (quint64(stringRecs[i].offset) + stringRecs[i].length > stringDataSec.count)
+                valid = false;
+            else strings[i] = QString(stringData + stringRecs[i].offset, int(stringRecs[i].length));
+        }
+
+        quint32 stringCount = quint32(strings.size());
+        const CacheSectionInfo& tokenSec = header->sections[CacheTokens];
+        const CacheTokenRecord* tokenRecs = reinterpret_cast<const CacheTokenRecord*>(data + tokenSec.offset);
+        entry->tokens.reserve(int(tokenSec.count));
+        for (quint32 i = 0; valid && i < tokenSec.count; i++)
+        {
+            const CacheTokenRecord& rec = tokenRecs[i];
+            if (rec.value >= stringCount)
+            {
+                valid = false;
+                break;
+            }
+            Tokenizer::Token tok;
+            tok.type = Tokenizer::TokenType(rec.type);
+            tok.value = strings[int(rec.value)];
+            tok.valueInt = rec.valueInt;
+            tok.valueDouble = rec.valueDouble;
+            tok.isValid = rec.isValid != 0;
+            tok.startsAt = rec.startsAt;
+            tok.endsAt = rec.endsAt;
+            tok.line = rec.line;
+            entry->tokens.append(tok);
+        }
+
+        const CacheSectionInfo& symSec = header->sections[CacheSymbols];
+        const quint32* symRecs = reinterpret_cast<const quint32*>(data + symSec.offset);
+        entry->symbolPaths.reserve(int(symSec.count));
+        for (quint32 i = 0; valid && i < symSec.count; i++)
+        {
+            if (symRecs[i] >= stringCount)
+                valid = false;
+            else entry->symbolPaths.append(strings[int(symRecs[i])]);
+        }
+
+        // semantic tokens are stored as is
+        const CacheSectionInfo& semSec = header->sections[CacheSemanticTokens];
+        if (valid)
+        {
+            entry->semanticTokens.resize(int(semSec.count));
+            if (semSec.count)
+                memcpy(entry->semanticTokens.data(), data + semSec.offset, semSec.count * sizeof(ParserToken));
+            for (const ParserToken& ptok : entry->semanticTokens)
+            {
+                if (ptok.symbol > symSec.count)
+                {
+                    valid = false;
+                    break;
+                }
+            }
+        }
+
+        const CacheSectionInfo& diagSec = header->sections[CacheDiagnostics];
+        const CacheDiagnosticRecord* diagRecs = reinterpret_cast<const CacheDiagnosticRecord*>(data + diagSec.offset);
+        entry->diagnostics.reserve(int(diagSec.count));
+        for (quint32 i = 0; valid && i < diagSec.count; i++)
+        {
+            const CacheDiagnosticRecord& rec = diagRecs[i];
+            if (rec.message >= stringCount)
+            {
+                valid = false;
+                break;
+            }
+            ParserDiagnostic diag;
+            diag.severity = rec.severity ? ParserDiagnostic::Warning : ParserDiagnostic::Error;
+            diag.line = rec.line;
+            diag.message = strings[int(rec.message)];
+            entry->diagnostics.append(diag);
+        }
+    }
+
+    if (readData.isEmpty())
+        file.unmap(const_cast<uchar*>(data));
+
+    if (!valid)
+    {
+        qDebug("ParseCache: discarding stale or damaged %s", path.toUtf8().data());
+        return nullptr;
+    }
+
+    return entry;
+}
+
+bool ParseCache::store(const ParseCacheEntry& entry)
+{
+    QString path = entryPath(entry.contentHash);
+    if (path.isEmpty())
+        return false;
+
+    CacheStringTable strings;
+
+    QVector<CacheTokenRecord> tokens;
+    tokens.reserve(entry.tokens.size());
+    for (const Tokenizer::Token& tok : entry.tokens)
+    {
+        CacheTokenRecord rec;
+        rec.type = quint64(tok.type);
+        rec.valueInt = tok.valueInt;
+        rec.valueDouble = tok.valueDouble;
+        rec.startsAt = tok.startsAt;
+        rec.endsAt = tok.endsAt;
+        rec.line = tok.line;
+        rec.value = strings.add(tok.value);
+        rec.isValid = tok.isValid ? 1 : 0;
+        rec.reserved = 0;
+        tokens.append(rec);
+    }
+
+    QVector<quint32> symbols;
+    symbols.reserve(entry.symbolPaths.size());
+    for (const QString& symbolPath : entry.symbolPaths)
+        symbols.append(strings.add(symbolPath));
+
+    QVector<CacheDiagnosticRecord> diagnostics;
+    diagnostics.reserve(entry.diagnostics.size());
+    for (const ParserDiagnostic& diag : entry.diagnostics)
+    {
+        CacheDiagnosticRecord rec;
+        rec.severity = (diag.severity == ParserDiagnostic::Warning) ? 1 : 0;
+        rec.line = diag.line;
+        rec.message = strings.add(diag.message);
+        rec.reserved = 0;
+        diagnostics.append(rec);
+    }
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = cacheMagic;
+    header.formatVersion = formatVersion;
+    header.parserVersion = Parser::version;
+    memcpy(header.contentHash, entry.contentHash.constData(), cacheHashSize);
+    if (entry.contextHash.size() == cacheHashSize)
+        memcpy(header.contextHash, entry.contextHash.constData(), cacheHashSize);
+
+    QByteArray out(sizeof(CacheHeader), '\0');
+    appendSection(out, header, CacheStrings, strings.records.constData(), strings.records.size());
+    appendSection(out, header, CacheStringData, strings.data.constData(), strings.data.size());
+    appendSection(out, header, CacheTokens, tokens.constData(), tokens.size());
+    appendSection(out, header, CacheSemanticTokens, entry.semanticTokens.constData(), entry.semanticTokens.size());
+    appendSection(out, header, CacheSymbols, symbols.constData(), symbols.size());
+    appendSection(out, header, CacheDiagnostics, diagnostics.constData(), diagnostics.size());
+    memcpy(out.data(), &header, sizeof(header));
+
+    // written to a temporary file and renamed, so a reader never sees a partial entry
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qDebug("ParseCache: cannot write %s", path.toUtf8().data());
+        return false;
+    }
+    file.write(out);
+    return file.commit();
+}
+
+void ParseCache::collect(ParseCacheEntry& entry, Parser* parser, const QByteArray& contextHash)
+{
+    entry.semanticTokens = parser->sortedParsedTokens();
+    entry.symbolPaths.clear();
+    entry.symbolPaths.reserve(parser->symbols.size());
+    for (const ParserSymbol& symbol : parser->symbols)
+        entry.symbolPaths.append(symbol.referencePath);
+    entry.diagnostics = parser->diagnostics;
+    entry.contextHash = contextHash;
+    entry.dirty = true;
+}
@@ -0,0 +1,62 @@
+#ifndef PARSECACHE_H
+#define PARSECACHE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QList>
+#include <QVector>
+#include <QSharedPointer>
+#include "tokenizer.h"
+#include "parser.h"
+
+// Parse results of one file, as stored in the parse cache.
+// Tokens depend only on the file contents. Semantic tokens and diagnostics also depend on the rest of the project
+// (types from other files), so they are only valid while contextHash matches the project.
+// Declarations are not stored: the root and field passes run on every load, other files need the AST of the types.
+struct ParseCacheEntry
+{
+    QByteArray contentHash;
+    QByteArray contextHash; // empty if the entry has no semantic results
+
+    // lexical tokens, exactly as the tokenizer produces them. only kept until handed to the parser and written out
+    QList<Tokenizer::Token> tokens;
+    QVector<ParserToken> semanticTokens;
+    QStringList symbolPaths; // referencePath of every Parser::symbols entry
+    QVector<ParserDiagnostic> diagnostics;
+
+    // true if the entry was not loaded from disk, or was changed since
+    bool dirty;
+
+    ParseCacheEntry() { dirty = false; }
+};
+
+// Persistent, content-addressed parse cache.
+// Every file is stored as <cache dir>/<sha1 of contents>.v<parser version>.zzc. The format is a fixed header followed by
+// sections of fixed-size records (strings are UTF-16 and referenced by index), so a file is read by mapping it
+// and copying the records out, without any parsing.
+// A missing or damaged file, or a format/parser version mismatch, is a cache miss.
+class ParseCache
+{
+public:
+    // the cache directory. ZZSCRIPT_CACHE_DIR overrides the default location
+    static QString directory();
+
+    static QByteArray contentHash(const QByteArray& data);
+
+    // returns nullptr on cache miss. safe to call from loader threads
+    static QSharedPointer<ParseCacheEntry> load(const QByteArray& contentHash);
+    // writes the entry atomically
+    static bool store(const ParseCacheEntry& entry);
+
+    // fills the semantic results from a parser that went through all passes
+    static void collect(ParseCacheEntry& entry, Parser* parser, const QByteArray& contextHash);
+
+    // bump this when the file layout changes
+    static const quint32 formatVersion = 2;
+
+private:
+    static QString entryPath(const QByteArray& contentHash);
+};
+
+#endif // PARSECACHE_H
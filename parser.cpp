@@ -1,5 +1,10 @@
 #include "parser.h"
+#include "profiler.h"
 #include <cmath>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <QMap>
+#include <algorithm>
 
 QList<ZSystemType> Parser::systemTypes = QList<ZSystemType>()
         << ZSystemType("string", ZSystemType::SType_String, 0, "StringStruct")
@@ -35,7 +40,11 @@ QList<ZSystemType> Parser::systemTypes = QList<ZSystemType>()
 
 Parser::Parser(QList<Tokenizer::Token> tokens) : tokens(tokens)
 {
-    //
+    lazyMethodBodies = false;
+    sortedTokens = 0;
+    deadSymbols = 0;
+    currentScope = nullptr;
+    listener = nullptr;
 }
 
 Parser::~Parser()
@@ -45,19 +54,104 @@ Parser::~Parser()
 
 ZTreeNode::ZTreeNode(QSharedPointer<ZTreeNode> p)
 {
+    ZZ_PROFILE_COUNT(NodesAllocated, 1);
     parent = p;
     isValid = false;
 }
 
+// nodes released by destructors on this thread, and whether a destructor further down the stack is freeing them.
+// the count is separate so that nodes without references (i.e. the static system types at exit) never touch the list
+static thread_local QList<QSharedPointer<ZTreeNode>> releasedNodes;
+static thread_local int releasedCount = 0;
+static thread_local bool releasingNodes = false;
+
 ZTreeNode::~ZTreeNode()
 {
-    // not needed anymore
+    releaseLater(children);
+    if (releasingNodes || !releasedCount)
+        return;
+
+    releasingNodes = true;
+    while (releasedCount)
+    {
+        // if this was the last reference, the node's destructor only queues what the node refers to
+        QSharedPointer<ZTreeNode> node = releasedNodes.takeLast();
+        releasedCount--;
+        node.reset();
+    }
+    releasingNodes = false;
+}
+
+void ZTreeNode::releaseLater(QSharedPointer<ZTreeNode> node)
+{
+    if (!node)
+        return;
+    releasedNodes.append(node);
+    releasedCount++;
+}
+
+void ZTreeNode::releaseLater(const ZCompoundType& type)
+{
+    releaseLater(type.arrayDimensions);
+    for (const ZCompoundType& arg : type.arguments)
+        releaseLater(arg);
+}
+
+ZField::~ZField()
+{
+    releaseLater(fieldType);
+}
+
+ZLocalVariable::~ZLocalVariable()
+{
+    releaseLater(varType);
+}
+
+ZMethod::~ZMethod()
+{
+    releaseLater(arguments);
+    for (const ZCompoundType& type : returnTypes)
+        releaseLater(type);
+}
+
+// one thread: freeing is not urgent and shouldn't take cores from the analysis
+class ReclaimPool : public QThreadPool
+{
+public:
+    ReclaimPool() { setMaxThreadCount(1); }
+};
+
+void Parser::retire(Parser* parser)
+{
+    if (!parser)
+        return;
+    // other parsers can refer to the top-level types until the tree is freed. they are detached right away, so that
+    // the engine doesn't depend on when the pool runs to find such references (see QueryEngine::computeClassGraph)
+    if (parser->root)
+    {
+        for (QSharedPointer<ZTreeNode> node : parser->root->children)
+            node->parent.clear();
+    }
+    // waits for the queue on exit
+    static ReclaimPool pool;
+    QtConcurrent::run(&pool, [parser]() { delete parser; });
 }
 
 bool Parser::parse()
 {
+    ZZ_PROFILE_SCOPE(ParseRoot);
     parsedTokens.clear();
+    sortedTokens = 0;
+    shift = PendingShift();
+    symbols.clear();
+    symbolIndex.clear();
+    deadSymbols = 0;
+    diagnostics.clear();
     types.clear();
+    typeIndex.clear();
+    constantIndex.clear();
+    pendingBodies.clear();
+    restoredBodies.clear();
 
     // first off, remove all comments
     for (int i = 0; i < tokens.size(); i++)
@@ -65,8 +159,7 @@ bool Parser::parse()
         Tokenizer::Token& tok = tokens[i];
         if (tok.type != Tokenizer::LineComment && tok.type != Tokenizer::BlockComment)
             continue;
-        ParserToken ptok(tok, ParserToken::Comment);
-        parsedTokens.append(ptok);
+        addParsedToken(tok, ParserToken::Comment);
         tokens.removeAt(i);
         i--;
     }
@@ -173,24 +266,56 @@ bool Parser::consumeTokens(TokenStream& stream, QList<Tokenizer::Token>& out, qu
     return true; // stream ended
 }
 
-void Parser::reportError(QString err)
+void Parser::reportError(QString err, int line)
 {
     qDebug("Parser ERRO: %s", err.toUtf8().data());
+    ParserDiagnostic diag;
+    diag.severity = ParserDiagnostic::Error;
+    diag.line = line;
+    diag.message = err;
+    diag.scope = currentScope;
+    diagnostics.append(diag);
 }
 
-void Parser::reportWarning(QString warn)
+void Parser::reportWarning(QString warn, int line)
 {
     qDebug("Parser WARN: %s", warn.toUtf8().data());
+    ParserDiagnostic diag;
+    diag.severity = ParserDiagnostic::Warning;
+    diag.line = line;
+    diag.message = warn;
+    diag.scope = currentScope;
+    diagnostics.append(diag);
 }
 
 void Parser::setTypeInformation(QList<QSharedPointer<ZTreeNode>> _types)
 {
+    ZZ_PROFILE_SCOPE(LinkTypes);
+    applyPendingShift();
     types = _types;
+    indexTypes();
+    // this can run more than once; warnings from the previous run are replaced
+    if (root)
+    {
+        for (int i = 0; i < diagnostics.size(); i++)
+        {
+            if (diagnostics[i].scope == root.data())
+            {
+                diagnostics.removeAt(i);
+                i--;
+            }
+        }
+    }
+    const ZTreeNode* outerScope = currentScope;
+    currentScope = root.data();
     for (QSharedPointer<ZTreeNode> struc : types)
     {
         // if struct is a class, we need to resolve references to other types (replaces, extends...)
         if (struc->type() != ZTreeNode::Class)
             continue;
+        // frozen library classes are resolved already and must not be touched
+        if (classOverlay && classOverlay->isFrozen(struc.data()))
+            continue;
         QSharedPointer<ZClass> cls = struc.dynamicCast<ZClass>();
         if ((!cls->extendName.isEmpty() && !cls->extendReference) ||
             (!cls->parentName.isEmpty() && !cls->parentReference) ||
@@ -204,42 +329,332 @@ void Parser::setTypeInformation(QList<QSharedPointer<ZTreeNode>> _types)
                 if (!cls2->identifier.compare(cls->extendName, Qt::CaseInsensitive) && !cls2->extendReference)
                 {
                     cls->extendReference = cls2;
-                    cls2->extensions.append(cls);
+                    addClassEdge(cls2, cls, ExtensionEdge);
                 }
                 if (!cls2->identifier.compare(cls->replaceName, Qt::CaseInsensitive))
                 {
                     cls->replaceReference = cls2;
-                    cls2->replacedByReferences.append(cls);
+                    addClassEdge(cls2, cls, ReplacementEdge);
                 }
                 if (!cls2->identifier.compare(cls->parentName, Qt::CaseInsensitive))
                 {
                     cls->parentReference = cls2;
-                    cls2->childrenReferences.append(cls);
+                    addClassEdge(cls2, cls, ChildEdge);
                 }
             }
+            // classes from other files are reported by their own parsers
+            if (cls->parent.toStrongRef() != root)
+                continue;
             if (!cls->extendName.isEmpty() && !cls->extendReference)
-                qDebug("setTypeInformation: warning: extend type %s not found for class %s", cls->extendName.toUtf8().data(), cls->identifier.toUtf8().data());
+                reportWarning(QString::asprintf("setTypeInformation: warning: extend type %s not found for class %s", cls->extendName.toUtf8().data(), cls->identifier.toUtf8().data()), cls->lineNumber);
             if (!cls->replaceName.isEmpty() && !cls->replaceReference)
-                qDebug("setTypeInformation: warning: replaced type %s not found for class %s", cls->replaceName.toUtf8().data(), cls->identifier.toUtf8().data());
+                reportWarning(QString::asprintf("setTypeInformation: warning: replaced type %s not found for class %s", cls->replaceName.toUtf8().data(), cls->identifier.toUtf8().data()), cls->lineNumber);
             if (!cls->parentName.isEmpty() && !cls->parentReference)
-                qDebug("setTypeInformation: warning: parent type %s not found for class %s", cls->parentName.toUtf8().data(), cls->identifier.toUtf8().data());
+                reportWarning(QString::asprintf("setTypeInformation: warning: parent type %s not found for class %s", cls->parentName.toUtf8().data(), cls->identifier.toUtf8().data()), cls->lineNumber);
         }
     }
 
+    resolveTypeSymbols();
+    currentScope = outerScope;
+}
+
+void Parser::indexTypes()
+{
+    // first one wins, same as a search through types in order
+    typeIndex.clear();
+    constantIndex.clear();
+    for (QSharedPointer<ZTreeNode> node : types)
+    {
+        if (classOverlay && classOverlay->isFrozen(node.data()))
+            continue;
+        QString key = node->identifier.toLower();
+        if (node->type() == ZTreeNode::Constant)
+        {
+            if (!constantIndex.contains(key))
+                constantIndex.insert(key, node);
+            continue;
+        }
+        if (node->type() != ZTreeNode::Struct && node->type() != ZTreeNode::Class && node->type() != ZTreeNode::Enum)
+            continue;
+        // extend classes are found through the class they extend
+        if (node->type() == ZTreeNode::Class && !node.dynamicCast<ZClass>()->extendName.isEmpty())
+            continue;
+        if (!typeIndex.contains(key))
+            typeIndex.insert(key, node);
+        if (node->type() != ZTreeNode::Enum)
+            continue;
+        for (QSharedPointer<ZTreeNode> enode : node->children)
+        {
+            QString ekey = enode->identifier.toLower();
+            if (enode->type() == ZTreeNode::Constant && !constantIndex.contains(ekey))
+                constantIndex.insert(ekey, enode);
+        }
+    }
+}
+
+void Parser::noteMembersUsed(QSharedPointer<ZTreeNode> type)
+{
+    if (!listener)
+        return;
+    // the listener can run passes of this parser (fields of another class); those are not part of the current scope
+    const ZTreeNode* outerScope = currentScope;
+    currentScope = nullptr;
+    listener->membersUsed(type);
+    currentScope = outerScope;
+}
+
+void Parser::addClassEdge(QSharedPointer<ZClass> target, QSharedPointer<ZClass> cls, ClassEdge edge)
+{
+    ZClassOverlay::Edges* overlayEdges = nullptr;
+    if (classOverlay && classOverlay->isFrozen(target.data()))
+        overlayEdges = &classOverlay->edges[target.data()];
+
+    QList<QWeakPointer<ZClass>>* edges = nullptr;
+    switch (edge)
+    {
+    case ExtensionEdge:
+        edges = overlayEdges ? &overlayEdges->extensions : &target->extensions;
+        break;
+    case ChildEdge:
+        edges = overlayEdges ? &overlayEdges->childrenReferences : &target->childrenReferences;
+        break;
+    case ReplacementEdge:
+        edges = overlayEdges ? &overlayEdges->replacedByReferences : &target->replacedByReferences;
+        break;
+    }
+
+    // drop edges from classes that were reparsed since
+    for (int i = 0; i < edges->size(); i++)
+    {
+        if (!(*edges)[i])
+        {
+            edges->removeAt(i);
+            i--;
+        }
+    }
+    edges->append(cls);
+}
+
+QList<QWeakPointer<ZClass>> Parser::getClassExtensions(QSharedPointer<ZClass> cls)
+{
+    if (!classOverlay || !classOverlay->isFrozen(cls.data()))
+        return cls->extensions;
+    QList<QWeakPointer<ZClass>> extensions = cls->extensions;
+    QHash<const ZClass*, ZClassOverlay::Edges>::const_iterator it = classOverlay->edges.constFind(cls.data());
+    if (it != classOverlay->edges.constEnd())
+        extensions.append(it->extensions);
+    return extensions;
+}
+
+void Parser::resolveTypeSymbols()
+{
     // go through parsed tokens and find types. and resolve if needed
-    for (ParserToken& token : parsedTokens)
+    // this is done once per symbol, not once per token
+    QVector<bool> resolvedSymbols(symbols.size(), false);
+    for (const ParserToken& token : parsedTokens)
+    {
+        if (token.type != ParserToken::TypeName || !token.symbol || resolvedSymbols[token.symbol-1])
+            continue;
+        resolvedSymbols[token.symbol-1] = true;
+        if (token.modifiers & ParserToken::SystemType)
+            continue;
+        ParserSymbol& symbol = symbols[token.symbol-1];
+        QSharedPointer<ZTreeNode> resolved = resolveType(symbol.referencePath);
+        if (resolved) symbol.reference = resolved;
+        else reportWarning(QString::asprintf("setTypeInformation: warning: unresolved type %s", symbol.referencePath.toUtf8().data()));
+    }
+}
+
+void Parser::restoreSemanticTokens(const QVector<ParserToken>& cachedTokens, const QStringList& cachedSymbolPaths, const QVector<ParserDiagnostic>& cachedDiagnostics)
+{
+    // the other passes ran, only what the bodies produced is taken from the cache
+    applyPendingShift();
+    QMap<int, ZMethod*> bodyStarts;
+    QMap<int, ZMethod*> bodyLines;
+    for (const QSharedPointer<ZMethod>& method : pendingBodies)
+    {
+        if (method->bodyStart < 0 || restoredBodies.contains(method.data()))
+            continue;
+        bodyStarts.insert(method->bodyStart, method.data());
+        bodyLines.insert(method->bodyLine, method.data());
+        restoredBodies.insert(method.data());
+    }
+    if (bodyStarts.isEmpty())
+        return;
+
+    QVector<quint32> restoredSymbols(cachedSymbolPaths.size(), 0);
+    for (ParserToken ptok : cachedTokens)
+    {
+        // comments are already there from parse()
+        if (ptok.type == ParserToken::Comment)
+            continue;
+        QMap<int, ZMethod*>::const_iterator it = bodyStarts.upperBound(int(ptok.startsAt));
+        if (it == bodyStarts.constBegin())
+            continue;
+        --it;
+        if (int(ptok.startsAt) >= it.value()->bodyEnd)
+            continue;
+
+        if (ptok.symbol && int(ptok.symbol) <= cachedSymbolPaths.size())
+        {
+            quint32& handle = restoredSymbols[ptok.symbol-1];
+            if (!handle)
+            {
+                // only type references can be restored, other nodes come from the bodies that were not parsed
+                const QString& path = cachedSymbolPaths[ptok.symbol-1];
+                handle = internSymbol(nullptr, path);
+                ParserSymbol& symbol = symbols[handle-1];
+                if (!symbol.reference && ptok.type == ParserToken::TypeName)
+                {
+                    if (ptok.modifiers & ParserToken::SystemType)
+                        symbol.reference = resolveSystemType(path);
+                    else symbol.reference = resolveType(path);
+                }
+            }
+            ptok.symbol = handle;
+        }
+        else ptok.symbol = 0;
+        parsedTokens.append(ptok);
+    }
+
+    for (ParserDiagnostic diag : cachedDiagnostics)
     {
-        if (token.type == ParserToken::TypeName)
+        QMap<int, ZMethod*>::const_iterator it = bodyLines.upperBound(diag.line);
+        if (it == bodyLines.constBegin())
+            continue;
+        --it;
+        if (diag.line > it.value()->bodyEndLine)
+            continue;
+        // the line of the body can hold a declaration as well; its diagnostics are there already
+        bool duplicate = false;
+        for (const ParserDiagnostic& other : diagnostics)
         {
-            QSharedPointer<ZTreeNode> resolved = resolveType(token.referencePath);
-            if (resolved) token.reference = resolved;
-            else qDebug("setTypeInformation: warning: unresolved type %s", token.referencePath.toUtf8().data());
+            if (other.line == diag.line && other.severity == diag.severity && other.message == diag.message)
+            {
+                duplicate = true;
+                break;
+            }
         }
+        if (duplicate)
+            continue;
+        diag.scope = it.value();
+        diagnostics.append(diag);
+    }
+}
+
+quint32 Parser::internSymbol(QSharedPointer<ZTreeNode> ref, const QString& refPath)
+{
+    if (!ref && refPath.isEmpty())
+        return 0;
+    QPair<ZTreeNode*, QString> key(ref.data(), refPath);
+    quint32 handle = symbolIndex.value(key, 0);
+    if (handle)
+        return handle;
+    ParserSymbol symbol;
+    symbol.reference = ref;
+    symbol.referencePath = refPath;
+    symbols.append(symbol);
+    handle = quint32(symbols.size());
+    symbolIndex.insert(key, handle);
+    return handle;
+}
+
+void Parser::addParsedToken(const Tokenizer::Token& tok, ParserToken::TokenType type, QSharedPointer<ZTreeNode> ref, const QString& refPath)
+{
+    ParserToken ptok(tok, type, internSymbol(ref, refPath));
+    if (ref && ref->type() == ZTreeNode::SystemType)
+        ptok.modifiers |= ParserToken::SystemType;
+    parsedTokens.append(ptok);
+}
+
+void Parser::sortParsedTokens()
+{
+    if (sortedTokens >= parsedTokens.size())
+        return;
+    auto byPosition = [](const ParserToken& a, const ParserToken& b) { return a.startsAt < b.startsAt; };
+    ParserToken* first = parsedTokens.data();
+    ParserToken* middle = first + sortedTokens;
+    ParserToken* last = first + parsedTokens.size();
+    std::stable_sort(middle, last, byPosition);
+    // the tokens of an edited body stay apart from the ones after it until the shift is applied
+    if (shift.method)
+        return;
+    std::inplace_merge(first, middle, last, byPosition);
+    sortedTokens = parsedTokens.size();
+}
+
+QVector<ParserToken> Parser::sortedParsedTokens()
+{
+    sortParsedTokens();
+    if (!shift.method)
+        return parsedTokens;
+    // before the body, the body, after the body
+    QVector<ParserToken> out(parsedTokens.size());
+    const ParserToken* tokens = parsedTokens.constData();
+    ParserToken* next = std::copy(tokens, tokens + shift.tailIndex, out.data());
+    next = std::copy(tokens + sortedTokens, tokens + parsedTokens.size(), next);
+    for (int i = shift.tailIndex; i < sortedTokens; i++, next++)
+    {
+        *next = tokens[i];
+        next->startsAt += shift.posDelta;
     }
+    return out;
+}
+
+void Parser::compactSymbols()
+{
+    QVector<quint32> handles(symbols.size(), 0);
+    for (const ParserToken& ptok : parsedTokens)
+    {
+        if (ptok.symbol && int(ptok.symbol) <= symbols.size())
+            handles[ptok.symbol-1] = 1;
+    }
+    QVector<ParserSymbol> kept;
+    kept.reserve(symbols.size());
+    for (int i = 0; i < symbols.size(); i++)
+    {
+        if (!handles[i])
+            continue;
+        kept.append(symbols[i]);
+        handles[i] = quint32(kept.size());
+    }
+    deadSymbols = 0;
+    if (kept.size() == symbols.size())
+        return;
+
+    symbols = kept;
+    symbolIndex.clear();
+    for (int i = 0; i < symbols.size(); i++)
+        symbolIndex.insert(qMakePair(symbols[i].reference.data(), symbols[i].referencePath), quint32(i+1));
+    for (ParserToken& ptok : parsedTokens)
+    {
+        if (ptok.symbol)
+            ptok.symbol = int(ptok.symbol) <= handles.size() ? handles[ptok.symbol-1] : 0;
+    }
+}
+
+const ParserSymbol* Parser::tokenSymbol(const ParserToken& token) const
+{
+    if (!token.symbol || int(token.symbol) > symbols.size())
+        return nullptr;
+    return &symbols[token.symbol-1];
+}
+
+QString Parser::tokenReferencePath(const ParserToken& token) const
+{
+    const ParserSymbol* symbol = tokenSymbol(token);
+    return symbol ? symbol->referencePath : QString();
+}
+
+QSharedPointer<ZTreeNode> Parser::tokenReference(const ParserToken& token) const
+{
+    const ParserSymbol* symbol = tokenSymbol(token);
+    return symbol ? symbol->reference : QSharedPointer<ZTreeNode>();
 }
 
 QSharedPointer<ZTreeNode> Parser::resolveType(QString name, QSharedPointer<ZStruct> context, bool onlycontext)
 {
+    ZZ_PROFILE_COUNT(ResolveTypeCalls, 1);
     if (!onlycontext && name.toLower() == "string")
         name = "stringstruct"; // this is because of ZScript hack
 
@@ -275,17 +690,17 @@ QSharedPointer<ZTreeNode> Parser::resolveType(QString name, QSharedPointer<ZStru
 
     if (onlycontext) return nullptr;
 
-    // search global type scope
-    for (QSharedPointer<ZTreeNode> node : types)
+    // search global type scope. library types come first, same as in types
+    QString key = nameParts[0].toLower();
+    QSharedPointer<ZTreeNode> found[2] = { classOverlay ? classOverlay->libraryTypes.value(key) : QSharedPointer<ZTreeNode>(), typeIndex.value(key) };
+    for (QSharedPointer<ZTreeNode> node : found)
     {
-        if ((node->type() == ZTreeNode::Struct || node->type() == ZTreeNode::Class || node->type() == ZTreeNode::Enum)
-                && !node->identifier.compare(nameParts[0], Qt::CaseInsensitive))
-        {
-            if (nameParts.size() == 1)
-                return node; // type found
-            else if (node->type() == ZTreeNode::Struct || node->type() == ZTreeNode::Class)
-                return resolveType(nameParts.mid(1).join("."), node.dynamicCast<ZStruct>(), true);
-        }
+        if (!node)
+            continue;
+        if (nameParts.size() == 1)
+            return node; // type found
+        else if (node->type() == ZTreeNode::Struct || node->type() == ZTreeNode::Class)
+            return resolveType(nameParts.mid(1).join("."), node.dynamicCast<ZStruct>(), true);
     }
 
     return nullptr; // not found
@@ -304,6 +719,7 @@ QSharedPointer<ZSystemType> Parser::resolveSystemType(QString name)
 
 QSharedPointer<ZTreeNode> Parser::resolveSymbol(QString name, QSharedPointer<ZTreeNode> parent, QSharedPointer<ZStruct> context)
 {
+    ZZ_PROFILE_COUNT(ResolveSymbolCalls, 1);
     if (name == "self")
     {
         if (context) return context->self;
@@ -377,30 +793,45 @@ QSharedPointer<ZTreeNode> Parser::resolveSymbol(QString name, QSharedPointer<ZTr
                 if (cls->extendReference)
                     cls = cls->extendReference.toStrongRef();
                 extensions.append(cls);
-                if (cls->extensions.size())
+                for (QWeakPointer<ZClass> extCls : getClassExtensions(cls))
                 {
-                    for (QWeakPointer<ZClass> extCls : cls->extensions)
-                    {
-                        if (extCls) extensions.append(extCls.toStrongRef());
-                    }
+                    if (extCls) extensions.append(extCls.toStrongRef());
                 }
                 if (cls->parentReference)
                     contextParent = cls->parentReference.toStrongRef();
             }
             for (QSharedPointer<ZTreeNode> extendContext : extensions)
             {
-                for (QSharedPointer<ZTreeNode> node : extendContext->children)
+                noteMembersUsed(extendContext);
+                // members of library classes are indexed in the overlay
+                const QHash<QString, QSharedPointer<ZTreeNode>>* libraryMembers = nullptr;
+                if (classOverlay)
                 {
-                    if ((node->type() == ZTreeNode::Field ||
-                         node->type() == ZTreeNode::Method ||
-                         node->type() == ZTreeNode::Constant) && !node->identifier.compare(name, Qt::CaseInsensitive))
+                    QHash<const ZTreeNode*, QHash<QString, QSharedPointer<ZTreeNode>>>::const_iterator it = classOverlay->libraryMembers.constFind(extendContext.data());
+                    if (it != classOverlay->libraryMembers.constEnd())
+                        libraryMembers = &it.value();
+                }
+                if (libraryMembers)
+                {
+                    QSharedPointer<ZTreeNode> node = libraryMembers->value(name.toLower());
+                    if (node)
                         return node;
-                    if (node->type() == ZTreeNode::Enum)
+                }
+                else
+                {
+                    for (QSharedPointer<ZTreeNode> node : extendContext->children)
                     {
-                        for (QSharedPointer<ZTreeNode> enode : node->children)
+                        if ((node->type() == ZTreeNode::Field ||
+                             node->type() == ZTreeNode::Method ||
+                             node->type() == ZTreeNode::Constant) && !node->identifier.compare(name, Qt::CaseInsensitive))
+                            return node;
+                        if (node->type() == ZTreeNode::Enum)
                         {
-                            if (enode->type() == ZTreeNode::Constant && !enode->identifier.compare(name, Qt::CaseInsensitive))
-                                return enode;
+                            for (QSharedPointer<ZTreeNode> enode : node->children)
+                            {
+                                if (enode->type() == ZTreeNode::Constant && !enode->identifier.compare(name, Qt::CaseInsensitive))
+                                    return enode;
+                            }
                         }
                     }
                 }
@@ -419,24 +850,11 @@ QSharedPointer<ZTreeNode> Parser::resolveSymbol(QString name, QSharedPointer<ZTr
     }
 
     // check global enums and constants (kind of duplicates the check inside classes)
-    for (QSharedPointer<ZTreeNode> node : types)
-    {
-        if (node->type() == ZTreeNode::Enum)
-        {
-            for (QSharedPointer<ZTreeNode> enode : node->children)
-            {
-                if (enode->type() == ZTreeNode::Constant && !enode->identifier.compare(name, Qt::CaseInsensitive))
-                    return enode;
-            }
-        }
-        else if (node->type() == ZTreeNode::Constant)
-        {
-            if (!node->identifier.compare(name, Qt::CaseInsensitive))
-                return node;
-        }
-    }
-
-    return nullptr;
+    QString key = name.toLower();
+    QSharedPointer<ZTreeNode> node = classOverlay ? classOverlay->libraryConstants.value(key) : QSharedPointer<ZTreeNode>();
+    if (node)
+        return node;
+    return constantIndex.value(key);
 }
 
 QList<QSharedPointer<ZTreeNode>> Parser::getOwnTypeInformation()
@@ -457,7 +875,7 @@ QList<QSharedPointer<ZTreeNode>> Parser::getTypeInformation()
 
 ZStruct::~ZStruct()
 {
-    // not needed anymore?
+    releaseLater(self);
 }
 
 // looks for all type-y parents
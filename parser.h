@@ -2,10 +2,15 @@
 #define PARSER_H
 
 #include <QPair>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QStringList>
 #include <QPointer>
 #include <QSharedPointer>
 #include "tokenizer.h"
 
+struct ZCompoundType;
 class ZTreeNode : public QObject
 {
     Q_OBJECT
@@ -39,9 +44,21 @@ public:
     QString error;
 
     explicit ZTreeNode(QSharedPointer<ZTreeNode> p);
+    // frees the subtree without recursion, see releaseLater
     virtual ~ZTreeNode();
 
     virtual NodeType type() { return Generic; }
+
+protected:
+    // destructors hand their references to other nodes over to the destructor at the bottom of the stack, which
+    // releases them one by one after its own. freeing a tree never recurses, however deep the expressions are
+    static void releaseLater(QSharedPointer<ZTreeNode> node);
+    static void releaseLater(const ZCompoundType& type);
+    template<typename T> static void releaseLater(const QList<QSharedPointer<T>>& nodes)
+    {
+        for (const QSharedPointer<T>& node : nodes)
+            releaseLater(QSharedPointer<ZTreeNode>(node));
+    }
 };
 
 class Parser;
@@ -148,6 +165,7 @@ class ZField : public ZTreeNode
 public:
 
     ZField(QSharedPointer<ZTreeNode> p) : ZTreeNode(p) {}
+    virtual ~ZField();
     virtual NodeType type() { return Field; }
 
     ZCompoundType fieldType;
@@ -165,6 +183,7 @@ class ZLocalVariable : public ZTreeNode
 public:
 
     ZLocalVariable(QSharedPointer<ZTreeNode> p) : ZTreeNode(p) {}
+    virtual ~ZLocalVariable();
     virtual NodeType type() { return LocalVariable; }
 
     bool hasType; // false if "let"
@@ -281,13 +300,14 @@ class ZMethod : public ZTreeNode
     Q_OBJECT
 public:
 
-    ZMethod(QSharedPointer<ZTreeNode> p) : ZTreeNode(p) {}
-    virtual NodeType type() { return Method; }
-
-    virtual ~ZMethod()
+    ZMethod(QSharedPointer<ZTreeNode> p) : ZTreeNode(p)
     {
-        // not needed anymore
+        bodyStart = bodyEnd = -1;
+        bodyLine = bodyEndLine = 0;
     }
+    virtual NodeType type() { return Method; }
+
+    virtual ~ZMethod();
 
     QList<ZCompoundType> returnTypes;
     QList<QSharedPointer<ZLocalVariable>> arguments;
@@ -299,7 +319,14 @@ public:
 
     // children = parsed method statements (expressions, etc)
     // tokens = after parseObjectFields, but before parseObjectMethods
+    // with lazy method bodies, tokens are kept until the body is parsed (see Parser::ensureMethodBody)
     QList<Tokenizer::Token> tokens;
+    // text between the curly braces: [bodyStart, bodyEnd). -1 if the method has no body.
+    // bodyLine is the line of the opening brace, bodyEndLine of the closing one
+    int bodyStart;
+    int bodyEnd;
+    int bodyLine;
+    int bodyEndLine;
 };
 
 class ZStruct : public ZTreeNode
@@ -490,18 +517,18 @@ public:
     // children = ZConstant
 };
 
-struct ParserToken
+// reference of a semantic token. symbols are interned per parser, so tokens that point to the same node share one entry
+struct ParserSymbol
 {
-    Tokenizer::Token token;
-
-    ParserToken()
-    {
-        startsAt = endsAt = 0;
-        type = Text;
-        reference = nullptr;
-    }
+    QString referencePath;
+    QSharedPointer<ZTreeNode> reference;
+};
 
-    enum TokenType
+// compact semantic token record: 16 bytes, no strings or smart pointers inside.
+// reference path and node are looked up lazily through the symbol handle (see Parser::tokenSymbol)
+struct ParserToken
+{
+    enum TokenType : quint8
     {
         Invalid,
         Text,
@@ -521,33 +548,124 @@ struct ParserToken
         SpecialToken
     };
 
-    ParserToken(Tokenizer::Token tok, TokenType type, QSharedPointer<ZTreeNode> ref = nullptr, QString refPath = "")
+    enum Modifier : quint8
     {
-        token = tok;
-        startsAt = token.startsAt;
-        endsAt = token.endsAt;
+        NoModifiers = 0x00,
+        SystemType = 0x01 // TypeName that references a ZSystemType (int, string...)
+    };
+
+    ParserToken()
+    {
+        startsAt = length = 0;
+        type = Text;
+        modifiers = NoModifiers;
+        reserved = 0;
+        symbol = 0;
+    }
+
+    ParserToken(const Tokenizer::Token& tok, TokenType type, quint32 symbol = 0)
+    {
+        startsAt = tok.startsAt;
+        length = tok.endsAt - tok.startsAt;
         this->type = type;
-        reference = ref;
-        referencePath = refPath;
+        modifiers = NoModifiers;
+        reserved = 0;
+        this->symbol = symbol;
     }
 
-    int startsAt;
-    int endsAt;
+    int endsAt() const { return startsAt + length; }
+
+    qint32 startsAt;
+    qint32 length;
     TokenType type;
-    QString referencePath;
-    QSharedPointer<ZTreeNode> reference;
+    quint8 modifiers;
+    quint16 reserved;
+    quint32 symbol; // 0 = no reference, otherwise index+1 into Parser::symbols
+};
+
+Q_STATIC_ASSERT(sizeof(ParserToken) == 16);
+Q_DECLARE_TYPEINFO(ParserToken, Q_PRIMITIVE_TYPE);
+
+// extend, parent and replace edges from user classes into classes of a frozen library (see LibraryIndex).
+// library classes are shared and never modified, so these edges are kept on the user side.
+// one overlay is shared by all parsers of a project
+struct ZClassOverlay
+{
+    struct Edges
+    {
+        QList<QWeakPointer<ZClass>> extensions;
+        QList<QWeakPointer<ZClass>> childrenReferences;
+        QList<QWeakPointer<ZClass>> replacedByReferences;
+    };
+
+    // top-level library types (classes, structs, enums, constants)
+    QSet<const ZTreeNode*> frozen;
+    QHash<const ZClass*, Edges> edges;
+    // lookups into the library, shared by every overlay of it (see LibraryIndex). keys are lowercase names
+    // top-level types, except extend classes
+    QHash<QString, QSharedPointer<ZTreeNode>> libraryTypes;
+    // global constants and constants of global enums
+    QHash<QString, QSharedPointer<ZTreeNode>> libraryConstants;
+    // fields, methods, constants and enum constants declared by each top-level class or struct (own children only)
+    QHash<const ZTreeNode*, QHash<QString, QSharedPointer<ZTreeNode>>> libraryMembers;
+
+    bool isFrozen(const ZTreeNode* node) const { return frozen.contains(node); }
+};
+
+// error or warning reported while parsing. line is -1 if unknown
+struct ParserDiagnostic
+{
+    enum Severity : quint8
+    {
+        Error,
+        Warning
+    };
+
+    ParserDiagnostic()
+    {
+        severity = Error;
+        line = -1;
+        scope = nullptr;
+    }
+
+    Severity severity;
+    int line;
+    QString message;
+    // node whose pass produced this diagnostic (method body or file root), if any. not saved in the parse cache
+    const ZTreeNode* scope;
+};
+
+// receives dependencies of the parser's passes
+class ParserListener
+{
+public:
+    virtual ~ParserListener() {}
+    // members (fields, methods, constants) of type are about to be looked up
+    virtual void membersUsed(QSharedPointer<ZTreeNode> type) = 0;
 };
 
 class Parser
 {
 public:
+    // bump this when parse results change. persistent caches made by an older parser are discarded
+    static const quint32 version = 3;
+
     explicit Parser(QList<Tokenizer::Token> tokens);
     virtual ~Parser();
+    // deletes the parser on the reclaim thread. the tree of a big file takes a while to free, and the parsers
+    // that are replaced on every edit shouldn't make the editor wait for that. its top-level types lose their
+    // parent on the calling thread, before this returns
+    static void retire(Parser* parser);
     // parse() populates initial values (includes, root enums, classes, structs)
     bool parse();
     // setTypeInformation() is used pretty much to concatenate classes from included files into this one.
     // expected usage is that the outside code will call parse() on all includes, then generate combined list of types and do deep parsing.
     void setTypeInformation(QList<QSharedPointer<ZTreeNode>> types);
+    // with an overlay, classes in overlay->frozen are never modified by setTypeInformation; edges into them go to the overlay
+    void setClassOverlay(QSharedPointer<ZClassOverlay> overlay) { classOverlay = overlay; }
+    QSharedPointer<ZClassOverlay> getClassOverlay() { return classOverlay; }
+    // classes that extend cls (extend class), both from cls itself and from the overlay
+    QList<QWeakPointer<ZClass>> getClassExtensions(QSharedPointer<ZClass> cls);
     // parseClassFields and parseStructFields will parse fields and method signatures inside objects
     // (and substructs)
     bool parseClassFields(QSharedPointer<ZClass> cls) { return parseObjectFields(cls, cls); }
@@ -555,14 +673,56 @@ public:
     // parseClassMethods and parseStructMethods will parse method bodies (knowing all possible types and fields at this point)
     bool parseClassMethods(QSharedPointer<ZClass> cls) { return parseObjectMethods(cls, cls); }
     bool parseStructMethods(QSharedPointer<ZStruct> struc) { return parseObjectMethods(nullptr, struc); }
+    // with lazy method bodies, the method pass only records methods and parses enum expressions (skeleton parse).
+    // bodies are parsed on request: ensureMethodBody for one method, parsePendingMethodBodies for a batch of them
+    void setLazyMethodBodies(bool lazy) { lazyMethodBodies = lazy; }
+    bool ensureMethodBody(QSharedPointer<ZMethod> method);
+    // parses up to maxMethods pending bodies. returns the number parsed; errors go to diagnostics as usual
+    int parsePendingMethodBodies(int maxMethods);
+    bool hasPendingMethodBodies() const { return !pendingBodies.isEmpty(); }
+    bool isMethodBodyPending(QSharedPointer<ZMethod> method) const { return pendingBodies.contains(method); }
+    // first pending body in file order, or nullptr
+    QSharedPointer<ZMethod> nextPendingMethodBody() const { return pendingBodies.isEmpty() ? QSharedPointer<ZMethod>() : pendingBodies.first(); }
+    // method with a body that contains the text range [start, end), or nullptr
+    QSharedPointer<ZMethod> findMethodBody(int start, int end);
+    // incremental reparse after an edit inside the body of method. text is the whole new file text, delta is the change
+    // in text length. the body is re-lexed and its old semantic tokens dropped; positions and lines after it shift
+    // (when the rest of the file is next needed, see PendingShift). the body itself is left pending for ensureMethodBody.
+    // returns false, without changing anything, if the edit can affect more than the body (i.e. unbalanced braces);
+    // then the file needs a full reparse
+    bool prepareMethodBodyEdit(QSharedPointer<ZMethod> method, const QString& text, int delta);
+    // parses an already parsed body again, i.e. when something it refers to has changed. text is the whole file text
+    bool reparseMethodBody(QSharedPointer<ZMethod> method, const QString& text);
+    // resolves the types of fields, method return values and arguments again, i.e. after the files that declare them
+    // were parsed again. the nodes the references pointed to are gone then
+    void relinkMemberTypes();
+    // the listener is told about every type whose members are looked up (see QueryEngine)
+    void setListener(ParserListener* listener) { this->listener = listener; }
 
     // Parser operates at File level
     //
     QSharedPointer<ZFileRoot> root;
-    QList<ParserToken> parsedTokens;
+    // in the order the passes produced them. while body edits are pending, the tokens after the edited body are at their
+    // old positions: read them through sortedParsedTokens
+    QVector<ParserToken> parsedTokens;
+    QVector<ParserSymbol> symbols;
+    QVector<ParserDiagnostic> diagnostics;
+
+    // parsedTokens sorted by position, at their current positions. shares parsedTokens unless body edits are pending
+    QVector<ParserToken> sortedParsedTokens();
 
-    void reportError(QString err);
-    void reportWarning(QString warn);
+    // symbol lookup for semantic tokens. returns nullptr if the token has no reference
+    const ParserSymbol* tokenSymbol(const ParserToken& token) const;
+    QString tokenReferencePath(const ParserToken& token) const;
+    QSharedPointer<ZTreeNode> tokenReference(const ParserToken& token) const;
+
+    // adds the semantic tokens and diagnostics that an earlier run (see ParseCache) produced for the bodies that are still
+    // pending, after a lazy method pass. the bodies stay pending; parsing one replaces what was restored for it.
+    // symbol nodes are restored for types only
+    void restoreSemanticTokens(const QVector<ParserToken>& cachedTokens, const QStringList& cachedSymbolPaths, const QVector<ParserDiagnostic>& cachedDiagnostics);
+
+    void reportError(QString err, int line = -1);
+    void reportWarning(QString warn, int line = -1);
 
     //
     static QSharedPointer<ZSystemType> resolveSystemType(QString name);
@@ -574,9 +734,70 @@ public:
 private:
     QList<Tokenizer::Token> tokens;
     QList<QSharedPointer<ZTreeNode>> types;
+    // global types and constants of types by lowercase name, filled by setTypeInformation.
+    // types frozen in the overlay are left out, they are looked up in the overlay
+    QHash<QString, QSharedPointer<ZTreeNode>> typeIndex;
+    QHash<QString, QSharedPointer<ZTreeNode>> constantIndex;
+    QSharedPointer<ZClassOverlay> classOverlay;
+    bool lazyMethodBodies;
+    // methods whose bodies were skipped by the method pass, in file order
+    QList<QSharedPointer<ZMethod>> pendingBodies;
+    // pending bodies that currently show semantic tokens from the cache
+    QSet<const ZMethod*> restoredBodies;
     // System type info. Initialized once
     static QList<ZSystemType> systemTypes;
 
+    // symbols are deduplicated by node and path
+    QHash<QPair<ZTreeNode*, QString>, quint32> symbolIndex;
+    // parsedTokens before this index are sorted by position
+    int sortedTokens;
+    // sorts parsedTokens by position. only the tokens added since the last call are sorted, then merged in
+    void sortParsedTokens();
+    // symbols of discarded bodies, cleared but still taking up a handle
+    int deadSymbols;
+    // drops symbols that no token refers to anymore; the tokens get new handles
+    void compactSymbols();
+
+    // an edit inside a body moves everything after it. while the edits stay in one body they only add up here, and the
+    // rest of the file is moved once another part of it is parsed or looked up (applyPendingShift). until then:
+    //  - the tree after the body has its positions and lines from before the edits: posDelta and lineDelta are to be
+    //    added to positions from fromPos on, and to lines from fromLine on that are after afterLine
+    //  - parsedTokens are the sorted tokens before the body, from tailIndex on the sorted tokens after it (at their
+    //    old positions), and from sortedTokens on the tokens of the body itself
+    // diagnostics are always moved right away
+    struct PendingShift
+    {
+        PendingShift()
+        {
+            fromPos = posDelta = 0;
+            fromLine = afterLine = lineDelta = 0;
+            tailIndex = 0;
+        }
+
+        QSharedPointer<ZMethod> method;
+        int fromPos;
+        int posDelta;
+        int fromLine;
+        int afterLine;
+        int lineDelta;
+        int tailIndex;
+    };
+    PendingShift shift;
+    void applyPendingShift();
+    quint32 internSymbol(QSharedPointer<ZTreeNode> ref, const QString& refPath);
+    void addParsedToken(const Tokenizer::Token& tok, ParserToken::TokenType type, QSharedPointer<ZTreeNode> ref = nullptr, const QString& refPath = QString());
+    void resolveTypeSymbols();
+    void indexTypes();
+    void relinkType(ZCompoundType& type, QSharedPointer<ZStruct> context);
+
+    enum ClassEdge
+    {
+        ExtensionEdge,
+        ChildEdge,
+        ReplacementEdge
+    };
+    void addClassEdge(QSharedPointer<ZClass> target, QSharedPointer<ZClass> cls, ClassEdge edge);
+
     bool skipWhitespace(TokenStream& stream, bool newline);
     bool consumeTokens(TokenStream& stream, QList<Tokenizer::Token>& out, quint64 stopAtAnyOf);
 
@@ -596,6 +817,18 @@ private:
 
     // this occurs in methods
     bool parseObjectMethods(QSharedPointer<ZClass> cls, QSharedPointer<ZStruct> struc);
+    bool parseMethodBody(QSharedPointer<ZMethod> method);
+    QSharedPointer<ZMethod> findMethodBody(QSharedPointer<ZTreeNode> node, int start, int end);
+    void shiftPositions(QSharedPointer<ZTreeNode> node, const ZMethod* edited, int fromPos, int posDelta, int fromLine, int afterLine, int lineDelta);
+    bool lexMethodBody(QSharedPointer<ZMethod> method, const QString& text, int bodyEnd, QList<Tokenizer::Token>& bodyTokens);
+    void discardMethodBody(QSharedPointer<ZMethod> method, int bodyEnd, int delta, int lineDelta);
+    void setMethodBodyTokens(QSharedPointer<ZMethod> method, const QList<Tokenizer::Token>& bodyTokens);
+    // drops what restoreSemanticTokens added for the body of method
+    void dropRestoredBody(QSharedPointer<ZMethod> method);
+    // node whose pass is running (a method for bodies, the root for type resolution). diagnostics are attributed to it
+    const ZTreeNode* currentScope;
+    ParserListener* listener;
+    void noteMembersUsed(QSharedPointer<ZTreeNode> type);
     // parent = outer code block or loop/condition
     // context = nearest outer class
     QSharedPointer<ZCodeBlock> parseCodeBlock(TokenStream& stream, QSharedPointer<ZTreeNode> parent, QSharedPointer<ZStruct> context);
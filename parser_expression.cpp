@@ -3,7 +3,10 @@
 
 ZExpression::~ZExpression()
 {
-    // not needed anymore?
+    // operand chains are the deepest part of a tree
+    for (const ZExpressionLeaf& leaf : leaves)
+        releaseLater(leaf.expr);
+    releaseLater(resultType);
 }
 
 static QString typeFromLeaf(ZExpressionLeaf& leaf)
@@ -1528,9 +1531,9 @@ static QString getFullFieldName(QSharedPointer<ZTreeNode> node)
 void Parser::highlightExpression(QSharedPointer<ZExpression> expr, QSharedPointer<ZTreeNode> parent, QSharedPointer<ZStruct> context)
 {
     for (Tokenizer::Token& tok : expr->operatorTokens)
-        parsedTokens.append(ParserToken(tok, ParserToken::Operator));
+        addParsedToken(tok, ParserToken::Operator);
     for (Tokenizer::Token& tok : expr->specialTokens)
-        parsedTokens.append(ParserToken(tok, ParserToken::SpecialToken));
+        addParsedToken(tok, ParserToken::SpecialToken);
 
     // here we also set expression type :)
 
@@ -1552,7 +1555,7 @@ void Parser::highlightExpression(QSharedPointer<ZExpression> expr, QSharedPointe
                 {
                     Tokenizer::Token& tok = leafExpr->leaves[0].token;
                     QSharedPointer<ZTreeNode> resolved = resolveType(tok.value, context);
-                    parsedTokens.append(ParserToken(tok, ParserToken::TypeName, resolved, tok.value));
+                    addParsedToken(tok, ParserToken::TypeName, resolved, tok.value);
                     // set type of this expression to resolved type
                     expr->resultType.type = tok.value;
                     expr->resultType.reference = resolved;
@@ -1563,7 +1566,7 @@ void Parser::highlightExpression(QSharedPointer<ZExpression> expr, QSharedPointe
                 }
             }
             // in this case, "new" is also a keyword
-            parsedTokens.append(ParserToken(expr->leaves[0].token, ParserToken::Keyword));
+            addParsedToken(expr->leaves[0].token, ParserToken::Keyword);
             return;
         }
     }
@@ -1617,7 +1620,7 @@ void Parser::highlightExpression(QSharedPointer<ZExpression> expr, QSharedPointe
                 }
                 if (resolved)
                 {
-                    parsedTokens.append(ParserToken(leaf.token, t, resolved, leaf.token.value));
+                    addParsedToken(leaf.token, t, resolved, leaf.token.value);
                     ZCompoundType ft;
                     if (resolved->type() == ZTreeNode::Method)
                     {
@@ -1659,7 +1662,7 @@ void Parser::highlightExpression(QSharedPointer<ZExpression> expr, QSharedPointe
                     lastcls = typeFound;
                     lastfound = nullptr;
                     // also mark this type as type
-                    parsedTokens.append(ParserToken(leaf.token, ParserToken::TypeName, typeFound, leaf.token.value));
+                    addParsedToken(leaf.token, ParserToken::TypeName, typeFound, leaf.token.value);
                 }
             }
             else if (lastcls)
@@ -1677,12 +1680,9 @@ void Parser::highlightExpression(QSharedPointer<ZExpression> expr, QSharedPointe
                         if (cls->extendReference)
                             cls = cls->extendReference.toStrongRef();
                         lastclsExtend.append(cls);
-                        if (cls->extensions.size())
+                        for (QWeakPointer<ZClass> extCls : getClassExtensions(cls))
                         {
-                            for (QWeakPointer<ZClass> extCls : cls->extensions)
-                            {
-                                if (extCls) lastclsExtend.append(extCls.toStrongRef());
-                            }
+                            if (extCls) lastclsExtend.append(extCls.toStrongRef());
                         }
                         if (cls->parentReference)
                             lastclsParent = cls->parentReference.toStrongRef();
@@ -1690,6 +1690,7 @@ void Parser::highlightExpression(QSharedPointer<ZExpression> expr, QSharedPointe
                     bool typefound = false;
                     for (QSharedPointer<ZTreeNode> extended : lastclsExtend)
                     {
+                        noteMembersUsed(extended);
                         for (QSharedPointer<ZTreeNode> node : extended->children)
                         {
                             if ((node->type() == ZTreeNode::Method || node->type() == ZTreeNode::Field || node->type() == ZTreeNode::Constant || node->type() == ZTreeNode::Struct) &&
@@ -1721,7 +1722,7 @@ void Parser::highlightExpression(QSharedPointer<ZExpression> expr, QSharedPointe
                                     t = ParserToken::ConstantName;
                                 else if (node->type() == ZTreeNode::Struct)
                                     t = ParserToken::TypeName;
-                                parsedTokens.append(ParserToken(leaf.token, t, node, getFullFieldName(node)));
+                                addParsedToken(leaf.token, t, node, getFullFieldName(node));
                                 // find type of this field
                                 // if it's a constant, there can be no type...
                                 if (node->type() == ZTreeNode::Constant)
@@ -1734,7 +1735,7 @@ void Parser::highlightExpression(QSharedPointer<ZExpression> expr, QSharedPointe
                                 if (isstatic && node->type() == ZTreeNode::Struct)
                                 {
                                     lastcls = node;
-                                    parsedTokens.append(ParserToken(leaf.token, ParserToken::TypeName, node, leaf.token.value));
+                                    addParsedToken(leaf.token, ParserToken::TypeName, node, leaf.token.value);
                                     continue;
                                 }
                                 // if it's a field, we have field type.
@@ -1814,12 +1815,12 @@ void Parser::highlightExpression(QSharedPointer<ZExpression> expr, QSharedPointe
         switch (leaf.type)
         {
         case ZExpressionLeaf::Boolean:
-            parsedTokens.append(ParserToken(leaf.token, ParserToken::Keyword));
+            addParsedToken(leaf.token, ParserToken::Keyword);
             break;
         case ZExpressionLeaf::Identifier:
         {
             if (keywords.contains(leaf.token.value.toLower()))
-                parsedTokens.append(ParserToken(leaf.token, ParserToken::Keyword));
+                addParsedToken(leaf.token, ParserToken::Keyword);
             QSharedPointer<ZTreeNode> resolved = resolveSymbol(leaf.token.value, parent, context);
             if (resolved)
             {
@@ -1845,7 +1846,7 @@ void Parser::highlightExpression(QSharedPointer<ZExpression> expr, QSharedPointe
                 default:
                     break;
                 }
-                parsedTokens.append(ParserToken(leaf.token, t, resolved, leaf.token.value));
+                addParsedToken(leaf.token, t, resolved, leaf.token.value);
             }
             break;
         }
@@ -1854,10 +1855,10 @@ void Parser::highlightExpression(QSharedPointer<ZExpression> expr, QSharedPointe
             break;
         case ZExpressionLeaf::Integer:
         case ZExpressionLeaf::Double:
-            parsedTokens.append(ParserToken(leaf.token, ParserToken::Number));
+            addParsedToken(leaf.token, ParserToken::Number);
             break;
         case ZExpressionLeaf::String:
-            parsedTokens.append(ParserToken(leaf.token, ParserToken::String));
+            addParsedToken(leaf.token, ParserToken::String);
             break;
         default:
             break;
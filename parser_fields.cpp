@@ -1,8 +1,11 @@
 #include "parser.h"
+#include "profiler.h"
 #include <cmath>
 
 bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruct> struc)
 {
+    ZZ_PROFILE_SCOPE(FieldPass);
+    applyPendingShift();
     // at this point, we have a list of tokens contained inside the struct/class body.
     // there, we have values in one of the forms:
     // 1)
@@ -32,7 +35,7 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
 
         if (token.value == "enum")
         {
-            parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+            addParsedToken(token, ParserToken::Keyword);
             stream.setPosition(stream.position()+1);
             QSharedPointer<ZEnum> enm = parseEnum(stream, struc);
             if (!enm)
@@ -44,7 +47,7 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
         }
         else if (token.value == "struct")
         {
-            parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+            addParsedToken(token, ParserToken::Keyword);
             stream.setPosition(stream.position()+1);
             QSharedPointer<ZStruct> subStruc = parseStruct(stream, struc);
             if (!subStruc)
@@ -56,7 +59,7 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
         }
         else if (token.value == "const")
         {
-            parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+            addParsedToken(token, ParserToken::Keyword);
             // read in const value
             // const <name> = <expression>;
             QSharedPointer<ZConstant> konst = parseConstant(stream, struc);
@@ -71,49 +74,49 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
         {
             // read in property expression
             // property <name> : <field1> [, <field2> ...]
-            parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+            addParsedToken(token, ParserToken::Keyword);
             stream.setPosition(stream.position()+1);
             skipWhitespace(stream, true);
             if (!stream.expectToken(token, Tokenizer::Identifier))
             {
-                qDebug("parseObjectFields: unexpected %s, expected property identifier at line %d", token.toCString(), token.line);
+                reportError(QString::asprintf("parseObjectFields: unexpected %s, expected property identifier at line %d", token.toCString(), token.line), token.line);
                 return false;
             }
             QString prop_identifier = token.value;
-            parsedTokens.append(ParserToken(token, ParserToken::Field));
+            addParsedToken(token, ParserToken::Field);
             skipWhitespace(stream, true);
             if (!stream.expectToken(token, Tokenizer::Colon))
             {
-                qDebug("parseObjectFields: unexpected %s, expected : at line %d", token.toCString(), token.line);
+                reportError(QString::asprintf("parseObjectFields: unexpected %s, expected : at line %d", token.toCString(), token.line), token.line);
                 return false;
             }
-            parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+            addParsedToken(token, ParserToken::SpecialToken);
             QList<QString> prop_fields;
             while (true)
             {
                 skipWhitespace(stream, true);
                 if (!stream.expectToken(token, Tokenizer::Identifier|Tokenizer::Semicolon))
                 {
-                    qDebug("parseObjectFields: unexpected %s, expected identifier or semicolon at line %d", token.toCString(), token.line);
+                    reportError(QString::asprintf("parseObjectFields: unexpected %s, expected identifier or semicolon at line %d", token.toCString(), token.line), token.line);
                     return false;
                 }
                 if (token.type == Tokenizer::Semicolon)
                     break;
-                parsedTokens.append(ParserToken(token, ParserToken::Field));
+                addParsedToken(token, ParserToken::Field);
                 prop_fields.append(token.value);
                 skipWhitespace(stream, true);
                 if (!stream.expectToken(token, Tokenizer::Comma|Tokenizer::Semicolon))
                 {
-                    qDebug("parseObjectFields: unexpected %s, expected comma or semicolon at line %d", token.toCString(), token.line);
+                    reportError(QString::asprintf("parseObjectFields: unexpected %s, expected comma or semicolon at line %d", token.toCString(), token.line), token.line);
                     return false;
                 }
                 if (token.type == Tokenizer::Semicolon)
                     break;
-                parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+                addParsedToken(token, ParserToken::SpecialToken);
             }
             if (!prop_fields.size())
-                qDebug("parseObjectFields: warning: property '%s' without fields at line %d", prop_identifier.toUtf8().data(), token.line);
-            parsedTokens.append(ParserToken(token, ParserToken::SpecialToken)); // semicolon
+                reportWarning(QString::asprintf("parseObjectFields: warning: property '%s' without fields at line %d", prop_identifier.toUtf8().data(), token.line), token.line);
+            addParsedToken(token, ParserToken::SpecialToken); // semicolon
             QSharedPointer<ZProperty> prop = QSharedPointer<ZProperty>(new ZProperty(struc));
             prop->identifier = prop_identifier;
             prop->fields = prop_fields;
@@ -124,13 +127,13 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
         }
         else if (token.value == "default") // no processing yet, just to make Doom classes work
         {
-            parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+            addParsedToken(token, ParserToken::Keyword);
             stream.setPosition(stream.position()+1);
             // read in a block
             skipWhitespace(stream, true);
             if (!stream.expectToken(token, Tokenizer::OpenCurly))
             {
-                qDebug("parseObjectFields: unexpected %s, expected opening curly brace at line %d", token.toCString(), token.line);
+                reportError(QString::asprintf("parseObjectFields: unexpected %s, expected opening curly brace at line %d", token.toCString(), token.line), token.line);
                 return false;
             }
             skipWhitespace(stream, true);
@@ -139,20 +142,20 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
             skipWhitespace(stream, true);
             if (!stream.expectToken(token, Tokenizer::CloseCurly))
             {
-                qDebug("parseObjectFields: unexpected %s, expected closing curly brace at line %d", token.toCString(), token.line);
+                reportError(QString::asprintf("parseObjectFields: unexpected %s, expected closing curly brace at line %d", token.toCString(), token.line), token.line);
                 return false;
             }
             continue;
         }
         else if (token.value == "states")
         {
-            parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+            addParsedToken(token, ParserToken::Keyword);
             stream.setPosition(stream.position()+1);
             // read in a block
             skipWhitespace(stream, true);
             if (!stream.expectToken(token, Tokenizer::OpenCurly))
             {
-                qDebug("parseObjectFields: unexpected %s, expected opening curly brace at line %d", token.toCString(), token.line);
+                reportError(QString::asprintf("parseObjectFields: unexpected %s, expected opening curly brace at line %d", token.toCString(), token.line), token.line);
                 return false;
             }
             skipWhitespace(stream, true);
@@ -161,7 +164,7 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
             skipWhitespace(stream, true);
             if (!stream.expectToken(token, Tokenizer::CloseCurly))
             {
-                qDebug("parseObjectFields: unexpected %s, expected closing curly brace at line %d", token.toCString(), token.line);
+                reportError(QString::asprintf("parseObjectFields: unexpected %s, expected closing curly brace at line %d", token.toCString(), token.line), token.line);
                 return false;
             }
             continue;
@@ -176,7 +179,7 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
             {
                 if (nothingread)
                     return true; // done
-                qDebug("parseObjectFields: unexpected end of input at line %d", token.line);
+                reportError(QString::asprintf("parseObjectFields: unexpected end of input at line %d", token.line), token.line);
                 return false;
             }
 
@@ -186,36 +189,36 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
             {
                 if (allowedKeywords.contains(token.value))
                 {
-                    parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+                    addParsedToken(token, ParserToken::Keyword);
                     if (token.value == "version" || token.value == "deprecated")
                     {
                         QString tt = token.value;
                         skipWhitespace(stream, true);
                         if (!stream.expectToken(token, Tokenizer::OpenParen))
                         {
-                            qDebug("parseObjectFields: unexpected %s at line %d, expected %s(\"string\")", token.toCString(), token.line, tt.toUtf8().data());
+                            reportError(QString::asprintf("parseObjectFields: unexpected %s at line %d, expected %s(\"string\")", token.toCString(), token.line, tt.toUtf8().data()), token.line);
                             return false;
                         }
-                        parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+                        addParsedToken(token, ParserToken::SpecialToken);
 
                         skipWhitespace(stream, true);
                         if (!stream.expectToken(token, Tokenizer::String))
                         {
-                            qDebug("parseObjectFields: unexpected %s at line %d, expected %s(\"string\")", token.toCString(), token.line, tt.toUtf8().data());
+                            reportError(QString::asprintf("parseObjectFields: unexpected %s at line %d, expected %s(\"string\")", token.toCString(), token.line, tt.toUtf8().data()), token.line);
                             return false;
                         }
                         if (token.value == "version")
                             f_version = token.value;
                         else f_deprecated = token.value;
-                        parsedTokens.append(ParserToken(token, ParserToken::String));
+                        addParsedToken(token, ParserToken::String);
 
                         skipWhitespace(stream, true);
                         if (!stream.expectToken(token, Tokenizer::CloseParen))
                         {
-                            qDebug("parseObjectFields: unexpected %s at line %d, expected %s(\"string\")", token.toCString(), token.line, tt.toUtf8().data());
+                            reportError(QString::asprintf("parseObjectFields: unexpected %s at line %d, expected %s(\"string\")", token.toCString(), token.line, tt.toUtf8().data()), token.line);
                             return false;
                         }
-                        parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+                        addParsedToken(token, ParserToken::SpecialToken);
                     }
                     else
                     {
@@ -230,7 +233,7 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
             }
             else
             {
-                qDebug("parseObjectFields: unexpected %s, expected flags or type at line %d", token.toCString(), token.line);
+                reportError(QString::asprintf("parseObjectFields: unexpected %s, expected flags or type at line %d", token.toCString(), token.line), token.line);
                 return false;
             }
         }
@@ -243,14 +246,14 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
             ZCompoundType f_type;
             if (!parseCompoundType(stream, f_type, struc))
             {
-                qDebug("parseObjectFields: expected valid type at line %d", token.line);
+                reportError(QString::asprintf("parseObjectFields: expected valid type at line %d", token.line), token.line);
                 return false;
             }
 
             skipWhitespace(stream, true);
             if (!stream.expectToken(token, Tokenizer::Comma|Tokenizer::Identifier))
             {
-                qDebug("parseObjectFields: unexpected %s, expected comma or identifier at line %d", token.toCString(), token.line);
+                reportError(QString::asprintf("parseObjectFields: unexpected %s, expected comma or identifier at line %d", token.toCString(), token.line), token.line);
                 return false;
             }
 
@@ -268,14 +271,14 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
         skipWhitespace(stream, true);
         if (!stream.expectToken(token, Tokenizer::OpenParen|Tokenizer::Semicolon|Tokenizer::OpenSquare|Tokenizer::OpAssign))
         {
-            qDebug("parseObjectFields: unexpected %s, expected method signature, array dimensions or semicolon at line %d", token.toCString(), token.line);
+            reportError(QString::asprintf("parseObjectFields: unexpected %s, expected method signature, array dimensions or semicolon at line %d", token.toCString(), token.line), token.line);
             return false;
         }
 
         //
         if (token.type == Tokenizer::OpenSquare)
         {
-            parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+            addParsedToken(token, ParserToken::SpecialToken);
             // parse array dimensons, can have many
             while (true)
             {
@@ -289,7 +292,7 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
                     skipWhitespace(stream, true);
                     if (!stream.expectToken(token, Tokenizer::CloseSquare))
                     {
-                        qDebug("parseObjectFields: expected valid expression for array dimensions at line %d", token.line);
+                        reportError(QString::asprintf("parseObjectFields: expected valid expression for array dimensions at line %d", token.line), token.line);
                         return false;
                     }
                     stream.setPosition(stream.position()-1);
@@ -298,20 +301,20 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
                 skipWhitespace(stream, true);
                 if (!stream.expectToken(token, Tokenizer::CloseSquare))
                 {
-                    qDebug("parseObjectFields: unexpected end of input, closing square brace at line %d", token.line);
+                    reportError(QString::asprintf("parseObjectFields: unexpected end of input, closing square brace at line %d", token.line), token.line);
                     return false;
                 }
-                parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+                addParsedToken(token, ParserToken::SpecialToken);
                 // next dimension or end of def
                 skipWhitespace(stream, true);
                 if (!stream.expectToken(token, Tokenizer::Semicolon|Tokenizer::OpenSquare|Tokenizer::OpAssign))
                 {
-                    qDebug("parseObjectFields: unexpected %s, expected semicolon or array dimensions at line %d", token.toCString(), token.line);
+                    reportError(QString::asprintf("parseObjectFields: unexpected %s, expected semicolon or array dimensions at line %d", token.toCString(), token.line), token.line);
                     return false;
                 }
                 if (token.type == Tokenizer::Semicolon || token.type == Tokenizer::OpAssign)
                     break; // field is done
-                parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+                addParsedToken(token, ParserToken::SpecialToken);
             }
         }
 
@@ -323,30 +326,30 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
             if (token.type == Tokenizer::OpAssign)
             {
                 // assignment token
-                parsedTokens.append(ParserToken(token, ParserToken::Operator));
+                addParsedToken(token, ParserToken::Operator);
                 //
                 skipWhitespace(stream, true);
                 assignmentExpr = parseExpression(stream, Tokenizer::Semicolon);
                 if (!assignmentExpr)
                 {
-                    qDebug("parseObjectFields: expected valid expression at line %d", token.line);
+                    reportError(QString::asprintf("parseObjectFields: expected valid expression at line %d", token.line), token.line);
                     return false;
                 }
                 skipWhitespace(stream, true);
                 if (!stream.expectToken(token, Tokenizer::Semicolon))
                 {
-                    qDebug("parseObjectFields: unexpected %s, expected semicolon at line %d", token.toCString(), token.line);
+                    reportError(QString::asprintf("parseObjectFields: unexpected %s, expected semicolon at line %d", token.toCString(), token.line), token.line);
                     return false;
                 }
             }
             // semicolon token
-            parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+            addParsedToken(token, ParserToken::SpecialToken);
             // field name
-            parsedTokens.append(ParserToken(fieldNameToken, ParserToken::Field));
+            addParsedToken(fieldNameToken, ParserToken::Field);
 
             if (fieldTypes.size() > 1)
             {
-                qDebug("parseObjectFields: multiple types in a field definition are not allowed at line %d", token.line);
+                reportError(QString::asprintf("parseObjectFields: multiple types in a field definition are not allowed at line %d", token.line), token.line);
                 return false;
             }
 
@@ -364,19 +367,20 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
         else
         {
             // opening parenthesis
-            parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+            addParsedToken(token, ParserToken::SpecialToken);
             // method name
-            parsedTokens.append(ParserToken(fieldNameToken, ParserToken::Method));
+            addParsedToken(fieldNameToken, ParserToken::Method);
             //
             QList<QSharedPointer<ZLocalVariable>> args;
             QList<Tokenizer::Token> body;
+            int bodyStart = -1, bodyEnd = -1, bodyLine = 0, bodyEndLine = 0;
             bool hadellipsis = false;
             while (true)
             {
                 skipWhitespace(stream, true);
                 if (!stream.expectToken(token, Tokenizer::CloseParen|Tokenizer::Ellipsis|Tokenizer::Identifier))
                 {
-                    qDebug("parseObjectFields: unexpected %s, closing parenthesis, ellipsis or argument at line %d", token.toCString(), token.line);
+                    reportError(QString::asprintf("parseObjectFields: unexpected %s, closing parenthesis, ellipsis or argument at line %d", token.toCString(), token.line), token.line);
                     return false;
                 }
 
@@ -398,7 +402,7 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
                         arg_isOut = true;
                     if (token.value == "ref")
                         arg_isRef = true;
-                    parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+                    addParsedToken(token, ParserToken::Keyword);
                     skipWhitespace(stream, true);
                 }
                 else stream.setPosition(stream.position()-1);
@@ -407,38 +411,38 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
                 ZCompoundType arg_type;
                 if (!parseCompoundType(stream, arg_type, struc))
                 {
-                    qDebug("parseObjectFields: expected valid argument type at line %d", token.line);
+                    reportError(QString::asprintf("parseObjectFields: expected valid argument type at line %d", token.line), token.line);
                     return false;
                 }
 
                 skipWhitespace(stream, true);
                 if (!stream.expectToken(token, Tokenizer::Identifier))
                 {
-                    qDebug("parseObjectFields: unexpected %s, expected argument name at line %d", token.toCString(), token.line);
+                    reportError(QString::asprintf("parseObjectFields: unexpected %s, expected argument name at line %d", token.toCString(), token.line), token.line);
                     return false;
                 }
 
                 QString arg_name = token.value;
-                parsedTokens.append(ParserToken(token, ParserToken::Argument));
+                addParsedToken(token, ParserToken::Argument);
 
                 skipWhitespace(stream, true);
                 // check token, it can be either closing parenthesis or assignment
                 if (!stream.expectToken(token, Tokenizer::CloseParen|Tokenizer::OpAssign|Tokenizer::Comma))
                 {
-                    qDebug("parseObjectFields: unexpected %s, expected closing parenthesis or default value at line %d", token.toCString(), token.line);
+                    reportError(QString::asprintf("parseObjectFields: unexpected %s, expected closing parenthesis or default value at line %d", token.toCString(), token.line), token.line);
                     return false;
                 }
 
                 QSharedPointer<ZExpression> dexpr = nullptr;
                 if (token.type == Tokenizer::OpAssign)
                 {
-                    parsedTokens.append(ParserToken(token, ParserToken::Operator));
+                    addParsedToken(token, ParserToken::Operator);
                     skipWhitespace(stream, true);
                     // parse default expression
                     dexpr = parseExpression(stream, Tokenizer::CloseParen|Tokenizer::Comma);
                     if (!dexpr)
                     {
-                        qDebug("parseObjectFields: expected valid default value expression for '%s' at line %d", arg_name.toUtf8().data(), token.line);
+                        reportError(QString::asprintf("parseObjectFields: expected valid default value expression for '%s' at line %d", arg_name.toUtf8().data(), token.line), token.line);
                         return false;
                     }
                     highlightExpression(dexpr, nullptr, struc);
@@ -447,7 +451,7 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
                     // expect comma or closing parenthesis now
                     if (!stream.expectToken(token, Tokenizer::CloseParen|Tokenizer::Comma))
                     {
-                        qDebug("parseObjectFields: unexpected %s, expected closing parenthesis or comma at line %d", token.toCString(), token.line);
+                        reportError(QString::asprintf("parseObjectFields: unexpected %s, expected closing parenthesis or comma at line %d", token.toCString(), token.line), token.line);
                         return false;
                     }
                 }
@@ -469,16 +473,16 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
 
                 if (token.type == Tokenizer::CloseParen)
                     break;
-                parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+                addParsedToken(token, ParserToken::SpecialToken);
             }
 
-            parsedTokens.append(ParserToken(token, ParserToken::SpecialToken)); // closing parenthesis
+            addParsedToken(token, ParserToken::SpecialToken); // closing parenthesis
 
             // check for "const" after signature
             skipWhitespace(stream, true);
             if (!stream.expectToken(token, Tokenizer::Identifier|Tokenizer::OpenCurly|Tokenizer::Semicolon))
             {
-                qDebug("parseObjectFields: unexpected %s, expected 'const', semicolon or method body at line %d", token.toCString(), token.line);
+                reportError(QString::asprintf("parseObjectFields: unexpected %s, expected 'const', semicolon or method body at line %d", token.toCString(), token.line), token.line);
                 return false;
             }
 
@@ -486,19 +490,19 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
             {
                 if (token.value == "const")
                 {
-                    parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+                    addParsedToken(token, ParserToken::Keyword);
                     f_flags.append("const");
                 }
                 else
                 {
-                    qDebug("parseObjectFields: invalid method flag %s, expected 'const' at line %d", token.toCString(), token.line);
+                    reportError(QString::asprintf("parseObjectFields: invalid method flag %s, expected 'const' at line %d", token.toCString(), token.line), token.line);
                     return false;
                 }
 
                 skipWhitespace(stream, true);
                 if (!stream.expectToken(token, Tokenizer::OpenCurly|Tokenizer::Semicolon))
                 {
-                    qDebug("parseObjectFields: unexpected %s, expected semicolon or method body at line %d", token.toCString(), token.line);
+                    reportError(QString::asprintf("parseObjectFields: unexpected %s, expected semicolon or method body at line %d", token.toCString(), token.line), token.line);
                     return false;
                 }
             }
@@ -508,23 +512,27 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
                 //
                 if (!f_flags.contains("native"))
                 {
-                    qDebug("parseObjectFields: warning: non-native function without body: %s at line %d", f_name.toUtf8().data(), token.line);
+                    reportWarning(QString::asprintf("parseObjectFields: warning: non-native function without body: %s at line %d", f_name.toUtf8().data(), token.line), token.line);
                 }
             }
             else
             {
-                parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+                addParsedToken(token, ParserToken::SpecialToken);
+                bodyStart = token.endsAt;
+                bodyLine = token.line;
                 if (!consumeTokens(stream, body, Tokenizer::CloseCurly) || !stream.peekToken(token) || token.type != Tokenizer::CloseCurly)
                 {
-                    qDebug("parseObjectFields: unexpected end of input for method body (method %s)", f_name.toUtf8().data());
+                    reportError(QString::asprintf("parseObjectFields: unexpected end of input for method body (method %s)", f_name.toUtf8().data()));
                     return false;
                 }
                 if (!stream.expectToken(token, Tokenizer::CloseCurly))
                 {
-                    qDebug("parseObjectFields: unexpected %s, expected closing curly brace at line %d", token.toCString(), token.line);
+                    reportError(QString::asprintf("parseObjectFields: unexpected %s, expected closing curly brace at line %d", token.toCString(), token.line), token.line);
                     return false;
                 }
-                parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+                addParsedToken(token, ParserToken::SpecialToken);
+                bodyEnd = token.startsAt;
+                bodyEndLine = token.line;
 
                 stream.setPosition(stream.position()+1);
             }
@@ -539,6 +547,10 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
             method->arguments = args;
             method->hasEllipsis = hadellipsis;
             method->tokens = body;
+            method->bodyStart = bodyStart;
+            method->bodyEnd = bodyEnd;
+            method->bodyLine = bodyLine;
+            method->bodyEndLine = bodyEndLine;
             method->lineNumber = lineno;
             method->isValid = true;
             // for destructor and expressions to work
@@ -564,13 +576,66 @@ bool Parser::parseObjectFields(QSharedPointer<ZClass> cls, QSharedPointer<ZStruc
     return allok;
 }
 
+void Parser::relinkMemberTypes()
+{
+    if (!root)
+        return;
+    applyPendingShift();
+    QList<QSharedPointer<ZStruct>> structs;
+    for (QSharedPointer<ZTreeNode> node : root->children)
+    {
+        if (node->type() == ZTreeNode::Class || node->type() == ZTreeNode::Struct)
+            structs.append(node.dynamicCast<ZStruct>());
+    }
+    while (!structs.isEmpty())
+    {
+        QSharedPointer<ZStruct> struc = structs.takeLast();
+        for (QSharedPointer<ZTreeNode> node : struc->children)
+        {
+            switch (node->type())
+            {
+            case ZTreeNode::Class:
+            case ZTreeNode::Struct:
+                structs.append(node.dynamicCast<ZStruct>());
+                break;
+            case ZTreeNode::Field:
+                relinkType(node.dynamicCast<ZField>()->fieldType, struc);
+                break;
+            case ZTreeNode::Method:
+            {
+                QSharedPointer<ZMethod> method = node.dynamicCast<ZMethod>();
+                for (ZCompoundType& rtype : method->returnTypes)
+                    relinkType(rtype, struc);
+                for (QSharedPointer<ZLocalVariable> arg : method->arguments)
+                    relinkType(arg->varType, struc);
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+}
+
+void Parser::relinkType(ZCompoundType& type, QSharedPointer<ZStruct> context)
+{
+    for (ZCompoundType& argument : type.arguments)
+        relinkType(argument, context);
+    // system types are not declared in any file
+    QSharedPointer<ZTreeNode> reference = type.reference.toStrongRef();
+    if (type.type.isEmpty() || (reference ? reference->type() == ZTreeNode::SystemType : !resolveSystemType(type.type).isNull()))
+        return;
+    // resolved types keep their full name, unresolved ones the name as written
+    type.reference = resolveType(type.type, context);
+}
+
 bool Parser::parseCompoundType(TokenStream& stream, ZCompoundType& type, QSharedPointer<ZStruct> context)
 {
     // get initial identifier
     Tokenizer::Token token;
     if (!stream.expectToken(token, Tokenizer::Identifier))
     {
-        qDebug("parseCompoundType: expected identifier at line %d", token.line);
+        reportError(QString::asprintf("parseCompoundType: expected identifier at line %d", token.line), token.line);
         return false;
     }
 
@@ -591,14 +656,14 @@ bool Parser::parseCompoundType(TokenStream& stream, ZCompoundType& type, QShared
         type.type = token.value.toLower();
         type.reference = systemType;
 
-        parsedTokens.append(ParserToken(token, ParserToken::TypeName, systemType, token.value));
+        addParsedToken(token, ParserToken::TypeName, systemType, token.value);
     }
     else
     {
         QSharedPointer<ZTreeNode> lastType = resolveType(token.value, context);
         if (!lastType)
         {
-            qDebug("parseCompoundType: warning: unresolved type %s", token.value.toUtf8().data());
+            reportWarning(QString::asprintf("parseCompoundType: warning: unresolved type %s", token.value.toUtf8().data()), token.line);
         }
 
         if (lastType && (!lastType->parent.toStrongRef() || lastType->parent.toStrongRef()->type() == ZTreeNode::FileRoot))
@@ -606,11 +671,11 @@ bool Parser::parseCompoundType(TokenStream& stream, ZCompoundType& type, QShared
 
         if (!lastType)
         {
-            parsedTokens.append(ParserToken(token, ParserToken::TypeName, lastType, prependContext+token.value));
+            addParsedToken(token, ParserToken::TypeName, lastType, prependContext+token.value);
         }
         else
         {
-            parsedTokens.append(ParserToken(token, ParserToken::TypeName, lastType, getFullType(lastType)));
+            addParsedToken(token, ParserToken::TypeName, lastType, getFullType(lastType));
         }
 
         // check for multi-component type (i.e. A.B.C)
@@ -622,23 +687,23 @@ bool Parser::parseCompoundType(TokenStream& stream, ZCompoundType& type, QShared
             skipWhitespace(stream, true);
             if (stream.peekToken(token) && token.type == Tokenizer::Dot)
             {
-                parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+                addParsedToken(token, ParserToken::SpecialToken);
                 stream.setPosition(stream.position()+1);
                 if (!stream.expectToken(token, Tokenizer::Identifier))
                 {
-                    qDebug("parseCompoundType: expected identifer at line %d", token.line);
+                    reportError(QString::asprintf("parseCompoundType: expected identifer at line %d", token.line), token.line);
                     return false;
                 }
                 fullType += "."+token.value;
                 lastType = resolveType(fullType, context);
                 if (!lastType)
                 {
-                    qDebug("parseCompoundType: warning: unresolved type %s", fullType.toUtf8().data());
-                    parsedTokens.append(ParserToken(token, ParserToken::TypeName, lastType, prependContext+fullType));
+                    reportWarning(QString::asprintf("parseCompoundType: warning: unresolved type %s", fullType.toUtf8().data()), token.line);
+                    addParsedToken(token, ParserToken::TypeName, lastType, prependContext+fullType);
                 }
                 else
                 {
-                    parsedTokens.append(ParserToken(token, ParserToken::TypeName, lastType, getFullType(lastType)));
+                    addParsedToken(token, ParserToken::TypeName, lastType, getFullType(lastType));
                 }
             }
             else
@@ -664,7 +729,7 @@ bool Parser::parseCompoundType(TokenStream& stream, ZCompoundType& type, QShared
     skipWhitespace(stream, true);
     if (stream.expectToken(token, Tokenizer::OpLessThan))
     {
-        parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+        addParsedToken(token, ParserToken::SpecialToken);
         while (true)
         {
             skipWhitespace(stream, true);
@@ -672,23 +737,23 @@ bool Parser::parseCompoundType(TokenStream& stream, ZCompoundType& type, QShared
             ZCompoundType subType;
             if (!parseCompoundType(stream, subType, context))
             {
-                qDebug("parseCompoundType: expected valid subtype at line %d", token.line);
+                reportError(QString::asprintf("parseCompoundType: expected valid subtype at line %d", token.line), token.line);
                 return false;
             }
             //
             if (!stream.expectToken(token, Tokenizer::OpGreaterThan|Tokenizer::Comma))
             {
-                qDebug("parseCompoundType: expected close brace or comma at line %d", token.line);
+                reportError(QString::asprintf("parseCompoundType: expected close brace or comma at line %d", token.line), token.line);
                 return false;
             }
-            parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+            addParsedToken(token, ParserToken::SpecialToken);
             //
             type.arguments.append(subType);
             //
             if (token.type == Tokenizer::OpGreaterThan)
                 break; // done
         }
-        parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+        addParsedToken(token, ParserToken::SpecialToken);
     }
     else stream.setPosition(cpos);
     return true;
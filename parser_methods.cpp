@@ -1,8 +1,12 @@
 #include "parser.h"
+#include "profiler.h"
 #include <cmath>
+#include <algorithm>
 
 bool Parser::parseObjectMethods(QSharedPointer<ZClass> cls, QSharedPointer<ZStruct> struc)
 {
+    ZZ_PROFILE_SCOPE(MethodPass);
+    applyPendingShift();
     // go through enums
     for (QSharedPointer<ZTreeNode> node : struc->children)
     {
@@ -19,17 +23,11 @@ bool Parser::parseObjectMethods(QSharedPointer<ZClass> cls, QSharedPointer<ZStru
         if (node->type() != ZTreeNode::Method)
             continue;
 
-        // parse method
+        // parse method, or leave it for later
         QSharedPointer<ZMethod> method = node.dynamicCast<ZMethod>();
-        TokenStream stream(method->tokens);
-        QSharedPointer<ZCodeBlock> rootBlock = parseCodeBlock(stream, method, struc);
-        if (!rootBlock)
-        {
-            qDebug("parseObjectMethods: failed to parse '%s'", method->identifier.toUtf8().data());
-            continue;
-        }
-        rootBlock->parent = method;
-        method->children.append(rootBlock);
+        if (lazyMethodBodies)
+            pendingBodies.append(method);
+        else parseMethodBody(method);
     }
 
     // success here means that we don't need tokens anymore. free memory
@@ -48,6 +46,463 @@ bool Parser::parseObjectMethods(QSharedPointer<ZClass> cls, QSharedPointer<ZStru
     return allok;
 }
 
+bool Parser::parseMethodBody(QSharedPointer<ZMethod> method)
+{
+    // bodies deferred by lazyMethodBodies are parsed later, outside of parseObjectMethods
+    ZZ_PROFILE_SCOPE(MethodPass);
+    // the body that is being edited is where the text is; any other one has to be moved first
+    if (shift.method != method)
+        applyPendingShift();
+    if (restoredBodies.contains(method.data()))
+        dropRestoredBody(method);
+    // context is the struct or class that declares the method
+    QSharedPointer<ZStruct> struc = method->parent.toStrongRef().dynamicCast<ZStruct>();
+    if (!struc)
+        return false;
+    TokenStream stream(method->tokens);
+    const ZTreeNode* outerScope = currentScope;
+    currentScope = method.data();
+    QSharedPointer<ZCodeBlock> rootBlock = parseCodeBlock(stream, method, struc);
+    if (!rootBlock)
+    {
+        reportError(QString::asprintf("parseObjectMethods: failed to parse '%s'", method->identifier.toUtf8().data()), method->lineNumber);
+        currentScope = outerScope;
+        return false;
+    }
+    currentScope = outerScope;
+    rootBlock->parent = method;
+    method->children.append(rootBlock);
+    // body is in the tree now
+    method->tokens.clear();
+    return true;
+}
+
+bool Parser::ensureMethodBody(QSharedPointer<ZMethod> method)
+{
+    int index = pendingBodies.indexOf(method);
+    if (index < 0)
+        return true; // already parsed, or not from this file
+    pendingBodies.removeAt(index);
+    return parseMethodBody(method);
+}
+
+int Parser::parsePendingMethodBodies(int maxMethods)
+{
+    int count = 0;
+    while (!pendingBodies.isEmpty() && count < maxMethods)
+    {
+        parseMethodBody(pendingBodies.takeFirst());
+        count++;
+    }
+    return count;
+}
+
+QSharedPointer<ZMethod> Parser::findMethodBody(int start, int end)
+{
+    if (!root)
+        return nullptr;
+    // typing goes on in the same body: nothing else has to be where the text is
+    QSharedPointer<ZMethod> edited = shift.method;
+    if (edited && start >= edited->bodyStart && end <= edited->bodyEnd)
+        return edited;
+    applyPendingShift();
+    return findMethodBody(root, start, end);
+}
+
+QSharedPointer<ZMethod> Parser::findMethodBody(QSharedPointer<ZTreeNode> node, int start, int end)
+{
+    // declarations only, method bodies are not entered
+    for (QSharedPointer<ZTreeNode> child : node->children)
+    {
+        if (child->type() == ZTreeNode::Method)
+        {
+            QSharedPointer<ZMethod> method = child.dynamicCast<ZMethod>();
+            if (method->bodyStart >= 0 && start >= method->bodyStart && end <= method->bodyEnd)
+                return method;
+        }
+        else if (child->type() == ZTreeNode::Class || child->type() == ZTreeNode::Struct)
+        {
+            QSharedPointer<ZMethod> method = findMethodBody(child, start, end);
+            if (method)
+                return method;
+        }
+    }
+
+    return nullptr;
+}
+
+void Parser::shiftPositions(QSharedPointer<ZTreeNode> node, const ZMethod* edited, int fromPos, int posDelta, int fromLine, int afterLine, int lineDelta)
+{
+    // everything after the edited body moves by the same amount: declarations, other bodies, and the tokens
+    // that expressions keep (field and argument initializers, array sizes, enum values). the edited method itself
+    // is where the text is already
+    auto shiftLine = [&](int& line)
+    {
+        if (line >= fromLine && line > afterLine)
+            line += lineDelta;
+    };
+    auto shiftToken = [&](Tokenizer::Token& token)
+    {
+        if (token.startsAt < fromPos)
+            return;
+        token.startsAt += posDelta;
+        token.endsAt += posDelta;
+        token.line += lineDelta;
+    };
+
+    // expression trees can be deep, no recursion. nodes can be reached more than once (arguments are children too)
+    QList<ZTreeNode*> stack;
+    QSet<ZTreeNode*> visited;
+    auto push = [&](QSharedPointer<ZTreeNode> child)
+    {
+        if (child && !visited.contains(child.data()))
+        {
+            visited.insert(child.data());
+            stack.append(child.data());
+        }
+    };
+    auto pushType = [&](ZCompoundType& ctype)
+    {
+        QList<ZCompoundType*> types;
+        types.append(&ctype);
+        while (!types.isEmpty())
+        {
+            ZCompoundType* t = types.takeLast();
+            for (QSharedPointer<ZExpression> dim : t->arrayDimensions)
+                push(dim);
+            for (ZCompoundType& arg : t->arguments)
+                types.append(&arg);
+        }
+    };
+
+    push(node);
+    while (!stack.isEmpty())
+    {
+        ZTreeNode* current = stack.takeLast();
+        // methods that end before the edit have nothing to move, the body included
+        if (current->type() == ZTreeNode::Method)
+        {
+            ZMethod* method = static_cast<ZMethod*>(current);
+            if (method == edited || (method->bodyStart >= 0 && method->bodyEnd < fromPos))
+                continue;
+        }
+        for (QSharedPointer<ZTreeNode> child : current->children)
+            push(child);
+
+        switch (current->type())
+        {
+        case ZTreeNode::Class:
+        case ZTreeNode::Struct:
+        {
+            ZStruct* struc = static_cast<ZStruct*>(current);
+            shiftLine(struc->lineNumber);
+            for (Tokenizer::Token& token : struc->tokens)
+                shiftToken(token);
+            break;
+        }
+        case ZTreeNode::Method:
+        {
+            ZMethod* method = static_cast<ZMethod*>(current);
+            shiftLine(method->lineNumber);
+            for (ZCompoundType& rtype : method->returnTypes)
+                pushType(rtype);
+            for (QSharedPointer<ZLocalVariable> arg : method->arguments)
+                push(arg);
+            if (method->bodyStart >= fromPos)
+            {
+                method->bodyStart += posDelta;
+                method->bodyEnd += posDelta;
+                method->bodyLine += lineDelta;
+                method->bodyEndLine += lineDelta;
+                // bodies that are not parsed yet still hold their tokens
+                for (Tokenizer::Token& token : method->tokens)
+                    shiftToken(token);
+            }
+            break;
+        }
+        case ZTreeNode::Field:
+        {
+            ZField* field = static_cast<ZField*>(current);
+            shiftLine(field->lineNumber);
+            pushType(field->fieldType);
+            break;
+        }
+        case ZTreeNode::LocalVariable:
+        {
+            ZLocalVariable* var = static_cast<ZLocalVariable*>(current);
+            shiftLine(var->lineNumber);
+            pushType(var->varType);
+            break;
+        }
+        case ZTreeNode::Constant:
+            shiftLine(static_cast<ZConstant*>(current)->lineNumber);
+            break;
+        case ZTreeNode::Property:
+            shiftLine(static_cast<ZProperty*>(current)->lineNumber);
+            break;
+        case ZTreeNode::Enum:
+            shiftLine(static_cast<ZEnum*>(current)->lineNumber);
+            break;
+        case ZTreeNode::ForCycle:
+        {
+            ZForCycle* cycle = static_cast<ZForCycle*>(current);
+            for (QSharedPointer<ZTreeNode> init : cycle->initializers)
+                push(init);
+            push(cycle->condition);
+            for (QSharedPointer<ZExpression> step : cycle->step)
+                push(step);
+            break;
+        }
+        case ZTreeNode::Condition:
+        {
+            ZCondition* cond = static_cast<ZCondition*>(current);
+            push(cond->condition);
+            push(cond->elseBlock);
+            break;
+        }
+        case ZTreeNode::Expression:
+        {
+            ZExpression* expr = static_cast<ZExpression*>(current);
+            for (Tokenizer::Token& token : expr->operatorTokens)
+                shiftToken(token);
+            for (Tokenizer::Token& token : expr->specialTokens)
+                shiftToken(token);
+            for (ZExpressionLeaf& leaf : expr->leaves)
+            {
+                shiftToken(leaf.token);
+                push(leaf.expr);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+bool Parser::lexMethodBody(QSharedPointer<ZMethod> method, const QString& text, int bodyEnd, QList<Tokenizer::Token>& bodyTokens)
+{
+    int bodyStart = method->bodyStart;
+    if (bodyStart < 0 || bodyEnd < bodyStart || bodyEnd >= text.length() || text[bodyEnd] != '}')
+        return false;
+
+    // lex only the body
+    QString bodyText = text.mid(bodyStart, bodyEnd - bodyStart);
+    Tokenizer tok(bodyText);
+    bodyTokens = tok.readAllTokens();
+
+    // the body must still end at the same closing brace: brackets balanced, and nothing open at the end
+    // that could continue past it in the full text (comments, strings)
+    QList<Tokenizer::TokenType> stack;
+    for (const Tokenizer::Token& token : bodyTokens)
+    {
+        if (token.type == Tokenizer::OpenCurly || token.type == Tokenizer::OpenSquare || token.type == Tokenizer::OpenParen)
+            stack.append(token.type);
+        else if (token.type == Tokenizer::CloseCurly || token.type == Tokenizer::CloseSquare || token.type == Tokenizer::CloseParen)
+        {
+            Tokenizer::TokenType expected = (token.type == Tokenizer::CloseCurly) ? Tokenizer::OpenCurly :
+                                            (token.type == Tokenizer::CloseSquare) ? Tokenizer::OpenSquare : Tokenizer::OpenParen;
+            if (stack.isEmpty() || stack.takeLast() != expected)
+                return false;
+        }
+    }
+    if (!stack.isEmpty())
+        return false;
+    if (!bodyTokens.isEmpty())
+    {
+        const Tokenizer::Token& last = bodyTokens.last();
+        if (last.endsAt >= bodyText.length() && (last.type & (Tokenizer::LineComment|Tokenizer::BlockComment|Tokenizer::String|Tokenizer::Name)))
+            return false;
+    }
+
+    int lineOffset = method->bodyLine - 1;
+    for (Tokenizer::Token& token : bodyTokens)
+    {
+        token.startsAt += bodyStart;
+        token.endsAt += bodyStart;
+        token.line += lineOffset;
+    }
+    return true;
+}
+
+void Parser::discardMethodBody(QSharedPointer<ZMethod> method, int bodyEnd, int delta, int lineDelta)
+{
+    // drop semantic tokens of the old body. after the first edit of a body they are the ones at the end; the first
+    // time they are cut out of the sorted tokens, and the rest of the file waits for its shift from then on
+    QSet<quint32> bodySymbols;
+    if (shift.method != method)
+    {
+        applyPendingShift();
+        sortParsedTokens();
+        auto before = [](const ParserToken& tok, int pos) { return tok.startsAt < pos; };
+        QVector<ParserToken>::iterator first = std::lower_bound(parsedTokens.begin(), parsedTokens.end(), method->bodyStart, before);
+        QVector<ParserToken>::iterator last = std::lower_bound(first, parsedTokens.end(), bodyEnd, before);
+        for (QVector<ParserToken>::iterator it = first; it != last; ++it)
+            bodySymbols.insert(it->symbol);
+        shift.tailIndex = int(parsedTokens.erase(first, last) - parsedTokens.begin());
+        sortedTokens = parsedTokens.size();
+        shift.method = method;
+        shift.fromPos = bodyEnd;
+        shift.fromLine = method->bodyEndLine;
+        shift.afterLine = method->bodyLine;
+    }
+    else
+    {
+        for (int i = sortedTokens; i < parsedTokens.size(); i++)
+            bodySymbols.insert(parsedTokens[i].symbol);
+        parsedTokens.resize(sortedTokens);
+    }
+    shift.posDelta += delta;
+    shift.lineDelta += lineDelta;
+
+    // diagnostics are few, they are moved right away
+    QVector<ParserDiagnostic> keptDiagnostics;
+    for (ParserDiagnostic diag : diagnostics)
+    {
+        if (diag.scope == method.data())
+            continue;
+        if (diag.line >= method->bodyEndLine && diag.line > method->bodyLine)
+            diag.line += lineDelta;
+        keptDiagnostics.append(diag);
+    }
+    diagnostics = keptDiagnostics;
+
+    // symbols that point into the old body would keep it alive. only tokens of the body refer to them.
+    // arguments are children of the method too, but not of the body
+    for (quint32 handle : bodySymbols)
+    {
+        if (!handle || int(handle) > symbols.size())
+            continue;
+        ParserSymbol& symbol = symbols[handle-1];
+        QSharedPointer<ZTreeNode> ref = symbol.reference;
+        if (!ref || ref == method)
+            continue;
+        QSharedPointer<ZTreeNode> top = ref;
+        QSharedPointer<ZTreeNode> p = ref->parent.toStrongRef();
+        while (p && p != method)
+        {
+            top = p;
+            p = p->parent.toStrongRef();
+        }
+        if (!p || top->type() != ZTreeNode::CodeBlock)
+            continue;
+        symbolIndex.remove(qMakePair(ref.data(), symbol.referencePath));
+        symbol.reference.reset();
+        deadSymbols++;
+    }
+    // the cleared symbols keep their handles until then: renumbering goes through every token
+    if (deadSymbols * 2 > symbols.size() && deadSymbols * 16 > parsedTokens.size())
+        compactSymbols();
+
+    method->children.clear();
+    pendingBodies.removeAll(method);
+    restoredBodies.remove(method.data());
+}
+
+void Parser::applyPendingShift()
+{
+    if (!shift.method)
+        return;
+    PendingShift pending = shift;
+    shift = PendingShift();
+
+    // the tokens after the body move, then the body's tokens are merged in between
+    if (pending.posDelta)
+    {
+        for (int i = pending.tailIndex; i < sortedTokens; i++)
+            parsedTokens[i].startsAt += pending.posDelta;
+    }
+    sortParsedTokens();
+
+    if (pending.posDelta || pending.lineDelta)
+        shiftPositions(root, pending.method.data(), pending.fromPos, pending.posDelta, pending.fromLine, pending.afterLine, pending.lineDelta);
+}
+
+void Parser::dropRestoredBody(QSharedPointer<ZMethod> method)
+{
+    restoredBodies.remove(method.data());
+    // comments were not restored, they came from parse()
+    QVector<ParserToken> keptTokens;
+    keptTokens.reserve(parsedTokens.size());
+    int keptSorted = 0;
+    for (int i = 0; i < parsedTokens.size(); i++)
+    {
+        const ParserToken& ptok = parsedTokens[i];
+        if (ptok.type != ParserToken::Comment && int(ptok.startsAt) >= method->bodyStart && int(ptok.startsAt) < method->bodyEnd)
+            continue;
+        keptTokens.append(ptok);
+        if (i < sortedTokens)
+            keptSorted++;
+    }
+    parsedTokens = keptTokens;
+    sortedTokens = keptSorted;
+    compactSymbols();
+
+    for (int i = 0; i < diagnostics.size(); i++)
+    {
+        if (diagnostics[i].scope == method.data())
+        {
+            diagnostics.removeAt(i);
+            i--;
+        }
+    }
+}
+
+void Parser::setMethodBodyTokens(QSharedPointer<ZMethod> method, const QList<Tokenizer::Token>& bodyTokens)
+{
+    // same as parse(): comments are highlighted, but not seen by the parser
+    method->tokens.clear();
+    for (const Tokenizer::Token& token : bodyTokens)
+    {
+        if (token.type == Tokenizer::LineComment || token.type == Tokenizer::BlockComment)
+            addParsedToken(token, ParserToken::Comment);
+        else method->tokens.append(token);
+    }
+    // parsed by ensureMethodBody, like a lazy body
+    pendingBodies.append(method);
+}
+
+bool Parser::prepareMethodBodyEdit(QSharedPointer<ZMethod> method, const QString& text, int delta)
+{
+    if (!root || method->bodyStart < 0)
+        return false;
+    // the positions of another body are right once the edits before it are applied
+    if (shift.method != method)
+        applyPendingShift();
+
+    int oldEnd = method->bodyEnd;
+    int newEnd = oldEnd + delta;
+    QList<Tokenizer::Token> bodyTokens;
+    if (!lexMethodBody(method, text, newEnd, bodyTokens))
+        return false;
+
+    // from here on the edit is known to be local to the body. what comes after it moves later (see PendingShift)
+    int oldEndLine = method->bodyEndLine;
+    int lineDelta = text.midRef(method->bodyStart, newEnd - method->bodyStart).count('\n') - (oldEndLine - method->bodyLine);
+
+    discardMethodBody(method, oldEnd, delta, lineDelta);
+    method->bodyEnd = newEnd;
+    method->bodyEndLine = oldEndLine + lineDelta;
+    setMethodBodyTokens(method, bodyTokens);
+    return true;
+}
+
+bool Parser::reparseMethodBody(QSharedPointer<ZMethod> method, const QString& text)
+{
+    if (!root || method->bodyStart < 0)
+        return false;
+    if (shift.method != method)
+        applyPendingShift();
+
+    // positions don't change, but the body is lexed again: tokens are released once a body is parsed
+    QList<Tokenizer::Token> bodyTokens;
+    if (!lexMethodBody(method, text, method->bodyEnd, bodyTokens))
+        return false;
+    discardMethodBody(method, method->bodyEnd, 0, 0);
+    setMethodBodyTokens(method, bodyTokens);
+    return ensureMethodBody(method);
+}
+
 QSharedPointer<ZCodeBlock> Parser::parseCodeBlock(TokenStream& stream, QSharedPointer<ZTreeNode> parent, QSharedPointer<ZStruct> context)
 {
     QSharedPointer<ZCodeBlock> block = QSharedPointer<ZCodeBlock>(new ZCodeBlock(parent));
@@ -84,7 +539,9 @@ QSharedPointer<ZCodeBlock> Parser::parseCodeBlock(TokenStream& stream, QSharedPo
 
 ZForCycle::~ZForCycle()
 {
-    // not needed anymore?
+    releaseLater(initializers);
+    releaseLater(condition);
+    releaseLater(step);
 }
 
 QSharedPointer<ZForCycle> Parser::parseForCycle(TokenStream& stream, QSharedPointer<ZTreeNode> parent, QSharedPointer<ZStruct> context)
@@ -97,10 +554,10 @@ QSharedPointer<ZForCycle> Parser::parseForCycle(TokenStream& stream, QSharedPoin
     Tokenizer::Token token;
     if (!stream.expectToken(token, Tokenizer::OpenParen))
     {
-        qDebug("parseForCycle: unexpected %s, expected open parenthesis at line %d", token.toCString(), token.line);
+        reportError(QString::asprintf("parseForCycle: unexpected %s, expected open parenthesis at line %d", token.toCString(), token.line), token.line);
         return nullptr;
     }
-    parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+    addParsedToken(token, ParserToken::SpecialToken);
     // either expression or list of initializers. same rules as local variables. todo: move out to some function
     QList<QSharedPointer<ZTreeNode>> initializers = parseStatement(stream, parent, context, Stmt_CycleInitializer, Tokenizer::Semicolon);
     cycle->initializers = initializers;
@@ -109,7 +566,7 @@ QSharedPointer<ZForCycle> Parser::parseForCycle(TokenStream& stream, QSharedPoin
     cycle->condition = condition.size() ? condition[0].dynamicCast<ZExpression>() : nullptr;
     if (cycle->condition && cycle->condition->type() != ZTreeNode::Expression)
     {
-        qDebug("parseForCycle: expected valid expression for loop condition at line %d", token.line);
+        reportError(QString::asprintf("parseForCycle: expected valid expression for loop condition at line %d", token.line), token.line);
         return nullptr;
     }
 
@@ -123,7 +580,7 @@ QSharedPointer<ZForCycle> Parser::parseForCycle(TokenStream& stream, QSharedPoin
         {
             if (!stream.expectToken(token, Tokenizer::CloseParen))
             {
-                qDebug("parseForCycle: unexpected %s, expected closing parenthesis at line %d", token.toCString(), token.line);
+                reportError(QString::asprintf("parseForCycle: unexpected %s, expected closing parenthesis at line %d", token.toCString(), token.line), token.line);
                 return nullptr;
             }
         }
@@ -135,10 +592,10 @@ QSharedPointer<ZForCycle> Parser::parseForCycle(TokenStream& stream, QSharedPoin
         skipWhitespace(stream, true);
         if (!stream.expectToken(token, Tokenizer::Comma|Tokenizer::CloseParen))
         {
-            qDebug("parseForCycle: unexpected %s, expected comma or closing parenthesis at line %d", token.toCString(), token.line);
+            reportError(QString::asprintf("parseForCycle: unexpected %s, expected comma or closing parenthesis at line %d", token.toCString(), token.line), token.line);
             return nullptr;
         }
-        parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+        addParsedToken(token, ParserToken::SpecialToken);
         if (token.type == Tokenizer::CloseParen)
             break;
     }
@@ -148,7 +605,7 @@ QSharedPointer<ZForCycle> Parser::parseForCycle(TokenStream& stream, QSharedPoin
     QSharedPointer<ZCodeBlock> forBlock = parseCodeBlockOrLine(stream, parent, context, cycle);
     if (!forBlock)
     {
-        qDebug("parseForCycle: expected valid cycle code");
+        reportError("parseForCycle: expected valid cycle code");
         return nullptr;
     }
     forBlock->parent = cycle;
@@ -182,7 +639,7 @@ QList<QSharedPointer<ZTreeNode>> Parser::parseStatement(TokenStream& stream, QSh
         // check keywords. for now allow only "const", "let", types, and "return"
         if (token.value == "let" && allowInitializer)
         {
-            parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+            addParsedToken(token, ParserToken::Keyword);
             while (true)
             {
                 // make a new local variable
@@ -190,7 +647,7 @@ QList<QSharedPointer<ZTreeNode>> Parser::parseStatement(TokenStream& stream, QSh
                 skipWhitespace(stream, true);
                 if (!stream.expectToken(token, Tokenizer::Identifier))
                 {
-                    qDebug("parseStatement: unexpected %s, expected variable name at line %d", token.toCString(), token.line);
+                    reportError(QString::asprintf("parseStatement: unexpected %s, expected variable name at line %d", token.toCString(), token.line), token.line);
                     return empty;
                 }
                 Tokenizer::Token identifierToken = token;
@@ -198,15 +655,15 @@ QList<QSharedPointer<ZTreeNode>> Parser::parseStatement(TokenStream& stream, QSh
                 skipWhitespace(stream, true);
                 if (!stream.expectToken(token, Tokenizer::OpAssign))
                 {
-                    qDebug("parseStatement: unexpected %s, expected assignment at line %d", token.toCString(), token.line);
+                    reportError(QString::asprintf("parseStatement: unexpected %s, expected assignment at line %d", token.toCString(), token.line), token.line);
                     return empty;
                 }
-                parsedTokens.append(ParserToken(token, ParserToken::Operator));
+                addParsedToken(token, ParserToken::Operator);
                 skipWhitespace(stream, true);
                 QSharedPointer<ZExpression> expr = parseExpression(stream, Tokenizer::Comma|stopAtAnyOf);
                 if (!expr)
                 {
-                    qDebug("parseStatement: expected valid assignment expression at line %d", token.line);
+                    reportError(QString::asprintf("parseStatement: expected valid assignment expression at line %d", token.line), token.line);
                     return empty;
                 }
                 highlightExpression(expr, parent, context);
@@ -217,16 +674,16 @@ QList<QSharedPointer<ZTreeNode>> Parser::parseStatement(TokenStream& stream, QSh
                 var->children.append(expr);
                 var->identifier = identifierToken.value;
                 nodes.append(var);
-                parsedTokens.append(ParserToken(identifierToken, ParserToken::Local, var, identifierToken.value));
+                addParsedToken(identifierToken, ParserToken::Local, var, identifierToken.value);
 
                 skipWhitespace(stream, true);
                 if (!stream.expectToken(token, Tokenizer::Comma|stopAtAnyOf))
                 {
-                    qDebug("parseStatement: unexpected %s, expected next variable or finalizing token at line %d", token.toCString(), token.line);
+                    reportError(QString::asprintf("parseStatement: unexpected %s, expected next variable or finalizing token at line %d", token.toCString(), token.line), token.line);
                     return empty;
                 }
 
-                parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+                addParsedToken(token, ParserToken::SpecialToken);
                 if (token.type == Tokenizer::Semicolon)
                     break;
             }
@@ -235,11 +692,11 @@ QList<QSharedPointer<ZTreeNode>> Parser::parseStatement(TokenStream& stream, QSh
         }
         else if ((token.value == "break" || token.value == "continue") && allowCycleControl)
         {
-            parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+            addParsedToken(token, ParserToken::Keyword);
             skipWhitespace(stream, true);
             if (!stream.expectToken(token, Tokenizer::Semicolon))
             {
-                qDebug("parseStatement: unexpected %s, expected semicolon at line %d", token.toCString(), token.line);
+                reportError(QString::asprintf("parseStatement: unexpected %s, expected semicolon at line %d", token.toCString(), token.line), token.line);
                 return empty;
             }
             QSharedPointer<ZExecutionControl> ctl = QSharedPointer<ZExecutionControl>(new ZExecutionControl(nullptr));
@@ -249,7 +706,7 @@ QList<QSharedPointer<ZTreeNode>> Parser::parseStatement(TokenStream& stream, QSh
         }
         else if (token.value == "return" && allowReturn)
         {
-            parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+            addParsedToken(token, ParserToken::Keyword);
             // for now, return single value
             skipWhitespace(stream, true);
             QSharedPointer<ZExpression> expr = parseExpression(stream, Tokenizer::Semicolon);
@@ -259,7 +716,7 @@ QList<QSharedPointer<ZTreeNode>> Parser::parseStatement(TokenStream& stream, QSh
                 skipWhitespace(stream, true);
                 if (!stream.peekToken(token) || token.type != Tokenizer::Semicolon)
                 {
-                    qDebug("parseStatement: expected valid return expression at line %d", token.line);
+                    reportError(QString::asprintf("parseStatement: expected valid return expression at line %d", token.line), token.line);
                     return empty;
                 }
 
@@ -280,30 +737,30 @@ QList<QSharedPointer<ZTreeNode>> Parser::parseStatement(TokenStream& stream, QSh
             skipWhitespace(stream, true);
             if (!stream.expectToken(token, Tokenizer::Semicolon))
             {
-                qDebug("parseStatement: unexpected %s, expected semicolon at line %d", token.toCString(), token.line);
+                reportError(QString::asprintf("parseStatement: unexpected %s, expected semicolon at line %d", token.toCString(), token.line), token.line);
                 return empty;
             }
-            parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+            addParsedToken(token, ParserToken::SpecialToken);
             return nodes;
         }
         else if (token.value == "if" && allowCondition)
         {
-            parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+            addParsedToken(token, ParserToken::Keyword);
             QSharedPointer<ZCondition> cond = parseCondition(stream, parent, context);
             if (!cond)
             {
-                qDebug("parseCondition: expected valid condition at line %d", token.line);
+                reportError(QString::asprintf("parseCondition: expected valid condition at line %d", token.line), token.line);
                 return empty;
             }
             nodes.append(cond);
         }
         else if (token.value == "for" && allowCycle)
         {
-            parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+            addParsedToken(token, ParserToken::Keyword);
             QSharedPointer<ZForCycle> cycle = parseForCycle(stream, parent, context);
             if (!cycle)
             {
-                qDebug("parseStatement: expected valid for cycle at line %d", token.line);
+                reportError(QString::asprintf("parseStatement: expected valid for cycle at line %d", token.line), token.line);
                 return empty;
             }
             nodes.append(cycle);
@@ -311,11 +768,11 @@ QList<QSharedPointer<ZTreeNode>> Parser::parseStatement(TokenStream& stream, QSh
         }
         else if (token.value == "while" && allowCycle)
         {
-            parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+            addParsedToken(token, ParserToken::Keyword);
         }
         else if (token.value == "do" && allowCycle)
         {
-            parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+            addParsedToken(token, ParserToken::Keyword);
         }
         else
         {
@@ -330,10 +787,10 @@ QList<QSharedPointer<ZTreeNode>> Parser::parseStatement(TokenStream& stream, QSh
 
                 if (!stream.expectToken(token, stopAtAnyOf))
                 {
-                    qDebug("parseStatement: unexpected %s, expected finalizing token at line %d", token.toCString(), token.line);
+                    reportError(QString::asprintf("parseStatement: unexpected %s, expected finalizing token at line %d", token.toCString(), token.line), token.line);
                     return empty;
                 }
-                parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+                addParsedToken(token, ParserToken::SpecialToken);
             }
             else if (allowInitializer)
             {
@@ -348,7 +805,7 @@ QList<QSharedPointer<ZTreeNode>> Parser::parseStatement(TokenStream& stream, QSh
                 ZCompoundType type;
                 if (!parseCompoundType(stream, type, context))
                 {
-                    qDebug("parseStatement: expected valid local type at line %d", token.line);
+                    reportError(QString::asprintf("parseStatement: expected valid local type at line %d", token.line), token.line);
                     return empty;
                 }
                 while (true)
@@ -359,7 +816,7 @@ QList<QSharedPointer<ZTreeNode>> Parser::parseStatement(TokenStream& stream, QSh
                     skipWhitespace(stream, true);
                     if (!stream.expectToken(token, Tokenizer::Identifier))
                     {
-                        qDebug("parseStatement: unexpected %s, expected variable name at line %d", token.toCString(), token.line);
+                        reportError(QString::asprintf("parseStatement: unexpected %s, expected variable name at line %d", token.toCString(), token.line), token.line);
                         return empty;
                     }
                     Tokenizer::Token identifierToken = token;
@@ -368,13 +825,13 @@ QList<QSharedPointer<ZTreeNode>> Parser::parseStatement(TokenStream& stream, QSh
                     skipWhitespace(stream, true);
                     if (stream.peekToken(token) && token.type == Tokenizer::OpAssign)
                     {
-                        parsedTokens.append(ParserToken(token, ParserToken::Operator));
+                        addParsedToken(token, ParserToken::Operator);
                         stream.setPosition(stream.position()+1);
                         skipWhitespace(stream, true);
                         expr = parseExpression(stream, Tokenizer::Comma|Tokenizer::Semicolon);
                         if (!expr)
                         {
-                            qDebug("parseStatement: expected valid assignment expression at line %d", token.line);
+                            reportError(QString::asprintf("parseStatement: expected valid assignment expression at line %d", token.line), token.line);
                             return empty;
                         }
                         highlightExpression(expr, parent, context);
@@ -384,13 +841,13 @@ QList<QSharedPointer<ZTreeNode>> Parser::parseStatement(TokenStream& stream, QSh
                         while (true)
                         {
                             stream.setPosition(stream.position()+1);
-                            parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+                            addParsedToken(token, ParserToken::SpecialToken);
                             // read array dimensions. they are mutually incompatible with assignment... at least for now
                             // read in subscript
                             QList<Tokenizer::Token> subTokens;
                             if (!consumeTokens(stream, subTokens, Tokenizer::CloseSquare))
                             {
-                                qDebug("parseStatement: unexpected end of stream while reading array expression at line %d", token.line);
+                                reportError(QString::asprintf("parseStatement: unexpected end of stream while reading array expression at line %d", token.line), token.line);
                                 return empty;
                             }
                             //
@@ -398,16 +855,16 @@ QList<QSharedPointer<ZTreeNode>> Parser::parseStatement(TokenStream& stream, QSh
                             stream.peekToken(token);
                             if (!stream.expectToken(token, Tokenizer::CloseSquare))
                             {
-                                qDebug("parseStatement: unexpected %s, expected closing square while reading array expression at line %d", token.toCString(), token.line);
+                                reportError(QString::asprintf("parseStatement: unexpected %s, expected closing square while reading array expression at line %d", token.toCString(), token.line), token.line);
                                 return empty;
                             }
-                            parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+                            addParsedToken(token, ParserToken::SpecialToken);
                             // parse expression under this subscript
                             TokenStream exprStream(subTokens);
                             QSharedPointer<ZExpression> expr = parseExpression(exprStream, 0);
                             if (!expr)
                             {
-                                qDebug("parseStatement: expected valid expression while reading array expression at line %d", token.line);
+                                reportError(QString::asprintf("parseStatement: expected valid expression while reading array expression at line %d", token.line), token.line);
                                 return empty;
                             }
                             highlightExpression(expr, parent, context);
@@ -433,16 +890,16 @@ QList<QSharedPointer<ZTreeNode>> Parser::parseStatement(TokenStream& stream, QSh
                         var->children.append(expr);
                     }
                     nodes.append(var);
-                    parsedTokens.append(ParserToken(identifierToken, ParserToken::Local, var, identifierToken.value));
+                    addParsedToken(identifierToken, ParserToken::Local, var, identifierToken.value);
 
                     skipWhitespace(stream, true);
                     if (!stream.expectToken(token, Tokenizer::Comma|Tokenizer::Semicolon))
                     {
-                        qDebug("parseStatement: unexpected %s, expected next variable or semicolon at line %d", token.toCString(), token.line);
+                        reportError(QString::asprintf("parseStatement: unexpected %s, expected next variable or semicolon at line %d", token.toCString(), token.line), token.line);
                         return empty;
                     }
 
-                    parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+                    addParsedToken(token, ParserToken::SpecialToken);
                     if (token.type == Tokenizer::Semicolon)
                         break;
                 }
@@ -455,7 +912,8 @@ QList<QSharedPointer<ZTreeNode>> Parser::parseStatement(TokenStream& stream, QSh
 
 ZCondition::~ZCondition()
 {
-    // not needed anymore?
+    releaseLater(condition);
+    releaseLater(elseBlock);
 }
 
 QSharedPointer<ZCondition> Parser::parseCondition(TokenStream& stream, QSharedPointer<ZTreeNode> parent, QSharedPointer<ZStruct> context)
@@ -467,16 +925,16 @@ QSharedPointer<ZCondition> Parser::parseCondition(TokenStream& stream, QSharedPo
     Tokenizer::Token token;
     if (!stream.expectToken(token, Tokenizer::OpenParen))
     {
-        qDebug("parseCondition: unexpected %s, expected open parenthesis at line %d", token.toCString(), token.line);
+        reportError(QString::asprintf("parseCondition: unexpected %s, expected open parenthesis at line %d", token.toCString(), token.line), token.line);
         return nullptr;
     }
-    parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+    addParsedToken(token, ParserToken::SpecialToken);
 
     // parse expression
     QSharedPointer<ZExpression> expr = parseExpression(stream, Tokenizer::CloseParen);
     if (!expr)
     {
-        qDebug("parseCondition: expected valid condition expression at line %d", token.line);
+        reportError(QString::asprintf("parseCondition: expected valid condition expression at line %d", token.line), token.line);
         return nullptr;
     }
     highlightExpression(expr, parent, context);
@@ -485,15 +943,15 @@ QSharedPointer<ZCondition> Parser::parseCondition(TokenStream& stream, QSharedPo
     skipWhitespace(stream, true);
     if (!stream.expectToken(token, Tokenizer::CloseParen))
     {
-        qDebug("parseCondition: unexpected %s, expected close parenthesis at line %d", token.toCString(),token.line);
+        reportError(QString::asprintf("parseCondition: unexpected %s, expected close parenthesis at line %d", token.toCString(),token.line), token.line);
         return nullptr;
     }
-    parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+    addParsedToken(token, ParserToken::SpecialToken);
 
     QSharedPointer<ZCodeBlock> condBlock = parseCodeBlockOrLine(stream, parent, context, cond);
     if (!condBlock)
     {
-        qDebug("parseCondition: expected valid conditional code");
+        reportError("parseCondition: expected valid conditional code");
         return nullptr;
     }
     condBlock->parent = cond;
@@ -503,11 +961,11 @@ QSharedPointer<ZCondition> Parser::parseCondition(TokenStream& stream, QSharedPo
     skipWhitespace(stream, true);
     if (stream.expectToken(token, Tokenizer::Identifier) && token.value.toLower() == "else")
     {
-        parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+        addParsedToken(token, ParserToken::Keyword);
         QSharedPointer<ZCodeBlock> elseBlock = parseCodeBlockOrLine(stream, parent, context, cond);
         if (!elseBlock)
         {
-            qDebug("parseCondition: expected valid else conditional code");
+            reportError("parseCondition: expected valid else conditional code");
             return nullptr;
         }
         elseBlock->parent = cond;
@@ -528,27 +986,27 @@ QSharedPointer<ZCodeBlock> Parser::parseCodeBlockOrLine(TokenStream& stream, QSh
     skipWhitespace(stream, true);
     if (stream.peekToken(token) && token.type == Tokenizer::OpenCurly) // this is a code block
     {
-        parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+        addParsedToken(token, ParserToken::SpecialToken);
         stream.setPosition(stream.position()+1);
         QList<Tokenizer::Token> tokens;
         if (!consumeTokens(stream, tokens, Tokenizer::CloseCurly))
         {
-            qDebug("parseCodeBlockOrLine: unexpected end of stream, expected cycle code block at line %d", token.line);
+            reportError(QString::asprintf("parseCodeBlockOrLine: unexpected end of stream, expected cycle code block at line %d", token.line), token.line);
             return nullptr;
         }
 
         if (!stream.readToken(token) || token.type != Tokenizer::CloseCurly)
         {
-            qDebug("parseCodeBlockOrLine: unexpected end of stream, expected closing curly brace at line %d", token.line);
+            reportError(QString::asprintf("parseCodeBlockOrLine: unexpected end of stream, expected closing curly brace at line %d", token.line), token.line);
             return nullptr;
         }
-        parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+        addParsedToken(token, ParserToken::SpecialToken);
 
         TokenStream childTs(tokens);
         QSharedPointer<ZCodeBlock> block = parseCodeBlock(childTs, parent, context);
         if (!block)
         {
-            qDebug("parseCodeBlockOrLine: expected valid code block at line %d", token.line);
+            reportError(QString::asprintf("parseCodeBlockOrLine: expected valid code block at line %d", token.line), token.line);
             return nullptr;
         }
         return block;
@@ -558,7 +1016,7 @@ QSharedPointer<ZCodeBlock> Parser::parseCodeBlockOrLine(TokenStream& stream, QSh
         QList<QSharedPointer<ZTreeNode>> statements = parseStatement(stream, parent, context, Stmt_Function|Stmt_CycleControl, Tokenizer::Semicolon);
         if (!statements.size())
         {
-            qDebug("parseCodeBlockOrLine: expected one-line statement at line %d", token.line);
+            reportError(QString::asprintf("parseCodeBlockOrLine: expected one-line statement at line %d", token.line), token.line);
             return nullptr;
         }
 
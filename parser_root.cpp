@@ -22,7 +22,7 @@ bool Parser::parseRoot(TokenStream& stream)
             skipWhitespace(stream, false);
             if (!stream.expectToken(token, Tokenizer::String))
             {
-                qDebug("invalid version statement, expected string at line %d", token.line);
+                reportError(QString::asprintf("invalid version statement, expected string at line %d", token.line), token.line);
                 return false;
             }
 
@@ -35,11 +35,11 @@ bool Parser::parseRoot(TokenStream& stream)
 
         if (token.type == Tokenizer::Preprocessor) // #
         {
-            parsedTokens.append(ParserToken(token, ParserToken::Preprocessor));
+            addParsedToken(token, ParserToken::Preprocessor);
             skipWhitespace(stream, false);
             if (!stream.expectToken(token, Tokenizer::Identifier))
             {
-                qDebug("invalid preprocessor token at line %d", token.line);
+                reportError(QString::asprintf("invalid preprocessor token at line %d", token.line), token.line);
                 return false; // for now abort, but later - just ignore the token
             }
 
@@ -47,14 +47,14 @@ bool Parser::parseRoot(TokenStream& stream)
             // answer: NO. use const
             if (token.value == "include")
             {
-                parsedTokens.append(ParserToken(token, ParserToken::Preprocessor));
+                addParsedToken(token, ParserToken::Preprocessor);
                 skipWhitespace(stream, false);
                 if (!stream.expectToken(token, Tokenizer::String))
                 {
-                    qDebug("invalid include at line %d - expected filename", token.line);
+                    reportError(QString::asprintf("invalid include at line %d - expected filename", token.line), token.line);
                     return false; // for now abort, but later - just ignore the token
                 }
-                parsedTokens.append(ParserToken(token, ParserToken::Preprocessor));
+                addParsedToken(token, ParserToken::Preprocessor);
 
                 QSharedPointer<ZInclude> incl = QSharedPointer<ZInclude>(new ZInclude(root));
                 incl->location = token.value;
@@ -64,7 +64,7 @@ bool Parser::parseRoot(TokenStream& stream)
             }
             else
             {
-                qDebug("invalid preprocessor directive '%s' at line %d", token.toCString(), token.line);
+                reportError(QString::asprintf("invalid preprocessor directive '%s' at line %d", token.toCString(), token.line), token.line);
                 return false; // for now abort, but later - just ignore the token
             }
         }
@@ -72,7 +72,7 @@ bool Parser::parseRoot(TokenStream& stream)
         {
             if (token.value == "class" || token.value == "extend")
             {
-                parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+                addParsedToken(token, ParserToken::Keyword);
                 bool isExtend = token.value == "extend";
                 if (isExtend)
                 {
@@ -80,16 +80,16 @@ bool Parser::parseRoot(TokenStream& stream)
                     skipWhitespace(stream, true);
                     if (!stream.expectToken(token, Tokenizer::Identifier))
                     {
-                        qDebug("invalid extend class at line %d", token.line);
+                        reportError(QString::asprintf("invalid extend class at line %d", token.line), token.line);
                         return false;
                     }
 
                     if (token.value != "class")
                     {
-                        qDebug("unexpected '%s' at line %d, expected 'extend class'", token.toCString(), token.line);
+                        reportError(QString::asprintf("unexpected '%s' at line %d, expected 'extend class'", token.toCString(), token.line), token.line);
                         return false;
                     }
-                    parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+                    addParsedToken(token, ParserToken::Keyword);
                 }
                 QSharedPointer<ZClass> cls = parseClass(stream, isExtend);
                 if (!cls)
@@ -100,7 +100,7 @@ bool Parser::parseRoot(TokenStream& stream)
             }
             else if (token.value == "struct")
             {
-                parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+                addParsedToken(token, ParserToken::Keyword);
                 QSharedPointer<ZStruct> struc = parseStruct(stream, nullptr);
                 if (!struc)
                     return false;
@@ -110,7 +110,7 @@ bool Parser::parseRoot(TokenStream& stream)
             }
             else if (token.value == "enum")
             {
-                parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+                addParsedToken(token, ParserToken::Keyword);
                 QSharedPointer<ZEnum> enm = parseEnum(stream, nullptr);
                 if (!enm)
                     return false;
@@ -120,7 +120,7 @@ bool Parser::parseRoot(TokenStream& stream)
             }
             else if (token.value == "const")
             {
-                parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+                addParsedToken(token, ParserToken::Keyword);
                 QSharedPointer<ZConstant> konst = parseConstant(stream, nullptr);
                 if (!konst)
                     return false;
@@ -130,7 +130,7 @@ bool Parser::parseRoot(TokenStream& stream)
             }
             else
             {
-                qDebug("invalid identifier at top level: %s at line %d", token.toCString(), token.line);
+                reportError(QString::asprintf("invalid identifier at top level: %s at line %d", token.toCString(), token.line), token.line);
             }
         }
     }
@@ -157,63 +157,63 @@ QSharedPointer<ZClass> Parser::parseClass(TokenStream& stream, bool extend)
     Tokenizer::Token token;
     if (!stream.expectToken(token, Tokenizer::Identifier))
     {
-        qDebug("parseClass: unexpected %s, expected class name at line %d", token.toCString(), token.line);
+        reportError(QString::asprintf("parseClass: unexpected %s, expected class name at line %d", token.toCString(), token.line), token.line);
         return nullptr;
     }
     c_className = token.value;
     if (extend) c_extendName = c_className;
-    parsedTokens.append(ParserToken(token, ParserToken::TypeName, nullptr, c_className));
+    addParsedToken(token, ParserToken::TypeName, nullptr, c_className);
 
     skipWhitespace(stream, true);
     if (!stream.expectToken(token, Tokenizer::Colon|Tokenizer::OpenCurly|Tokenizer::Identifier))
     {
-        qDebug("parseClass: unexpected %s, expected parent class, replace, flag or class body at line %d", token.toCString(), token.line);
+        reportError(QString::asprintf("parseClass: unexpected %s, expected parent class, replace, flag or class body at line %d", token.toCString(), token.line), token.line);
         return nullptr;
     }
 
     if (token.type == Tokenizer::Colon)
     {
-        parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+        addParsedToken(token, ParserToken::SpecialToken);
         skipWhitespace(stream, true);
         if (!stream.expectToken(token, Tokenizer::Identifier))
         {
-            qDebug("parseClass: unexpected %s, expected parent class name at line %d", token.toCString(), token.line);
+            reportError(QString::asprintf("parseClass: unexpected %s, expected parent class name at line %d", token.toCString(), token.line), token.line);
             return nullptr;
         }
         c_parentName = token.value;
-        parsedTokens.append(ParserToken(token, ParserToken::TypeName, nullptr, c_parentName));
+        addParsedToken(token, ParserToken::TypeName, nullptr, c_parentName);
 
         skipWhitespace(stream, true);
         if (!stream.expectToken(token, Tokenizer::OpenCurly|Tokenizer::Identifier))
         {
-            qDebug("parseClass: unexpected %s, expected replace, flag or class body at line %d", token.toCString(), token.line);
+            reportError(QString::asprintf("parseClass: unexpected %s, expected replace, flag or class body at line %d", token.toCString(), token.line), token.line);
             return nullptr;
         }
     }
 
     if (token.type == Tokenizer::Identifier && token.value == "replaces")
     {
-        parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+        addParsedToken(token, ParserToken::Keyword);
         skipWhitespace(stream, true);
         if (!stream.expectToken(token, Tokenizer::Identifier))
         {
-            qDebug("parseClass: unexpected %s, expected replaced class name at line %d", token.toCString(), token.line);
+            reportError(QString::asprintf("parseClass: unexpected %s, expected replaced class name at line %d", token.toCString(), token.line), token.line);
             return nullptr;
         }
         c_replaceName = token.value;
-        parsedTokens.append(ParserToken(token, ParserToken::TypeName, nullptr, c_replaceName));
+        addParsedToken(token, ParserToken::TypeName, nullptr, c_replaceName);
 
         skipWhitespace(stream, true);
         if (!stream.expectToken(token, Tokenizer::OpenCurly|Tokenizer::Identifier))
         {
-            qDebug("parseClass: unexpected %s, expected flag or class body at line %d", token.toCString(), token.line);
+            reportError(QString::asprintf("parseClass: unexpected %s, expected flag or class body at line %d", token.toCString(), token.line), token.line);
             return nullptr;
         }
     }
 
     if (token.type == Tokenizer::Identifier)
     {
-        parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+        addParsedToken(token, ParserToken::Keyword);
         // start of flags
         while (true)
         {
@@ -223,29 +223,29 @@ QSharedPointer<ZClass> Parser::parseClass(TokenStream& stream, bool extend)
                 skipWhitespace(stream, true);
                 if (!stream.expectToken(token, Tokenizer::OpenParen))
                 {
-                    qDebug("parseClass: unexpected %s at line %d, expected %s(\"string\")", token.toCString(), token.line, tt.toUtf8().data());
+                    reportError(QString::asprintf("parseClass: unexpected %s at line %d, expected %s(\"string\")", token.toCString(), token.line, tt.toUtf8().data()), token.line);
                     return nullptr;
                 }
-                parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+                addParsedToken(token, ParserToken::SpecialToken);
 
                 skipWhitespace(stream, true);
                 if (!stream.expectToken(token, Tokenizer::String))
                 {
-                    qDebug("parseClass: unexpected %s at line %d, expected %s(\"string\")", token.toCString(), token.line, tt.toUtf8().data());
+                    reportError(QString::asprintf("parseClass: unexpected %s at line %d, expected %s(\"string\")", token.toCString(), token.line, tt.toUtf8().data()), token.line);
                     return nullptr;
                 }
                 if (token.value == "version")
                     c_version = token.value;
                 else c_deprecated = token.value;
-                parsedTokens.append(ParserToken(token, ParserToken::String));
+                addParsedToken(token, ParserToken::String);
 
                 skipWhitespace(stream, true);
                 if (!stream.expectToken(token, Tokenizer::CloseParen))
                 {
-                    qDebug("parseClass: unexpected %s at line %d, expected %s(\"string\")", token.toCString(), token.line, tt.toUtf8().data());
+                    reportError(QString::asprintf("parseClass: unexpected %s at line %d, expected %s(\"string\")", token.toCString(), token.line, tt.toUtf8().data()), token.line);
                     return nullptr;
                 }
-                parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+                addParsedToken(token, ParserToken::SpecialToken);
             }
             else
             {
@@ -255,7 +255,7 @@ QSharedPointer<ZClass> Parser::parseClass(TokenStream& stream, bool extend)
             skipWhitespace(stream, true);
             if (!stream.expectToken(token, Tokenizer::Identifier|Tokenizer::OpenCurly))
             {
-                qDebug("parseClass: unexpected %s, expected flag or class body at line %d", token.toCString(), token.line);
+                reportError(QString::asprintf("parseClass: unexpected %s, expected flag or class body at line %d", token.toCString(), token.line), token.line);
                 return nullptr;
             }
 
@@ -266,21 +266,21 @@ QSharedPointer<ZClass> Parser::parseClass(TokenStream& stream, bool extend)
 
     if (token.type == Tokenizer::OpenCurly)
     {
-        parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+        addParsedToken(token, ParserToken::SpecialToken);
         // rewind one token back
         QList<Tokenizer::Token> classTokens;
         if (!consumeTokens(stream, classTokens, Tokenizer::CloseCurly) || !stream.expectToken(token, Tokenizer::CloseCurly))
         {
-            qDebug("parseClass: unexpected end of input");
+            reportError("parseClass: unexpected end of input");
             return nullptr;
         }
         // check if we actually finished at closing curly brace...
         if (token.type != Tokenizer::CloseCurly)
         {
-            qDebug("parseClass: unexpected end of input while parsing class body; check curly braces");
+            reportError("parseClass: unexpected end of input while parsing class body; check curly braces");
             return nullptr;
         }
-        parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+        addParsedToken(token, ParserToken::SpecialToken);
 
         QSharedPointer<ZClass> cls = QSharedPointer<ZClass>(new ZClass(nullptr));
         cls->flags = c_flags;
@@ -304,7 +304,7 @@ QSharedPointer<ZClass> Parser::parseClass(TokenStream& stream, bool extend)
     }
     else
     {
-        qDebug("parseClass: no class body found at line %d", token.line);
+        reportError(QString::asprintf("parseClass: no class body found at line %d", token.line), token.line);
         return nullptr;
     }
 }
@@ -333,7 +333,7 @@ QSharedPointer<ZStruct> Parser::parseStruct(TokenStream& stream, QSharedPointer<
     Tokenizer::Token token;
     if (!stream.expectToken(token, Tokenizer::Identifier))
     {
-        qDebug("parseStruct: unexpected %s, expected struct name at line %d", token.toCString(), token.line);
+        reportError(QString::asprintf("parseStruct: unexpected %s, expected struct name at line %d", token.toCString(), token.line), token.line);
         return nullptr;
     }
     s_structName = token.value;
@@ -342,13 +342,13 @@ QSharedPointer<ZStruct> Parser::parseStruct(TokenStream& stream, QSharedPointer<
     skipWhitespace(stream, true);
     if (!stream.expectToken(token, Tokenizer::OpenCurly|Tokenizer::Identifier))
     {
-        qDebug("parseStruct: unexpected %s, expected flag or struct body at line %d", token.toCString(), token.line);
+        reportError(QString::asprintf("parseStruct: unexpected %s, expected flag or struct body at line %d", token.toCString(), token.line), token.line);
         return nullptr;
     }
 
     if (token.type == Tokenizer::Identifier)
     {
-        parsedTokens.append(ParserToken(token, ParserToken::Keyword));
+        addParsedToken(token, ParserToken::Keyword);
         // start of flags
         while (true)
         {
@@ -358,29 +358,29 @@ QSharedPointer<ZStruct> Parser::parseStruct(TokenStream& stream, QSharedPointer<
                 skipWhitespace(stream, true);
                 if (!stream.expectToken(token, Tokenizer::OpenParen))
                 {
-                    qDebug("parseStruct: unexpected %s at line %d, expected %s(\"string\")", token.toCString(), token.line, tt.toUtf8().data());
+                    reportError(QString::asprintf("parseStruct: unexpected %s at line %d, expected %s(\"string\")", token.toCString(), token.line, tt.toUtf8().data()), token.line);
                     return nullptr;
                 }
-                parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+                addParsedToken(token, ParserToken::SpecialToken);
 
                 skipWhitespace(stream, true);
                 if (!stream.expectToken(token, Tokenizer::String))
                 {
-                    qDebug("parseStruct: unexpected %s at line %d, expected %s(\"string\")", token.toCString(), token.line, tt.toUtf8().data());
+                    reportError(QString::asprintf("parseStruct: unexpected %s at line %d, expected %s(\"string\")", token.toCString(), token.line, tt.toUtf8().data()), token.line);
                     return nullptr;
                 }
                 if (token.value == "version")
                     s_version = token.value;
                 else s_deprecated = token.value;
-                parsedTokens.append(ParserToken(token, ParserToken::String));
+                addParsedToken(token, ParserToken::String);
 
                 skipWhitespace(stream, true);
                 if (!stream.expectToken(token, Tokenizer::CloseParen))
                 {
-                    qDebug("parseStruct: unexpected %s at line %d, expected %s(\"string\")", token.toCString(), token.line, tt.toUtf8().data());
+                    reportError(QString::asprintf("parseStruct: unexpected %s at line %d, expected %s(\"string\")", token.toCString(), token.line, tt.toUtf8().data()), token.line);
                     return nullptr;
                 }
-                parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+                addParsedToken(token, ParserToken::SpecialToken);
             }
             else
             {
@@ -390,7 +390,7 @@ QSharedPointer<ZStruct> Parser::parseStruct(TokenStream& stream, QSharedPointer<
             skipWhitespace(stream, true);
             if (!stream.expectToken(token, Tokenizer::Identifier|Tokenizer::OpenCurly))
             {
-                qDebug("parseStruct: unexpected %s, expected flag or struct body at line %d", token.toCString(), token.line);
+                reportError(QString::asprintf("parseStruct: unexpected %s, expected flag or struct body at line %d", token.toCString(), token.line), token.line);
                 return nullptr;
             }
 
@@ -401,24 +401,24 @@ QSharedPointer<ZStruct> Parser::parseStruct(TokenStream& stream, QSharedPointer<
 
     if (token.type == Tokenizer::OpenCurly)
     {
-        parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+        addParsedToken(token, ParserToken::SpecialToken);
         // rewind one token back
         QList<Tokenizer::Token> classTokens;
         if (!consumeTokens(stream, classTokens, Tokenizer::CloseCurly) || !stream.expectToken(token, Tokenizer::CloseCurly))
         {
-            qDebug("parseStruct: unexpected end of input");
+            reportError("parseStruct: unexpected end of input");
             return nullptr;
         }
         // check if we actually finished at closing curly brace...
         if (token.type != Tokenizer::CloseCurly)
         {
-            qDebug("parseStruct: unexpected end of input while parsing class body; check curly braces");
+            reportError("parseStruct: unexpected end of input while parsing class body; check curly braces");
             return nullptr;
         }
-        parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+        addParsedToken(token, ParserToken::SpecialToken);
 
         QSharedPointer<ZStruct> struc = QSharedPointer<ZStruct>(new ZStruct(nullptr));
-        parsedTokens.append(ParserToken(structName, ParserToken::TypeName, struc, parentsPrefix+s_structName));
+        addParsedToken(structName, ParserToken::TypeName, struc, parentsPrefix+s_structName);
         struc->flags = s_flags;
         struc->identifier = s_structName;
         struc->tokens = classTokens;
@@ -437,7 +437,7 @@ QSharedPointer<ZStruct> Parser::parseStruct(TokenStream& stream, QSharedPointer<
     }
     else
     {
-        qDebug("parseStruct: no class body found at line %d", token.line);
+        reportError(QString::asprintf("parseStruct: no class body found at line %d", token.line), token.line);
         return nullptr;
     }
 }
@@ -468,7 +468,7 @@ QSharedPointer<ZEnum> Parser::parseEnum(TokenStream& stream, QSharedPointer<ZStr
     Tokenizer::Token token;
     if (!stream.expectToken(token, Tokenizer::Identifier))
     {
-        qDebug("parseEnum: unexpected %s, expected enum name at line %d", token.toCString(), token.line);
+        reportError(QString::asprintf("parseEnum: unexpected %s, expected enum name at line %d", token.toCString(), token.line), token.line);
         return nullptr;
     }
     e_enumName = token.value;
@@ -477,10 +477,10 @@ QSharedPointer<ZEnum> Parser::parseEnum(TokenStream& stream, QSharedPointer<ZStr
     skipWhitespace(stream, true);
     if (!stream.expectToken(token, Tokenizer::OpenCurly))
     {
-        qDebug("parseEnum: unexpected %s, expected enum body at line %d", token.toCString(), token.line);
+        reportError(QString::asprintf("parseEnum: unexpected %s, expected enum body at line %d", token.toCString(), token.line), token.line);
         return nullptr;
     }
-    parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+    addParsedToken(token, ParserToken::SpecialToken);
 
     while (true)
     {
@@ -488,7 +488,7 @@ QSharedPointer<ZEnum> Parser::parseEnum(TokenStream& stream, QSharedPointer<ZStr
         // get name
         if (!stream.expectToken(token, Tokenizer::Identifier|Tokenizer::CloseCurly))
         {
-            qDebug("parseEnum: unexpected %s, expected closing brace or item name at line %d", token.toCString(), token.line);
+            reportError(QString::asprintf("parseEnum: unexpected %s, expected closing brace or item name at line %d", token.toCString(), token.line), token.line);
             return nullptr;
         }
 
@@ -497,11 +497,11 @@ QSharedPointer<ZEnum> Parser::parseEnum(TokenStream& stream, QSharedPointer<ZStr
 
         int lineNo = token.line;
         QString enum_id = token.value;
-        parsedTokens.append(ParserToken(token, ParserToken::ConstantName));
+        addParsedToken(token, ParserToken::ConstantName);
         skipWhitespace(stream, true);
         if (!stream.expectToken(token, Tokenizer::Comma|Tokenizer::OpAssign|Tokenizer::CloseCurly))
         {
-            qDebug("parseEnum: unexpected %s, expected closing brace, comma or value assignment at line %d", token.toCString(), token.line);
+            reportError(QString::asprintf("parseEnum: unexpected %s, expected closing brace, comma or value assignment at line %d", token.toCString(), token.line), token.line);
             return nullptr;
         }
 
@@ -509,14 +509,14 @@ QSharedPointer<ZEnum> Parser::parseEnum(TokenStream& stream, QSharedPointer<ZStr
         if (token.type == Tokenizer::CloseCurly)
             lastEnum = true;
 
-        parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+        addParsedToken(token, ParserToken::SpecialToken);
         if (token.type == Tokenizer::OpAssign)
         {
             skipWhitespace(stream, true);
             QSharedPointer<ZExpression> expr = parseExpression(stream, Tokenizer::Comma|Tokenizer::CloseCurly);
             if (!expr)
             {
-                qDebug("parseEnum: failed parsing expression at line %d", token.line);
+                reportError(QString::asprintf("parseEnum: failed parsing expression at line %d", token.line), token.line);
                 return nullptr;
             }
 
@@ -534,14 +534,14 @@ QSharedPointer<ZEnum> Parser::parseEnum(TokenStream& stream, QSharedPointer<ZStr
             skipWhitespace(stream, true);
             if (!stream.expectToken(token, Tokenizer::Comma|Tokenizer::CloseCurly))
             {
-                qDebug("parseEnum: unexpected %s, expected closing brace or comma at line %d", token.toCString(), token.line);
+                reportError(QString::asprintf("parseEnum: unexpected %s, expected closing brace or comma at line %d", token.toCString(), token.line), token.line);
                 return nullptr;
             }
 
             if (token.type == Tokenizer::CloseCurly)
                 break;
 
-            parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+            addParsedToken(token, ParserToken::SpecialToken);
         }
         else
         {
@@ -555,16 +555,16 @@ QSharedPointer<ZEnum> Parser::parseEnum(TokenStream& stream, QSharedPointer<ZStr
             break;
     }
 
-    parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+    addParsedToken(token, ParserToken::SpecialToken);
     // enum can also optionally end with a semicolon - if ported from C++
     int cpos = stream.position();
     skipWhitespace(stream, true);
     if (!stream.expectToken(token, Tokenizer::Semicolon))
         stream.setPosition(cpos);
-    else parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+    else addParsedToken(token, ParserToken::SpecialToken);
 
     QSharedPointer<ZEnum> enm = QSharedPointer<ZEnum>(new ZEnum(nullptr));
-    parsedTokens.append(ParserToken(enumName, ParserToken::TypeName, enm, parentsPrefix+e_enumName));
+    addParsedToken(enumName, ParserToken::TypeName, enm, parentsPrefix+e_enumName);
     enm->identifier = e_enumName;
     for (QSharedPointer<ZConstant> konst : e_values)
     {
@@ -582,32 +582,32 @@ QSharedPointer<ZConstant> Parser::parseConstant(TokenStream& stream, QSharedPoin
     skipWhitespace(stream, true);
     if (!stream.expectToken(token, Tokenizer::Identifier))
     {
-        qDebug("parseConstant: unexpected %s, expected const identifier at line %d", token.toCString(), token.line);
+        reportError(QString::asprintf("parseConstant: unexpected %s, expected const identifier at line %d", token.toCString(), token.line), token.line);
         return nullptr;
     }
     QString c_identifier = token.value;
-    parsedTokens.append(ParserToken(token, ParserToken::ConstantName));
+    addParsedToken(token, ParserToken::ConstantName);
     skipWhitespace(stream, true);
     if (!stream.expectToken(token, Tokenizer::OpAssign))
     {
-        qDebug("parseConstant: unexpected %s, expected assignment operator at line %d", token.toCString(), token.line);
+        reportError(QString::asprintf("parseConstant: unexpected %s, expected assignment operator at line %d", token.toCString(), token.line), token.line);
         return nullptr;
     }
-    parsedTokens.append(ParserToken(token, ParserToken::Operator));
+    addParsedToken(token, ParserToken::Operator);
     skipWhitespace(stream, true);
     QSharedPointer<ZExpression> c_expression = parseExpression(stream, Tokenizer::Semicolon);
     if (!c_expression)
     {
-        qDebug("parseConstant: expected valid const expression at line %d", token.line);
+        reportError(QString::asprintf("parseConstant: expected valid const expression at line %d", token.line), token.line);
         return nullptr;
     }
     skipWhitespace(stream, true);
     if (!stream.expectToken(token, Tokenizer::Semicolon))
     {
-        qDebug("parseConstant: unexpected %s, expected semicolon at line %d", token.toCString(), token.line);
+        reportError(QString::asprintf("parseConstant: unexpected %s, expected semicolon at line %d", token.toCString(), token.line), token.line);
         return nullptr;
     }
-    parsedTokens.append(ParserToken(token, ParserToken::SpecialToken));
+    addParsedToken(token, ParserToken::SpecialToken);
     QSharedPointer<ZConstant> konst = QSharedPointer<ZConstant>(new ZConstant(struc));
     konst->identifier = c_identifier;
     c_expression->parent = konst;
@@ -0,0 +1,74 @@
+#include "parsesnapshot.h"
+#include <algorithm>
+
+ParseSnapshot::ParseSnapshot()
+{
+    version = 0;
+    maxTokenLength = 0;
+}
+
+static ZTreeNode::NodeType referenceType(QSharedPointer<ZTreeNode> node)
+{
+    return node ? node->type() : ZTreeNode::Generic;
+}
+
+ParseSnapshotPtr ParseSnapshot::build(Parser* parser, const QVector<ParserToken>& parsedTokens, const QString& fullPath, int version)
+{
+    ParseSnapshot* snapshot = new ParseSnapshot();
+    snapshot->fullPath = fullPath;
+    snapshot->version = version;
+
+    snapshot->parsedTokens = parsedTokens;
+    for (const ParserToken& ptok : snapshot->parsedTokens)
+        snapshot->maxTokenLength = qMax(snapshot->maxTokenLength, int(ptok.length));
+    snapshot->diagnostics = parser->diagnostics;
+    for (ParserDiagnostic& diag : snapshot->diagnostics)
+        diag.scope = nullptr;
+
+    snapshot->symbols.reserve(parser->symbols.size());
+    for (const ParserSymbol& parserSymbol : parser->symbols)
+    {
+        Symbol symbol;
+        symbol.referencePath = parserSymbol.referencePath;
+        symbol.referenceType = referenceType(parserSymbol.reference);
+        QSharedPointer<ZLocalVariable> local = parserSymbol.reference.dynamicCast<ZLocalVariable>();
+        if (local)
+        {
+            QSharedPointer<ZTreeNode> localParent = local->parent.toStrongRef();
+            symbol.isArgument = (localParent && localParent->type() == ZTreeNode::Method);
+            symbol.hasType = local->hasType;
+            // type of "let" variables comes from the initializer
+            ZCompoundType vtype = local->varType;
+            if (!local->hasType && local->children.size() && local->children[0]->type() == ZTreeNode::Expression)
+                vtype = local->children[0].dynamicCast<ZExpression>()->resultType;
+            symbol.typeName = vtype.type;
+            symbol.typeReferenceType = referenceType(vtype.reference.toStrongRef());
+        }
+        snapshot->symbols.append(symbol);
+    }
+
+    return ParseSnapshotPtr(snapshot);
+}
+
+const ParseSnapshot::Symbol* ParseSnapshot::tokenSymbol(const ParserToken& token) const
+{
+    if (!token.symbol || int(token.symbol) > symbols.size())
+        return nullptr;
+    return &symbols[token.symbol-1];
+}
+
+const ParserToken* ParseSnapshot::tokenAt(int position) const
+{
+    // last token that starts at or before position, then back while a token can still reach it
+    QVector<ParserToken>::const_iterator it = std::upper_bound(parsedTokens.constBegin(), parsedTokens.constEnd(), position,
+                                                               [](int pos, const ParserToken& tok) { return pos < tok.startsAt; });
+    while (it != parsedTokens.constBegin())
+    {
+        --it;
+        if (it->startsAt + maxTokenLength <= position)
+            break;
+        if (it->endsAt() > position)
+            return &*it;
+    }
+    return nullptr;
+}
@@ -0,0 +1,79 @@
+#ifndef PARSESNAPSHOT_H
+#define PARSESNAPSHOT_H
+
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <memory>
+#include <QAtomicInt>
+#include "tokenizer.h"
+#include "parser.h"
+
+class ParseSnapshot;
+typedef std::shared_ptr<const ParseSnapshot> ParseSnapshotPtr;
+
+// Analysis results of one file at one version: tokens, semantic tokens, symbols and diagnostics.
+// A snapshot is built once, on the thread that ran the analysis, and is never modified afterwards. It holds no
+// pointers into the AST, so any thread can read it without locking while the parser is being changed.
+class ParseSnapshot
+{
+public:
+    // what a symbol refers to, as far as the editor needs to know
+    struct Symbol
+    {
+        QString referencePath;
+        ZTreeNode::NodeType referenceType; // Generic if unresolved
+        // locals and arguments
+        bool isArgument;
+        bool hasType; // false if "let"
+        QString typeName;
+        ZTreeNode::NodeType typeReferenceType; // Generic if unresolved
+
+        Symbol()
+        {
+            referenceType = typeReferenceType = ZTreeNode::Generic;
+            isArgument = false;
+            hasType = true;
+        }
+    };
+
+    // the caller owns the parser, i.e. holds the engine mutex. parsedTokens are the parser's, sorted (see
+    // Parser::sortedParsedTokens)
+    static ParseSnapshotPtr build(Parser* parser, const QVector<ParserToken>& parsedTokens, const QString& fullPath, int version);
+
+    QString fullPath;
+    int version;
+    // sorted by position
+    QVector<ParserToken> parsedTokens;
+    QVector<Symbol> symbols;
+    // scope is always nullptr here
+    QVector<ParserDiagnostic> diagnostics;
+
+    const Symbol* tokenSymbol(const ParserToken& token) const;
+    // semantic token at position, or nullptr
+    const ParserToken* tokenAt(int position) const;
+
+private:
+    ParseSnapshot();
+    // longest semantic token; bounds the search in tokenAt
+    int maxTokenLength;
+};
+
+// The current snapshot of a file. Readers load() a snapshot and keep that version alive for as long as they hold it;
+// the analysis publish()es a new one with an atomic swap. The old version is freed when its last reader lets go.
+class ParseSnapshotSlot
+{
+public:
+    ParseSnapshotPtr load() const { return std::atomic_load(&current); }
+    void publish(ParseSnapshotPtr snapshot) { std::atomic_store(&current, snapshot); outdated.storeRelease(0); }
+    // something the snapshot depends on changed since it was published (another file's declarations, or the file on disk).
+    // it can still be shown, but opening the file analyzes it again
+    void markOutdated() { outdated.storeRelease(1); }
+    bool isOutdated() const { return outdated.loadAcquire(); }
+
+private:
+    ParseSnapshotPtr current;
+    QAtomicInt outdated;
+};
+
+#endif // PARSESNAPSHOT_H
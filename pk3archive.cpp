@@ -0,0 +1,215 @@
+#include "pk3archive.h"
+
+#include <QFileInfo>
+#include <QtEndian>
+#include <zlib.h>
+#include <cstring>
+
+// zip record signatures and fixed sizes
+static const quint32 zipEndOfDirectorySignature = 0x06054b50;
+static const quint32 zipDirectoryEntrySignature = 0x02014b50;
+static const quint32 zipLocalHeaderSignature = 0x04034b50;
+static const int zipEndOfDirectorySize = 22;
+static const int zipDirectoryEntrySize = 46;
+static const int zipLocalHeaderSize = 30;
+// 0xFFFFFFFF in a size field means the real size is in a zip64 extra field
+static const quint32 zip64Marker = 0xFFFFFFFF;
+// larger entries are rejected. nothing in a mod comes close, and sizes are read into an int-sized QByteArray
+static const quint32 maxEntrySize = 256 * 1024 * 1024;
+
+static inline quint16 readU16(const uchar* p)
+{
+    return qFromLittleEndian<quint16>(p);
+}
+
+static inline quint32 readU32(const uchar* p)
+{
+    return qFromLittleEndian<quint32>(p);
+}
+
+Pk3Archive::Pk3Archive()
+{
+    data = nullptr;
+    dataSize = 0;
+}
+
+Pk3Archive::~Pk3Archive()
+{
+    if (data)
+        file.unmap(const_cast<uchar*>(data));
+    data = nullptr;
+}
+
+bool Pk3Archive::isArchivePath(const QString& path)
+{
+    QString suffix = QFileInfo(path).suffix().toLower();
+    return (suffix == "pk3" || suffix == "zip" || suffix == "ipk3");
+}
+
+QSharedPointer<Pk3Archive> Pk3Archive::open(QString path)
+{
+    QSharedPointer<Pk3Archive> archive = QSharedPointer<Pk3Archive>(new Pk3Archive());
+    archive->archivePath = path;
+    archive->file.setFileName(path);
+    if (!archive->file.open(QIODevice::ReadOnly))
+    {
+        qDebug("Pk3Archive: cannot open %s", path.toUtf8().data());
+        return nullptr;
+    }
+
+    archive->dataSize = archive->file.size();
+    if (archive->dataSize < zipEndOfDirectorySize)
+        return nullptr;
+    archive->data = archive->file.map(0, archive->dataSize);
+    if (!archive->data)
+    {
+        qDebug("Pk3Archive: cannot map %s", path.toUtf8().data());
+        return nullptr;
+    }
+
+    if (!archive->readCentralDirectory())
+    {
+        qDebug("Pk3Archive: %s is not a valid zip archive", path.toUtf8().data());
+        return nullptr;
+    }
+
+    return archive;
+}
+
+bool Pk3Archive::readCentralDirectory()
+{
+    // end of central directory record is at the very end, followed by a comment of up to 64k
+    qint64 minPos = qMax(qint64(0), dataSize - zipEndOfDirectorySize - 0xFFFF);
+    qint64 eocd = -1;
+    for (qint64 pos = dataSize - zipEndOfDirectorySize; pos >= minPos; pos--)
+    {
+        if (readU32(data + pos) == zipEndOfDirectorySignature)
+        {
+            eocd = pos;
+            break;
+        }
+    }
+    if (eocd < 0)
+        return false;
+
+    quint16 count = readU16(data + eocd + 10);
+    quint32 directorySize = readU32(data + eocd + 12);
+    quint32 directoryOffset = readU32(data + eocd + 16);
+    if (directoryOffset == 0xFFFFFFFF || count == 0xFFFF)
+    {
+        qDebug("Pk3Archive: zip64 archives are not supported");
+        return false;
+    }
+    if (qint64(directoryOffset) + directorySize > dataSize)
+        return false;
+
+    entryList.reserve(count);
+    const uchar* p = data + directoryOffset;
+    const uchar* end = p + directorySize;
+    for (int i = 0; i < count; i++)
+    {
+        if (p + zipDirectoryEntrySize > end || readU32(p) != zipDirectoryEntrySignature)
+            return false;
+        quint16 flags = readU16(p + 8);
+        quint16 nameLength = readU16(p + 28);
+        quint16 extraLength = readU16(p + 30);
+        quint16 commentLength = readU16(p + 32);
+        if (p + zipDirectoryEntrySize + nameLength > end)
+            return false;
+
+        Entry entry;
+        const char* name = reinterpret_cast<const char*>(p + zipDirectoryEntrySize);
+        // bit 11: name is utf-8. otherwise it's cp437, which is the same as latin1 for the names people actually use
+        entry.name = (flags & 0x0800) ? QString::fromUtf8(name, nameLength) : QString::fromLatin1(name, nameLength);
+        entry.name.replace('\\', '/');
+        entry.method = readU16(p + 10);
+        entry.crc = readU32(p + 16);
+        entry.compressedSize = readU32(p + 20);
+        entry.size = readU32(p + 24);
+        entry.localHeaderOffset = readU32(p + 42);
+        p += zipDirectoryEntrySize + nameLength + extraLength + commentLength;
+
+        // skip directories and encrypted entries
+        if (entry.name.endsWith('/') || (flags & 0x0001))
+            continue;
+        // the sizes are used for the output buffer as they are, damaged or zip64 sizes would overrun it
+        if (entry.size == zip64Marker || entry.compressedSize == zip64Marker)
+        {
+            qDebug("Pk3Archive: zip64 entries are not supported (%s)", entry.name.toUtf8().data());
+            continue;
+        }
+        if (entry.size > maxEntrySize || entry.compressedSize > maxEntrySize)
+        {
+            qDebug("Pk3Archive: %s is too large, skipped", entry.name.toUtf8().data());
+            continue;
+        }
+        entryIndex.insert(entry.name.toLower(), entryList.size());
+        entryList.append(entry);
+    }
+
+    return true;
+}
+
+bool Pk3Archive::contains(const QString& name) const
+{
+    return entryIndex.contains(name.toLower());
+}
+
+bool Pk3Archive::read(const QString& name, QByteArray& out) const
+{
+    int index = entryIndex.value(name.toLower(), -1);
+    if (index < 0)
+        return false;
+    const Entry& entry = entryList[index];
+
+    // the local header repeats the name, and can have a different extra field than the central directory
+    qint64 local = entry.localHeaderOffset;
+    if (local + zipLocalHeaderSize > dataSize || readU32(data + local) != zipLocalHeaderSignature)
+        return false;
+    qint64 start = local + zipLocalHeaderSize + readU16(data + local + 26) + readU16(data + local + 28);
+    if (start + entry.compressedSize > dataSize)
+        return false;
+    const uchar* compressed = data + start;
+
+    if (entry.method == 0)
+    {
+        if (entry.compressedSize != entry.size)
+            return false;
+        out = QByteArray(reinterpret_cast<const char*>(compressed), int(entry.size));
+    }
+    else if (entry.method == 8)
+    {
+        // raw deflate stream, inflated straight from the mapping into the output buffer
+        out.resize(int(entry.size));
+        if (quint32(out.size()) != entry.size)
+            return false;
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+            return false;
+        stream.next_in = const_cast<Bytef*>(compressed);
+        stream.avail_in = entry.compressedSize;
+        stream.next_out = reinterpret_cast<Bytef*>(out.data());
+        stream.avail_out = entry.size;
+        int result = inflate(&stream, Z_FINISH);
+        inflateEnd(&stream);
+        if (result != Z_STREAM_END || stream.total_out != entry.size)
+        {
+            qDebug("Pk3Archive: failed to inflate %s", entry.name.toUtf8().data());
+            return false;
+        }
+    }
+    else
+    {
+        qDebug("Pk3Archive: unsupported compression method %d for %s", entry.method, entry.name.toUtf8().data());
+        return false;
+    }
+
+    if (crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(out.constData()), uInt(out.size())) != entry.crc)
+    {
+        qDebug("Pk3Archive: checksum mismatch for %s", entry.name.toUtf8().data());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,55 @@
+#ifndef PK3ARCHIVE_H
+#define PK3ARCHIVE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+#include <QHash>
+#include <QFile>
+#include <QSharedPointer>
+
+// Read-only PK3 (zip) archive.
+// The archive is memory-mapped and only the central directory is read on open. Entries are decompressed
+// on request, straight from the mapping, so opening an archive costs the size of the entries that are actually read.
+// read() is thread-safe: the loader threads decompress different entries in parallel.
+class Pk3Archive
+{
+public:
+    struct Entry
+    {
+        QString name; // path inside the archive, with original case
+        quint32 crc;
+        quint32 compressedSize;
+        quint32 size;
+        quint32 localHeaderOffset;
+        quint16 method; // 0 = stored, 8 = deflate
+    };
+
+    ~Pk3Archive();
+
+    // returns nullptr if the file is not a readable zip archive
+    static QSharedPointer<Pk3Archive> open(QString path);
+    // true if the path looks like an archive (pk3, zip, ipk3)
+    static bool isArchivePath(const QString& path);
+
+    QString path() const { return archivePath; }
+    const QVector<Entry>& entries() const { return entryList; }
+    // lookup is case-insensitive, same as in GZDoom
+    bool contains(const QString& name) const;
+    // decompressed contents of an entry. returns false if the entry is missing, unsupported or damaged
+    bool read(const QString& name, QByteArray& out) const;
+
+private:
+    Pk3Archive();
+    bool readCentralDirectory();
+
+    QString archivePath;
+    QFile file;
+    const uchar* data;
+    qint64 dataSize;
+    QVector<Entry> entryList;
+    QHash<QString, int> entryIndex;
+};
+
+#endif // PK3ARCHIVE_H
@@ -0,0 +1,204 @@
+#include "profiler.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QList>
+#include <atomic>
+#include <cstring>
+
+#ifndef ZZSCRIPT_NO_PROFILER
+
+// slots of one thread. written by that thread only, read by anyone
+struct ThreadProfile
+{
+    std::atomic<qint64> timerNsecs[Profiler::TimerCount];
+    std::atomic<qint64> timerCalls[Profiler::TimerCount];
+    std::atomic<qint64> counters[Profiler::CounterCount];
+    // nesting of each timer, owner thread only
+    int depth[Profiler::TimerCount];
+
+    ThreadProfile();
+    ~ThreadProfile();
+};
+
+// function statics: nodes of static objects are counted before main, possibly before this file is initialized
+static QMutex& registryLock()
+{
+    static QMutex lock;
+    return lock;
+}
+
+static QList<ThreadProfile*>& registry()
+{
+    static QList<ThreadProfile*> profiles;
+    return profiles;
+}
+
+// what threads that exited had recorded
+static Profiler::Totals retired;
+
+ThreadProfile::ThreadProfile()
+{
+    for (int i = 0; i < Profiler::TimerCount; i++)
+    {
+        timerNsecs[i].store(0, std::memory_order_relaxed);
+        timerCalls[i].store(0, std::memory_order_relaxed);
+        depth[i] = 0;
+    }
+    for (int i = 0; i < Profiler::CounterCount; i++)
+        counters[i].store(0, std::memory_order_relaxed);
+    QMutexLocker locker(&registryLock());
+    registry().append(this);
+}
+
+ThreadProfile::~ThreadProfile()
+{
+    QMutexLocker locker(&registryLock());
+    for (int i = 0; i < Profiler::TimerCount; i++)
+    {
+        retired.timerNsecs[i] += timerNsecs[i].load(std::memory_order_relaxed);
+        retired.timerCalls[i] += timerCalls[i].load(std::memory_order_relaxed);
+    }
+    for (int i = 0; i < Profiler::CounterCount; i++)
+        retired.counters[i] += counters[i].load(std::memory_order_relaxed);
+    registry().removeOne(this);
+}
+
+static ThreadProfile& threadProfile()
+{
+    static thread_local ThreadProfile profile;
+    return profile;
+}
+
+#endif
+
+bool Profiler::isEnabled()
+{
+#ifndef ZZSCRIPT_NO_PROFILER
+    return true;
+#else
+    return false;
+#endif
+}
+
+Profiler::Totals Profiler::totals()
+{
+    Totals out;
+    memset(&out, 0, sizeof(out));
+#ifndef ZZSCRIPT_NO_PROFILER
+    QMutexLocker locker(&registryLock());
+    out = retired;
+    for (ThreadProfile* profile : registry())
+    {
+        for (int i = 0; i < TimerCount; i++)
+        {
+            out.timerNsecs[i] += profile->timerNsecs[i].load(std::memory_order_relaxed);
+            out.timerCalls[i] += profile->timerCalls[i].load(std::memory_order_relaxed);
+        }
+        for (int i = 0; i < CounterCount; i++)
+            out.counters[i] += profile->counters[i].load(std::memory_order_relaxed);
+    }
+#endif
+    return out;
+}
+
+void Profiler::reset()
+{
+#ifndef ZZSCRIPT_NO_PROFILER
+    QMutexLocker locker(&registryLock());
+    memset(&retired, 0, sizeof(retired));
+    for (ThreadProfile* profile : registry())
+    {
+        for (int i = 0; i < TimerCount; i++)
+        {
+            profile->timerNsecs[i].store(0, std::memory_order_relaxed);
+            profile->timerCalls[i].store(0, std::memory_order_relaxed);
+        }
+        for (int i = 0; i < CounterCount; i++)
+            profile->counters[i].store(0, std::memory_order_relaxed);
+    }
+#endif
+}
+
+const char* Profiler::timerName(Timer timer)
+{
+    switch (timer)
+    {
+        case Tokenize: return "tokenize";
+        case ParseRoot: return "parse root";
+        case LinkTypes: return "link types";
+        case FieldPass: return "field pass";
+        case MethodPass: return "method pass";
+        case Highlight: return "highlight";
+        case ApplyFormats: return "apply formats";
+        default: return "?";
+    }
+}
+
+const char* Profiler::counterName(Counter counter)
+{
+    switch (counter)
+    {
+        case TokensLexed: return "tokens lexed";
+        case NodesAllocated: return "nodes allocated";
+        case ResolveTypeCalls: return "resolveType calls";
+        case ResolveSymbolCalls: return "resolveSymbol calls";
+        case ParseCacheHits: return "parse cache hits";
+        case ParseCacheMisses: return "parse cache misses";
+        case SourceBytes: return "source bytes";
+        case QueriesRecomputed: return "queries recomputed";
+        case QueriesReused: return "queries reused";
+        default: return "?";
+    }
+}
+
+QString Profiler::report()
+{
+    if (!isEnabled())
+        return "profiler disabled (built with ZZSCRIPT_NO_PROFILER)\n";
+    Totals t = totals();
+    QString out;
+    for (int i = 0; i < TimerCount; i++)
+    {
+        out += QString("%1 %2 ms, %3 calls\n").arg(QString(timerName(Timer(i))), -20)
+                .arg(t.timerNsecs[i] / 1000000.0, 10, 'f', 2).arg(t.timerCalls[i]);
+    }
+    for (int i = 0; i < CounterCount; i++)
+        out += QString("%1 %2\n").arg(QString(counterName(Counter(i))), -20).arg(t.counters[i], 13);
+    return out;
+}
+
+void Profiler::add(Counter counter, qint64 value)
+{
+#ifndef ZZSCRIPT_NO_PROFILER
+    threadProfile().counters[counter].fetch_add(value, std::memory_order_relaxed);
+#else
+    Q_UNUSED(counter);
+    Q_UNUSED(value);
+#endif
+}
+
+bool Profiler::enter(Timer timer)
+{
+#ifndef ZZSCRIPT_NO_PROFILER
+    return threadProfile().depth[timer]++ == 0;
+#else
+    Q_UNUSED(timer);
+    return false;
+#endif
+}
+
+void Profiler::leave(Timer timer, qint64 nsecs)
+{
+#ifndef ZZSCRIPT_NO_PROFILER
+    ThreadProfile& profile = threadProfile();
+    profile.depth[timer]--;
+    if (nsecs < 0)
+        return;
+    profile.timerNsecs[timer].fetch_add(nsecs, std::memory_order_relaxed);
+    profile.timerCalls[timer].fetch_add(1, std::memory_order_relaxed);
+#else
+    Q_UNUSED(timer);
+    Q_UNUSED(nsecs);
+#endif
+}
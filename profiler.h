@@ -0,0 +1,101 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QElapsedTimer>
+
+// Phase timers and counters.
+// Every thread adds to slots of its own (one uncontended atomic add), readers sum the slots of all threads.
+// Instrumented code uses ZZ_PROFILE_SCOPE and ZZ_PROFILE_COUNT only. Building with ZZSCRIPT_NO_PROFILER defined removes
+// them completely (arguments are not evaluated either); the functions here stay, and report zeros.
+// A timer that is entered again on the same thread while running (e.g. nested structs) counts only the outermost scope.
+class Profiler
+{
+public:
+    enum Timer
+    {
+        Tokenize,
+        ParseRoot,
+        LinkTypes,
+        FieldPass,
+        MethodPass,
+        Highlight,
+        ApplyFormats, // part of Highlight
+        TimerCount
+    };
+
+    enum Counter
+    {
+        TokensLexed,
+        NodesAllocated,
+        ResolveTypeCalls,
+        ResolveSymbolCalls,
+        ParseCacheHits,
+        ParseCacheMisses,
+        SourceBytes,
+        QueriesRecomputed,
+        QueriesReused,
+        CounterCount
+    };
+
+    struct Totals
+    {
+        qint64 timerNsecs[TimerCount];
+        qint64 timerCalls[TimerCount];
+        qint64 counters[CounterCount];
+    };
+
+    static bool isEnabled();
+    // sums over all threads, including the ones that exited since the last reset
+    static Totals totals();
+    static void reset();
+    static const char* timerName(Timer timer);
+    static const char* counterName(Counter counter);
+    // one line per timer and counter
+    static QString report();
+
+    static void add(Counter counter, qint64 value);
+    // used by ProfileScope. enter returns true for the outermost scope of the timer on this thread;
+    // leave records nsecs if it's not negative
+    static bool enter(Timer timer);
+    static void leave(Timer timer, qint64 nsecs);
+};
+
+#ifndef ZZSCRIPT_NO_PROFILER
+
+class ProfileScope
+{
+public:
+    explicit ProfileScope(Profiler::Timer timer) : timer(timer)
+    {
+        outermost = Profiler::enter(timer);
+        if (outermost)
+            clock.start();
+    }
+
+    ~ProfileScope()
+    {
+        Profiler::leave(timer, outermost ? clock.nsecsElapsed() : -1);
+    }
+
+private:
+    Profiler::Timer timer;
+    bool outermost;
+    QElapsedTimer clock;
+};
+
+#define ZZ_PROFILE_CONCAT2(a, b) a##b
+#define ZZ_PROFILE_CONCAT(a, b) ZZ_PROFILE_CONCAT2(a, b)
+// times the rest of the enclosing block
+#define ZZ_PROFILE_SCOPE(timer) ProfileScope ZZ_PROFILE_CONCAT(profileScope, __LINE__)(Profiler::timer)
+#define ZZ_PROFILE_COUNT(counter, value) Profiler::add(Profiler::counter, (value))
+
+#else
+
+#define ZZ_PROFILE_SCOPE(timer) do {} while (false)
+#define ZZ_PROFILE_COUNT(counter, value) do {} while (false)
+
+#endif
+
+#endif // PROFILER_H
@@ -1,168 +1,265 @@
 #include "project.h"
 
+#include <QCryptographicHash>
 #include <QDir>
+#include <QDirIterator>
 #include <QFileInfo>
+#include <QSet>
+#include "sourceloader.h"
+#include "libraryindex.h"
 
-Project::Project(QString path)
+Project::Project(QString path, QSharedPointer<const LibraryIndex> library)
 {
+    this->library = library;
+    lazyMethodBodies = false;
+    fileListRevision = 0;
+    if (library)
+        classOverlay = library->classOverlay();
     path = fixPath(path);
     int lastSlash = path.lastIndexOf('/');
     if (lastSlash < 0)
         lastSlash = -1; // specifically -1, not -2, not -666... I don't remember how Qt does it exactly
     projectName = path.mid(lastSlash+1);
+    basePath = path;
     // read root
-    readDir(path, projectName);
+    if (Pk3Archive::isArchivePath(path) && QFileInfo(path).isFile())
+    {
+        archive = Pk3Archive::open(path);
+        if (archive)
+            readArchive(projectName);
+    }
+    else readDir(path, projectName);
+}
+
+void Project::setLibrary(QSharedPointer<const LibraryIndex> library)
+{
+    this->library = library;
+    classOverlay = library ? library->classOverlay() : nullptr;
+}
+
+void Project::prioritize(const QString& fullPath)
+{
+    QMutexLocker locker(&priorityLock);
+    priorityPaths.removeAll(fullPath);
+    priorityPaths.append(fullPath);
+}
+
+ProjectFile* Project::takeNextFile(QList<ProjectFile*>& waiting)
+{
+    QMutexLocker locker(&priorityLock);
+    while (!priorityPaths.isEmpty())
+    {
+        ProjectFile* f = findFileByFullPath(priorityPaths.takeLast());
+        // not in the project, or done already
+        if (f && waiting.removeOne(f))
+            return f;
+    }
+    return waiting.takeFirst();
 }
 
 void Project::readDir(QString basePath, QString relativeBasePath)
 {
-    QDir dir(basePath);
-    QStringList files = dir.entryList(QDir::NoDotAndDotDot|QDir::Dirs|QDir::Files, QDir::DirsFirst);
-    for (const QString& file : files)
+    // single streaming pass over the whole tree. QDirIterator gets the entry type from the directory listing,
+    // so there is no separate stat per entry
+    QStringList dirPaths;
+    QStringList filePaths;
+    QDirIterator it(basePath, QDir::NoDotAndDotDot|QDir::Dirs|QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext())
     {
-        // if dir, read all sub files
-        const QFileInfo testDir(basePath+"/"+file);
-        if (testDir.isDir())
-        {
-            directories.append(relativeBasePath+"/"+file);
-            readDir(basePath+"/"+file, relativeBasePath+"/"+file);
-        }
-        else
-        {
-            // if file, add file
-            ProjectFile pf;
-            pf.fullPath = basePath+"/"+file;
-            pf.relativePath = relativeBasePath+"/"+file;
-            pf.fileType = ProjectFile::Unknown;
-            pf.name = file;
-            this->files.append(pf);
-        }
+        QString entry = it.next().mid(basePath.length()+1);
+        if (it.fileInfo().isDir())
+            dirPaths.append(entry);
+        else filePaths.append(entry);
+    }
+
+    // directory listing order is arbitrary; keep the tree sorted by name
+    dirPaths.sort();
+    filePaths.sort();
+
+    for (const QString& dir : dirPaths)
+        directories.append(relativeBasePath+"/"+dir);
+
+    for (const QString& file : filePaths)
+    {
+        ProjectFile pf;
+        pf.fullPath = basePath+"/"+file;
+        pf.relativePath = relativeBasePath+"/"+file;
+        pf.fileType = ProjectFile::Unknown;
+        pf.name = file.mid(file.lastIndexOf('/')+1);
+        this->files.append(pf);
+        // QList stores ProjectFile by pointer, so the address stays valid while the list grows
+        includeGraph.addFile(&this->files.last());
     }
 }
 
 // this is your typical fixSlashes. it's needed for various reasons, but mainly for easy ZScript include lookup
 QString Project::fixPath(QString path)
 {
-    path = path.replace('\\', '/');
-    // look for multiple slashes in a row, collapse
+    // single pass: convert backslashes and collapse multiple slashes in a row
+    QString fixed;
+    fixed.reserve(path.length());
     bool wasslash = false;
-    for (int i = 0; i < path.length(); i++)
+    for (QChar c : path)
     {
-        if (path[i] == '/')
+        if (c == '\\')
+            c = '/';
+        if (c == '/')
         {
             if (wasslash)
-            {
-                path.remove(i, 1);
                 continue;
-            }
-            else wasslash = true;
+            wasslash = true;
         }
         else wasslash = false;
+        fixed.append(c);
     }
-    return path;
+    return fixed;
 }
 
-bool Project::parseProject()
+ProjectFile* Project::findFile(const QString& relativePath) const
 {
-    bool allok = true;
-    // find zscript.txt
-    QList<ProjectFile*> zsFiles;
-    QStringList includeTree;
-    QStringList allIncludes;
-    bool rootfound = false;
-    for (ProjectFile& f : files)
+    return includeGraph.file(relativePath);
+}
+
+ProjectFile* Project::findFileByFullPath(const QString& fullPath) const
+{
+    QString path = fixPath(fullPath);
+    if (!path.startsWith(basePath + "/"))
+        return nullptr;
+    return includeGraph.file(projectName + path.mid(basePath.length()));
+}
+
+void Project::readArchive(QString relativeBasePath)
+{
+    // same layout as readDir, only the listing comes from the central directory.
+    // nothing is decompressed here
+    QStringList filePaths;
+    QSet<QString> dirPaths;
+    for (const Pk3Archive::Entry& entry : archive->entries())
     {
-        if (f.relativePath == projectName + "/zscript.txt")
-        {
-            zsFiles.append(&f);
-            f.fileType = ProjectFile::ZScript;
-            // parse file
-            bool thisok = f.parse();
-            allok &= thisok;
-            if (!thisok)
-                qDebug("parseProject: %s/zscript.txt failed", projectName.toUtf8().data());
-            rootfound = true;
-            allIncludes.append(f.relativePath);
-            // find and add includes
-            if (f.parser && f.parser->root)
-            {
-                for (QSharedPointer<ZTreeNode> node : f.parser->root->children)
-                {
-                    if (node->type() == ZTreeNode::Include)
-                    {
-                        QSharedPointer<ZInclude> inc = node.dynamicCast<ZInclude>();
-                        includeTree.append(inc->location);
-                    }
-                }
-            }
-            break;
-        }
+        filePaths.append(entry.name);
+        // zips don't always have explicit directory entries, so take them from file paths
+        for (int slash = entry.name.indexOf('/'); slash >= 0; slash = entry.name.indexOf('/', slash+1))
+            dirPaths.insert(entry.name.left(slash));
     }
 
-    if (!rootfound)
+    QStringList sortedDirs = dirPaths.toList();
+    sortedDirs.sort();
+    filePaths.sort();
+
+    for (const QString& dir : sortedDirs)
+        directories.append(relativeBasePath+"/"+dir);
+
+    for (const QString& file : filePaths)
+    {
+        ProjectFile pf;
+        pf.fullPath = archive->path()+"/"+file;
+        pf.relativePath = relativeBasePath+"/"+file;
+        pf.fileType = ProjectFile::Unknown;
+        pf.name = file.mid(file.lastIndexOf('/')+1);
+        this->files.append(pf);
+        includeGraph.addFile(&this->files.last());
+    }
+}
+
+bool Project::parseProject()
+{
+    bool allok = true;
+    // files are read and tokenized by the loader threads. every include is queued for prefetch
+    // as soon as the file that includes it is parsed, so the next files are loading while this one is parsed
+    SourceLoader loader;
+    // archive entries are decompressed by the loader threads, only the ones that are actually included
+    loader.setArchive(archive);
+    includeGraph.clearIncludes();
+
+    // find zscript.txt
+    ProjectFile* rootFile = includeGraph.file(projectName + "/zscript.txt");
+    if (!rootFile)
     {
         qDebug("parseProject: %s/zscript.txt not found", projectName.toUtf8().data());
         return false;
     }
 
-    if (includeTree.size())
+    // breadth-first over includes. a file that is included more than once is parsed once
+    QList<ProjectFile*> includeQueue;
+    QSet<ProjectFile*> queuedFiles;
+    includeQueue.append(rootFile);
+    queuedFiles.insert(rootFile);
+    loadPhase.storeRelease(LoadDeclarations);
+    for (int i = 0; i < includeQueue.size(); i++)
     {
-        do
+        if (loadCancelled.loadAcquire())
+            return false;
+        loadDone.storeRelease(i);
+        loadTotal.storeRelease(includeQueue.size());
+        ProjectFile* f = includeQueue[i];
+        f->fileType = ProjectFile::ZScript;
+        // parse file
+        bool thisok = f->parse(&loader);
+        allok &= thisok;
+        if (!thisok)
+            qDebug("parseProject: %s failed", f->relativePath.toUtf8().data());
+        if (!f->parser || !f->parser->root)
+            continue;
+
+        // find and add includes
+        QList<ProjectFile*> included;
+        QStringList prefetch;
+        for (QSharedPointer<ZTreeNode> node : f->parser->root->children)
         {
-            bool incfound = false;
-            QString currentInclude = includeTree.first();
-            if (allIncludes.contains(projectName + "/" + currentInclude))
-            {
-                qDebug("parseProject: circular include %s/%s", projectName.toUtf8().data(), currentInclude.toUtf8().data());
-                includeTree.removeFirst();
+            if (node->type() != ZTreeNode::Include)
                 continue;
-            }
-            for (ProjectFile& f : files)
-            {
-                if (f.relativePath == projectName + "/" + currentInclude)
-                {
-                    zsFiles.append(&f);
-                    f.fileType = ProjectFile::ZScript;
-                    // parse file
-                    bool thisok = f.parse();
-                    allok &= thisok;
-                    if (!thisok)
-                        qDebug("parseProject: %s/%s failed", projectName.toUtf8().data(), currentInclude.toUtf8().data());
-                    includeTree.removeFirst();
-                    incfound = true;
-                    allIncludes.append(f.relativePath);
-                    // find and add includes
-                    if (f.parser && f.parser->root)
-                    {
-                        for (QSharedPointer<ZTreeNode> node : f.parser->root->children)
-                        {
-                            if (node->type() == ZTreeNode::Include)
-                            {
-                                QSharedPointer<ZInclude> inc = node.dynamicCast<ZInclude>();
-                                includeTree.append(inc->location);
-                            }
-                        }
-                    }
-                    break;
-                }
-            }
-
-            if (!incfound)
+            QSharedPointer<ZInclude> inc = node.dynamicCast<ZInclude>();
+            ProjectFile* incf = includeGraph.file(projectName + "/" + inc->location);
+            if (!incf)
             {
-                qDebug("parseProject: %s/%s not found", projectName.toUtf8().data(), currentInclude.toUtf8().data());
+                qDebug("parseProject: %s/%s not found", projectName.toUtf8().data(), inc->location.toUtf8().data());
                 allok = false;
+                continue;
             }
+            included.append(incf);
+            if (queuedFiles.contains(incf))
+                continue;
+            queuedFiles.insert(incf);
+            includeQueue.append(incf);
+            prefetch.append(incf->fullPath);
         }
-        while (includeTree.size());
+
+        includeGraph.setIncludes(f->relativePath, included);
+        loader.prefetch(prefetch);
+    }
+
+    // include order follows from the file contents, so this changes if and only if some parsed file changes
+    QCryptographicHash context(QCryptographicHash::Sha1);
+    if (library)
+        context.addData(library->contextHash());
+    for (ProjectFile* f : includeQueue)
+    {
+        if (f->cacheEntry)
+            context.addData(f->cacheEntry->contentHash);
     }
+    contextHash = context.result();
+
+    for (const QStringList& cycle : includeGraph.cycles())
+        qDebug("parseProject: circular include %s -> %s", cycle.join(" -> ").toUtf8().data(), cycle.first().toUtf8().data());
 
     allok &= parseProjectClasses(); // this can be separate from parseProject
+    if (loadCancelled.loadAcquire())
+        return false;
+
+    // from here on, the query engine decides what is parsed again
+    queries.setLibrary(library, classOverlay);
+    for (ProjectFile* f : includeQueue)
+        queries.adoptFile(f);
+    queries.adoptClassGraph();
+    loadPhase.storeRelease(LoadDone);
     return allok;
 }
 
 bool Project::parseProjectClasses()
 {
     QList<QSharedPointer<ZTreeNode>> allTypes;
+    if (library)
+        allTypes = library->types();
     for (ProjectFile& f : files)
     {
         if (!f.parser) continue;
@@ -171,9 +268,22 @@ bool Project::parseProjectClasses()
     }
 
     bool allok = true;
+    int cachedFiles = 0;
+    QList<ProjectFile*> waiting;
     for (ProjectFile& f : files)
     {
-        if (!f.parser) continue;
+        if (f.parser)
+            waiting.append(&f);
+    }
+    loadPhase.storeRelease(LoadClasses);
+    loadDone.storeRelease(0);
+    loadTotal.storeRelease(waiting.size());
+    while (!waiting.isEmpty())
+    {
+        if (loadCancelled.loadAcquire())
+            return false;
+        ProjectFile& f = *takeNextFile(waiting);
+        f.parser->setClassOverlay(classOverlay);
         f.parser->setTypeInformation(allTypes);
 
         for (QSharedPointer<ZTreeNode> node : f.parser->root->children)
@@ -188,7 +298,11 @@ bool Project::parseProjectClasses()
             }
         }
 
+        // method bodies don't affect other files. if nothing in the project changed since the cache was written,
+        // the bodies are left pending and show the semantic tokens and diagnostics from the cache until they are parsed
+        bool cached = f.cacheEntry && !f.cacheEntry->dirty && f.cacheEntry->contextHash == contextHash;
         // later this also needs to be done outside of the parser after all fields are processed
+        f.parser->setLazyMethodBodies(lazyMethodBodies || cached);
         for (QSharedPointer<ZTreeNode> node : f.parser->root->children)
         {
             if (node->type() == ZTreeNode::Class)
@@ -200,41 +314,367 @@ bool Project::parseProjectClasses()
                 allok &= f.parser->parseStructMethods(node.dynamicCast<ZStruct>());
             }
         }
+        if (cached)
+        {
+            f.parser->restoreSemanticTokens(f.cacheEntry->semanticTokens, f.cacheEntry->symbolPaths, f.cacheEntry->diagnostics);
+            f.cacheEntry->tokens.clear();
+            cachedFiles++;
+        }
+
+        // the file can be shown from here on, while the others are still being parsed
+        f.snapshot.publish(ParseSnapshot::build(f.parser, f.parser->sortedParsedTokens(), f.fullPath, 0));
+        loadDone.fetchAndAddRelease(1);
+    }
+
+    // write out new and outdated cache entries. files with lazy method bodies are written once the bodies are parsed
+    int storedFiles = 0;
+    for (ProjectFile& f : files)
+    {
+        if (storeCacheEntry(f))
+            storedFiles++;
+    }
+    qDebug("parseProjectClasses: %d files from parse cache, %d written to %s", cachedFiles, storedFiles, ParseCache::directory().toUtf8().data());
+
+    // semantic token memory summary
+    int semanticTokens = 0;
+    int semanticSymbols = 0;
+    for (ProjectFile& f : files)
+    {
+        if (!f.parser) continue;
+        semanticTokens += f.parser->parsedTokens.size();
+        semanticSymbols += f.parser->symbols.size();
     }
+    qDebug("parseProjectClasses: %d semantic tokens (%d KB), %d symbols", semanticTokens, int(semanticTokens*sizeof(ParserToken)/1024), semanticSymbols);
 
     return allok;
 }
 
-bool ProjectFile::parse()
+bool Project::parseMethodBodies(int maxMethods)
 {
-    if (parser) delete parser;
-    parser = nullptr;
+    int remaining = maxMethods;
+    for (ProjectFile& f : files)
+    {
+        if (!f.parser)
+            continue;
+        bool pending = f.parser->hasPendingMethodBodies();
+        if (queries.hasFile(f.fullPath))
+        {
+            // through the engine, so that every body records the types it depends on.
+            // the engine can replace the parser on the way, then its bodies are pending again
+            while (remaining > 0 && f.parser->hasPendingMethodBodies())
+            {
+                QSharedPointer<ZMethod> method = f.parser->nextPendingMethodBody();
+                queries.body(method);
+                if (queries.isCancelled())
+                    return false;
+                // not found by the engine
+                f.parser->ensureMethodBody(method);
+                remaining--;
+            }
+        }
+        else remaining -= f.parser->parsePendingMethodBodies(remaining);
+        if (f.parser->hasPendingMethodBodies())
+            return false; // out of budget
+        // the snapshot is complete now, so opening the file doesn't need an analysis
+        if (pending)
+            f.snapshot.publish(ParseSnapshot::build(f.parser, f.parser->sortedParsedTokens(), f.fullPath, 0));
+        // this also writes out files whose bodies were parsed on request
+        storeCacheEntry(f);
+    }
+    return true;
+}
 
-    // read file
-    QFileInfo fi(fullPath);
-    if (!fi.isFile())
-        return false;
+QString Project::relativePath(const QString& fullPath) const
+{
+    return projectName + fullPath.mid(basePath.length());
+}
+
+ProjectFile* Project::addFile(const QString& fullPath)
+{
+    ProjectFile pf;
+    pf.fullPath = fullPath;
+    pf.relativePath = relativePath(fullPath);
+    pf.fileType = ProjectFile::Unknown;
+    pf.name = fullPath.mid(fullPath.lastIndexOf('/')+1);
+    files.append(pf);
+    includeGraph.addFile(&files.last());
+    return &files.last();
+}
 
-    //
-    QFile f(fullPath);
-    if (f.open(QIODevice::ReadOnly|QIODevice::Text))
+void Project::removeFile(ProjectFile* f)
+{
+    queries.removeFile(f->fullPath);
+    includeGraph.removeFile(f->relativePath);
+    for (int i = 0; i < files.size(); i++)
     {
-        contents = f.readAll();
+        if (&files[i] == f)
+        {
+            files.removeAt(i);
+            break;
+        }
+    }
+}
 
-        Tokenizer t(contents);
-        QList<Tokenizer::Token> tokens = t.readAllTokens();
-        parser = new Parser(tokens);
+bool Project::applyChanges(const QStringList& paths, QStringList& reread, QStringList& outdated)
+{
+    queries.resetStatistics();
+    QSet<QString> changedFiles;
+    QSet<QString> changedDirs;
+    for (const QString& changed : paths)
+    {
+        QString path = fixPath(changed);
+        if (path != basePath && !path.startsWith(basePath + "/"))
+            continue;
+        if (path == basePath || QFileInfo(path).isDir() || directories.contains(relativePath(path)))
+            changedDirs.insert(path);
+        else changedFiles.insert(path);
+    }
 
-        f.close();
-        bool okparsed = parser->parse();
-        if (parser->root)
+    // entries of a directory changed: compare what is on disk under it with what the project has
+    bool filesChanged = false;
+    for (const QString& dir : changedDirs)
+    {
+        QString prefix = dir + "/";
+        QString relativePrefix = relativePath(prefix);
+        QSet<QString> onDisk;
+        QSet<QString> dirsOnDisk;
+        if (QFileInfo(dir).isDir())
+        {
+            QDirIterator it(dir, QDir::NoDotAndDotDot|QDir::Dirs|QDir::Files, QDirIterator::Subdirectories);
+            while (it.hasNext())
+            {
+                QString entry = fixPath(it.next());
+                if (it.fileInfo().isDir())
+                    dirsOnDisk.insert(relativePath(entry));
+                else onDisk.insert(entry);
+            }
+        }
+
+        for (int i = 0; i < directories.size(); i++)
+        {
+            if (directories[i].startsWith(relativePrefix) && !dirsOnDisk.remove(directories[i]))
+            {
+                directories.removeAt(i);
+                i--;
+                filesChanged = true;
+            }
+        }
+        for (const QString& newDir : dirsOnDisk)
         {
-            parser->root->fullPath = fullPath;
-            parser->root->relativePath = relativePath;
+            directories.append(newDir);
+            filesChanged = true;
         }
 
-        return okparsed;
+        for (const ProjectFile& f : files)
+        {
+            if (f.fullPath.startsWith(prefix) && !onDisk.remove(f.fullPath))
+                changedFiles.insert(f.fullPath); // removed
+        }
+        changedFiles.unite(onDisk); // added
+    }
+    if (filesChanged)
+        directories.sort();
+
+    // read the changed files again. only the text goes to the engine here; parsing happens below, through the queries
+    bool closureChanged = false;
+    QStringList textChanged;
+    for (const QString& path : changedFiles)
+    {
+        ProjectFile* f = findFileByFullPath(path);
+        if (!QFileInfo(path).isFile())
+        {
+            if (!f)
+                continue;
+            closureChanged |= queries.hasFile(f->fullPath);
+            removeFile(f);
+            filesChanged = true;
+            continue;
+        }
+        if (!f)
+        {
+            addFile(path);
+            filesChanged = true;
+            continue;
+        }
+        // not part of the include closure (yet): read when it gets included
+        if (!queries.hasFile(path) || !f->source)
+            continue;
+        if (f->source->isEdited())
+        {
+            qDebug("applyChanges: %s has unsaved edits, keeping them", f->relativePath.toUtf8().data());
+            continue;
+        }
+        QSharedPointer<SourceFile> source = SourceFile::open(path);
+        if (!source || source->text() == f->source->text())
+            continue; // i.e. our own save
+        f->source = source;
+        // positions in it don't match the new text
+        f->snapshot.publish(nullptr);
+        queries.setFileText(path, source->text());
+        textChanged.append(path);
+        reread.append(path);
+    }
+
+    // the include closure can change with any of these files: walk it again. unchanged files are only verified
+    QList<ProjectFile*> includeQueue;
+    QSet<ProjectFile*> queuedFiles;
+    ProjectFile* rootFile = includeGraph.file(projectName + "/zscript.txt");
+    if (rootFile)
+    {
+        includeQueue.append(rootFile);
+        queuedFiles.insert(rootFile);
+    }
+    for (int i = 0; i < includeQueue.size(); i++)
+    {
+        ProjectFile* f = includeQueue[i];
+        if (!queries.hasFile(f->fullPath))
+        {
+            if (!f->source)
+                f->source = SourceFile::open(f->fullPath);
+            if (!f->source)
+                continue;
+            f->fileType = ProjectFile::ZScript;
+            queries.addFile(f);
+            closureChanged = true;
+        }
+
+        Parser* parser = queries.declarations(f->fullPath);
+        if (!parser || !parser->root)
+            continue;
+        QList<ProjectFile*> included;
+        for (QSharedPointer<ZTreeNode> node : parser->root->children)
+        {
+            if (node->type() != ZTreeNode::Include)
+                continue;
+            ProjectFile* incf = includeGraph.file(projectName + "/" + node.dynamicCast<ZInclude>()->location);
+            if (!incf)
+                continue;
+            included.append(incf);
+            if (queuedFiles.contains(incf))
+                continue;
+            queuedFiles.insert(incf);
+            includeQueue.append(incf);
+        }
+        includeGraph.setIncludes(f->relativePath, included);
+    }
+
+    // files that are not included anymore
+    for (ProjectFile& f : files)
+    {
+        if (queuedFiles.contains(&f) || !queries.hasFile(f.fullPath))
+            continue;
+        queries.removeFile(f.fullPath);
+        includeGraph.setIncludes(f.relativePath, QList<ProjectFile*>());
+        Parser::retire(f.parser);
+        f.parser = nullptr;
+        f.snapshot.publish(nullptr);
+        closureChanged = true;
+    }
+
+    if (filesChanged)
+        fileListRevision++;
+    bool declarationsChanged = closureChanged;
+    QSet<QString> outdatedFiles;
+    for (const QString& path : textChanged)
+    {
+        if (!queries.hasFile(path))
+            continue;
+        QSet<QString> dependents;
+        if (!queries.updateDeclarations(path, &dependents))
+            continue;
+        declarationsChanged = true;
+        if (closureChanged)
+            continue;
+        for (const QString& dependent : markDependentsOutdated(path, dependents))
+            outdatedFiles.insert(dependent);
+    }
+    // types joined or left the project: anything can refer to them
+    if (closureChanged)
+    {
+        markSnapshotsOutdated();
+        for (const ProjectFile& f : files)
+            outdatedFiles.insert(f.fullPath);
+    }
+    outdated = outdatedFiles.values();
+
+    qDebug("applyChanges: %d paths, %d files read again, %d files outdated, %d queries recomputed%s%s", paths.size(), textChanged.size(), outdated.size(),
+           queries.recomputedCount(), filesChanged ? ", files added or removed" : "", declarationsChanged ? ", declarations changed" : "");
+    return declarationsChanged;
+}
+
+void Project::markSnapshotsOutdated()
+{
+    for (ProjectFile& f : files)
+        f.snapshot.markOutdated();
+}
+
+QStringList Project::markDependentsOutdated(const QString& fullPath, const QSet<QString>& dependents)
+{
+    QSet<QString> outdated = dependents;
+    ProjectFile* pf = findFileByFullPath(fullPath);
+    if (pf)
+    {
+        for (ProjectFile* f : includeGraph.affectedBy(pf->relativePath))
+            outdated.insert(f->fullPath);
+    }
+    outdated.remove(fullPath);
+
+    QStringList out;
+    for (const QString& path : outdated)
+    {
+        ProjectFile* f = findFileByFullPath(path);
+        if (!f)
+            continue;
+        f->snapshot.markOutdated();
+        out.append(path);
+    }
+    return out;
+}
+
+bool Project::storeCacheEntry(ProjectFile& f)
+{
+    if (!f.parser || !f.cacheEntry || f.parser->hasPendingMethodBodies())
+        return false;
+    if (!f.cacheEntry->dirty && f.cacheEntry->contextHash == contextHash)
+        return false;
+    ParseCache::collect(*f.cacheEntry, f.parser, contextHash);
+    bool stored = ParseCache::store(*f.cacheEntry);
+    f.cacheEntry->dirty = false;
+    f.cacheEntry->tokens.clear();
+    return stored;
+}
+
+bool ProjectFile::parse(SourceLoader* loader)
+{
+    Parser::retire(parser);
+    parser = nullptr;
+
+    // read file. if there is a loader, it's already read and tokenized (or being read) on a loader thread
+    SourceLoader::Result loaded = loader ? loader->take(fullPath) : SourceLoader::load(fullPath);
+    if (!loaded.ok)
+        return false; // failed to open
+
+    source = loaded.source;
+    if (loaded.cached)
+    {
+        cacheEntry = loaded.cached;
+    }
+    else
+    {
+        // written out after the project is fully parsed
+        cacheEntry = QSharedPointer<ParseCacheEntry>(new ParseCacheEntry());
+        cacheEntry->contentHash = loaded.contentHash;
+        cacheEntry->tokens = loaded.tokens;
+        cacheEntry->dirty = true;
+    }
+    parser = new Parser(loaded.tokens);
+
+    bool okparsed = parser->parse();
+    if (parser->root)
+    {
+        parser->root->fullPath = fullPath;
+        parser->root->relativePath = relativePath;
     }
 
-    return false; // failed to open
+    return okparsed;
 }
@@ -2,8 +2,20 @@
 #define PROJECT_H
 
 #include <QString>
+#include <QStringList>
 #include <QList>
+#include <QMutex>
+#include <QAtomicInt>
 #include "parser.h"
+#include "sourcefile.h"
+#include "includegraph.h"
+#include "parsecache.h"
+#include "pk3archive.h"
+#include "queryengine.h"
+#include "parsesnapshot.h"
+
+class SourceLoader;
+class LibraryIndex;
 
 struct ProjectFile
 {
@@ -21,8 +33,13 @@ struct ProjectFile
 
     ProjectFileType fileType;
 
-    QString contents;
+    // shared with the Document that shows this file
+    QSharedPointer<SourceFile> source;
     Parser* parser;
+    // parse cache entry for the current contents. either loaded from the cache, or created on parse and written out by Project
+    QSharedPointer<ParseCacheEntry> cacheEntry;
+    // results of the last analysis, for readers on any thread. published at load and by every analysis of the file
+    ParseSnapshotSlot snapshot;
 
     ProjectFile()
     {
@@ -31,28 +48,99 @@ struct ProjectFile
 
     ~ProjectFile()
     {
-        if (parser) delete parser;
+        Parser::retire(parser);
         parser = nullptr;
     }
 
-    bool parse();
+    // loader is optional. without it, the file is read and tokenized on the calling thread
+    bool parse(SourceLoader* loader = nullptr);
 };
 
 class Project
 {
 public:
-    Project(QString basePath);
+    // library is optional. its types are visible to the project, but are never reparsed or modified.
+    // basePath is either a directory or a pk3/zip archive
+    Project(QString basePath, QSharedPointer<const LibraryIndex> library = nullptr);
     QList<ProjectFile> files;
     QList<QString> directories;
+    // incremented whenever files or directories are added or removed after the initial scan
+    int fileListRevision;
     QString projectName;
+    QString basePath;
+    // path index and include edges. filled by readDir and parseProject
+    IncludeGraph includeGraph;
+    // hash of the contents of all parsed files. cached semantic results are valid only for the same context
+    QByteArray contextHash;
+    QSharedPointer<const LibraryIndex> library;
+    // edges from project classes into library classes. shared with every parser of the project
+    QSharedPointer<ZClassOverlay> classOverlay;
+    // set if the project is read from an archive. file full paths are then <archive path>/<entry>
+    QSharedPointer<Pk3Archive> archive;
+    // skeleton parse: parseProject parses declarations only, method bodies are parsed on request or by parseMethodBodies
+    bool lazyMethodBodies;
+    // incremental analysis after parseProject: every parsed file is adopted, edits go through setFileText.
+    // declared after files, the engine refers to them
+    QueryEngine queries;
+
+    // parseProject can run on a worker thread while the GUI shows the file tree. these are safe to use from other
+    // threads while it runs; everything else belongs to the loading thread until parseProject returns
+    enum LoadPhase
+    {
+        LoadPending,
+        LoadDeclarations,
+        LoadClasses,
+        LoadDone
+    };
+    // phase, and files done out of total in this phase. the total of the declaration pass grows as includes are found
+    QAtomicInt loadPhase;
+    QAtomicInt loadDone;
+    QAtomicInt loadTotal;
+    // parseProject stops at the next file and returns false
+    void cancelLoad() { loadCancelled.storeRelease(1); }
+    // the file is opened: its class passes run before those of the files that are still waiting
+    void prioritize(const QString& fullPath);
 
     static QString fixPath(QString path);
+    // before parseProject, if the library wasn't loaded yet when the project was opened
+    void setLibrary(QSharedPointer<const LibraryIndex> library);
+
+    // O(1) lookups through the include graph index. return nullptr if the file is not in the project
+    ProjectFile* findFile(const QString& relativePath) const;
+    ProjectFile* findFileByFullPath(const QString& fullPath) const;
 
     bool parseProject();
     bool parseProjectClasses();
+    // background pass for lazy method bodies. parses up to maxMethods bodies, returns true when none are left.
+    // after parseProject the bodies go through the engine; the caller holds queries.mutex()
+    bool parseMethodBodies(int maxMethods);
+    // changes made on disk outside of the editor, collected over a while (see ProjectWatcher): full paths of changed files
+    // and directories. only these files are read and parsed again, the engine recomputes what depends on them.
+    // reread receives the files whose text was replaced, outdated the other files whose snapshots are now out of date
+    // (every file if the include closure changed). returns true if declarations that other files see changed.
+    // files with unsaved edits keep them. the caller holds queries.mutex(); MainWindow runs this on a worker thread, so
+    // files and includeGraph are only read with the mutex held while a batch may be running
+    bool applyChanges(const QStringList& paths, QStringList& reread, QStringList& outdated);
+    // every snapshot is out of date, i.e. after declarations changed
+    void markSnapshotsOutdated();
+    // the declarations of fullPath changed: the snapshots of the files that include it, directly or not, and of the
+    // dependents the engine reported (see QueryEngine::updateDeclarations) are out of date. returns their full paths
+    QStringList markDependentsOutdated(const QString& fullPath, const QSet<QString>& dependents);
 
 private:
+    QAtomicInt loadCancelled;
+    QMutex priorityLock;
+    QStringList priorityPaths;
+    // next file for the class passes: the most recently prioritized one that is still waiting, or the first one
+    ProjectFile* takeNextFile(QList<ProjectFile*>& waiting);
+
     void readDir(QString basePath, QString relativeBasePath);
+    void readArchive(QString relativeBasePath);
+    bool storeCacheEntry(ProjectFile& f);
+    ProjectFile* addFile(const QString& fullPath);
+    void removeFile(ProjectFile* f);
+    // project-relative path of a full path inside basePath
+    QString relativePath(const QString& fullPath) const;
 };
 
 #endif // PROJECT_H
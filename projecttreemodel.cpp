@@ -0,0 +1,195 @@
+#include "projecttreemodel.h"
+#include "project.h"
+
+ProjectTreeModel::ProjectTreeModel(QObject* parent) : QAbstractItemModel(parent)
+{
+    root = nullptr;
+}
+
+ProjectTreeModel::~ProjectTreeModel()
+{
+    clear();
+}
+
+void ProjectTreeModel::clear()
+{
+    if (root)
+        deleteNode(root);
+    root = nullptr;
+    childDirectories.clear();
+    childFiles.clear();
+    nodes.clear();
+}
+
+void ProjectTreeModel::deleteNode(Node* node)
+{
+    // directories are a few levels deep at most
+    for (Node* child : node->children)
+        deleteNode(child);
+    delete node;
+}
+
+QString ProjectTreeModel::parentPath(const QString& path)
+{
+    int lastSlash = path.lastIndexOf('/');
+    return (lastSlash >= 0) ? path.left(lastSlash) : QString();
+}
+
+void ProjectTreeModel::setProject(const Project* project)
+{
+    beginResetModel();
+    clear();
+    root = new Node();
+    root->isDirectory = true;
+    root->fetched = true;
+    root->row = 0;
+    root->parent = nullptr;
+    if (project)
+    {
+        basePath = project->basePath;
+        projectName = project->projectName;
+        for (const QString& dir : project->directories)
+            childDirectories[parentPath(dir)].append(dir);
+        for (const ProjectFile& pf : project->files)
+            childFiles[parentPath(pf.relativePath)].append(pf.relativePath);
+        addNode(root, projectName, true);
+    }
+    endResetModel();
+}
+
+ProjectTreeModel::Node* ProjectTreeModel::addNode(Node* parent, const QString& path, bool isDirectory)
+{
+    Node* n = new Node();
+    n->name = path.mid(path.lastIndexOf('/')+1);
+    n->path = path;
+    n->isDirectory = isDirectory;
+    n->fetched = !isDirectory;
+    n->row = parent->children.size();
+    n->parent = parent;
+    parent->children.append(n);
+    nodes[path] = n;
+    return n;
+}
+
+ProjectTreeModel::Node* ProjectTreeModel::node(const QModelIndex& index) const
+{
+    return index.isValid() ? static_cast<Node*>(index.internalPointer()) : root;
+}
+
+QString ProjectTreeModel::filePath(const QModelIndex& index) const
+{
+    Node* n = node(index);
+    if (!n || n->isDirectory)
+        return QString();
+    // same as ProjectFile::fullPath, for directories and archives alike
+    return basePath + n->path.mid(projectName.length());
+}
+
+QModelIndex ProjectTreeModel::indexForPath(const QString& relativePath)
+{
+    Node* n = nodes.value(relativePath);
+    if (!n)
+    {
+        // the parent has to be fetched first
+        if (relativePath == projectName || !relativePath.startsWith(projectName + "/"))
+            return QModelIndex();
+        QModelIndex parentIndex = indexForPath(parentPath(relativePath));
+        if (!parentIndex.isValid())
+            return QModelIndex();
+        if (canFetchMore(parentIndex))
+            fetchMore(parentIndex);
+        n = nodes.value(relativePath);
+        if (!n)
+            return QModelIndex();
+    }
+    return createIndex(n->row, 0, n);
+}
+
+QStringList ProjectTreeModel::fetchedDirectories() const
+{
+    QStringList paths;
+    for (Node* n : nodes)
+    {
+        if (n->isDirectory && n->fetched)
+            paths.append(n->path);
+    }
+    return paths;
+}
+
+QModelIndex ProjectTreeModel::index(int row, int column, const QModelIndex& parent) const
+{
+    Node* p = node(parent);
+    if (!p || column != 0 || row < 0 || row >= p->children.size())
+        return QModelIndex();
+    return createIndex(row, 0, p->children[row]);
+}
+
+QModelIndex ProjectTreeModel::parent(const QModelIndex& child) const
+{
+    Node* n = node(child);
+    if (!child.isValid() || !n || n->parent == root)
+        return QModelIndex();
+    return createIndex(n->parent->row, 0, n->parent);
+}
+
+int ProjectTreeModel::rowCount(const QModelIndex& parent) const
+{
+    Node* p = node(parent);
+    return p ? p->children.size() : 0;
+}
+
+int ProjectTreeModel::columnCount(const QModelIndex& parent) const
+{
+    Q_UNUSED(parent);
+    return 1;
+}
+
+QVariant ProjectTreeModel::data(const QModelIndex& index, int role) const
+{
+    Node* n = node(index);
+    if (!index.isValid() || !n)
+        return QVariant();
+    // todo mark directories and file types
+    if (role == Qt::DisplayRole)
+        return n->name;
+    if (role == Qt::UserRole && !n->isDirectory)
+        return filePath(index);
+    return QVariant();
+}
+
+bool ProjectTreeModel::hasChildren(const QModelIndex& parent) const
+{
+    Node* n = node(parent);
+    if (!n || !n->isDirectory)
+        return false;
+    if (n->fetched)
+        return !n->children.isEmpty();
+    return childDirectories.contains(n->path) || childFiles.contains(n->path);
+}
+
+bool ProjectTreeModel::canFetchMore(const QModelIndex& parent) const
+{
+    Node* n = node(parent);
+    return n && !n->fetched;
+}
+
+void ProjectTreeModel::fetchMore(const QModelIndex& parent)
+{
+    Node* n = node(parent);
+    if (!n || n->fetched)
+        return;
+    n->fetched = true;
+    // directories first, then files. files added after the scan are not in order
+    QStringList dirs = childDirectories.value(n->path);
+    QStringList files = childFiles.value(n->path);
+    dirs.sort(Qt::CaseInsensitive);
+    files.sort(Qt::CaseInsensitive);
+    if (dirs.isEmpty() && files.isEmpty())
+        return;
+    beginInsertRows(parent, 0, dirs.size()+files.size()-1);
+    for (const QString& dir : dirs)
+        addNode(n, dir, true);
+    for (const QString& file : files)
+        addNode(n, file, false);
+    endInsertRows();
+}
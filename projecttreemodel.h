@@ -0,0 +1,71 @@
+#ifndef PROJECTTREEMODEL_H
+#define PROJECTTREEMODEL_H
+
+#include <QAbstractItemModel>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QHash>
+
+class Project;
+
+// Files and directories of a project, for the project tree.
+// The directory index (children of every directory, by project-relative path) is built in one pass over the project's
+// lists; rows are only created when a directory is expanded. Every row that exists is found by path in O(1).
+class ProjectTreeModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    explicit ProjectTreeModel(QObject* parent = nullptr);
+    ~ProjectTreeModel();
+
+    // rebuilds the index from the project's files and directories. nullptr clears the tree
+    void setProject(const Project* project);
+
+    // full path of the file at index, empty for directories
+    QString filePath(const QModelIndex& index) const;
+    // index of a project-relative path, directories on the way are fetched. invalid if there is no such path
+    QModelIndex indexForPath(const QString& relativePath);
+    // project-relative paths of the directories whose rows were fetched, i.e. that were expanded at some point
+    QStringList fetchedDirectories() const;
+
+    QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex& child) const override;
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    bool hasChildren(const QModelIndex& parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex& parent) const override;
+    void fetchMore(const QModelIndex& parent) override;
+
+private:
+    struct Node
+    {
+        QString name;
+        QString path; // project-relative
+        bool isDirectory;
+        bool fetched;
+        int row;
+        Node* parent;
+        QList<Node*> children;
+    };
+
+    // invisible; its only child is the project directory
+    Node* root;
+    QString basePath;
+    QString projectName;
+    // directory index: subdirectories and files of every directory that has any
+    QHash<QString, QStringList> childDirectories;
+    QHash<QString, QStringList> childFiles;
+    // every node that was created
+    QHash<QString, Node*> nodes;
+
+    Node* node(const QModelIndex& index) const;
+    Node* addNode(Node* parent, const QString& path, bool isDirectory);
+    void clear();
+    static void deleteNode(Node* node);
+    static QString parentPath(const QString& path);
+};
+
+#endif // PROJECTTREEMODEL_H
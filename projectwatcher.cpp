@@ -0,0 +1,76 @@
+#include "projectwatcher.h"
+#include "project.h"
+
+ProjectWatcher::ProjectWatcher(QObject* parent) : QObject(parent)
+{
+    watcher = new QFileSystemWatcher(this);
+    connect(watcher, SIGNAL(fileChanged(QString)), this, SLOT(onPathChanged(QString)));
+    connect(watcher, SIGNAL(directoryChanged(QString)), this, SLOT(onPathChanged(QString)));
+
+    quietTimer = new QTimer(this);
+    quietTimer->setSingleShot(true);
+    quietTimer->setInterval(300);
+    connect(quietTimer, SIGNAL(timeout()), this, SLOT(flush()));
+}
+
+void ProjectWatcher::watch(Project* project)
+{
+    QSet<QString> wanted;
+    if (project && project->archive)
+    {
+        // an archive is read again as a whole
+        wanted.insert(project->archive->path());
+    }
+    else if (project)
+    {
+        wanted.insert(project->basePath);
+        for (const QString& dir : project->directories)
+            wanted.insert(project->basePath + dir.mid(project->projectName.length()));
+        // contents only matter for the files that are part of the include closure
+        for (const ProjectFile& pf : project->files)
+        {
+            if (project->queries.hasFile(pf.fullPath))
+                wanted.insert(pf.fullPath);
+        }
+    }
+
+    QStringList watched = watcher->files() + watcher->directories();
+    QStringList unwanted;
+    for (const QString& path : watched)
+    {
+        if (!wanted.remove(path))
+            unwanted.append(path);
+    }
+    if (!unwanted.isEmpty())
+        watcher->removePaths(unwanted);
+    if (!wanted.isEmpty())
+        watcher->addPaths(wanted.toList());
+}
+
+void ProjectWatcher::clear()
+{
+    watch(nullptr);
+    quietTimer->stop();
+    pending.clear();
+}
+
+void ProjectWatcher::onPathChanged(const QString& path)
+{
+    if (pending.isEmpty())
+        burstTimer.start();
+    pending.insert(path);
+    if (burstTimer.elapsed() > 2000)
+        flush();
+    else quietTimer->start();
+}
+
+void ProjectWatcher::flush()
+{
+    quietTimer->stop();
+    if (pending.isEmpty())
+        return;
+    QStringList paths = pending.toList();
+    pending.clear();
+    qDebug("ProjectWatcher: %d changed paths", paths.size());
+    emit changed(paths);
+}
@@ -0,0 +1,46 @@
+#ifndef PROJECTWATCHER_H
+#define PROJECTWATCHER_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QSet>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
+
+class Project;
+
+// Watches the directories and parsed files of a project for changes made outside of the editor (checkouts, other tools).
+// Notifications come in bursts, a branch switch touches hundreds of files at once. They are collected until the
+// filesystem is quiet for a moment and then reported as one batch (see Project::applyChanges).
+class ProjectWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ProjectWatcher(QObject* parent = nullptr);
+
+    // replaces the watched paths with the ones of project. called again after every batch, since files come and go
+    // (and a file replaced by a rename is not watched anymore). the caller holds project->queries.mutex()
+    void watch(Project* project);
+    void clear();
+
+signals:
+    // full paths of changed files and directories
+    void changed(QStringList paths);
+
+private slots:
+    void onPathChanged(const QString& path);
+    void flush();
+
+private:
+    QFileSystemWatcher* watcher;
+    // restarted by every notification
+    QTimer* quietTimer;
+    // a burst that never goes quiet is still reported after a while
+    QElapsedTimer burstTimer;
+    QSet<QString> pending;
+};
+
+#endif // PROJECTWATCHER_H
@@ -0,0 +1,845 @@
+#include "queryengine.h"
+#include "project.h"
+#include "libraryindex.h"
+
+#include <QCryptographicHash>
+
+QueryEngine::QueryEngine()
+{
+    currentRevision = 1;
+    generation = 0;
+    recomputed = reused = 0;
+    cancelFlag = nullptr;
+    skipped = 0;
+}
+
+QueryEngine::~QueryEngine()
+{
+    for (FileState* state : files)
+    {
+        // parsers of project files belong to the project
+        if (state->parser)
+            state->parser->setListener(nullptr);
+        if (!state->projectFile)
+            Parser::retire(state->parser);
+        delete state;
+    }
+    qDeleteAll(querySlots);
+}
+
+void QueryEngine::setLibrary(QSharedPointer<const LibraryIndex> library, QSharedPointer<ZClassOverlay> classOverlay)
+{
+    this->library = library;
+    this->classOverlay = classOverlay;
+    changeInput(Key(FileSet));
+}
+
+QueryEngine::Slot* QueryEngine::slot(const Key& key)
+{
+    Slot*& s = querySlots[key];
+    if (!s)
+    {
+        s = new Slot();
+        s->changedAt = 0;
+        s->verifiedAt = 0;
+        s->computed = false;
+        s->interrupted = false;
+    }
+    return s;
+}
+
+void QueryEngine::changeInput(const Key& key)
+{
+    currentRevision++;
+    Slot* s = slot(key);
+    s->changedAt = currentRevision;
+    s->verifiedAt = currentRevision;
+    s->computed = true;
+}
+
+QByteArray QueryEngine::nextGeneration()
+{
+    generation++;
+    return QByteArray::number(generation);
+}
+
+void QueryEngine::adoptFile(ProjectFile* pf)
+{
+    if (!pf->parser || !pf->parser->root)
+        return;
+    removeFile(pf->fullPath);
+
+    FileState* state = new FileState();
+    state->text = pf->source ? pf->source->text() : QString();
+    state->textVersion = 1;
+    state->tokensVersion = 0;
+    state->editCount = 0;
+    state->projectFile = pf;
+    state->parser = pf->parser;
+    state->parser->setListener(this);
+    // the project ran the field and method passes on every type already
+    for (QSharedPointer<ZTreeNode> type : state->parser->getOwnTypeInformation())
+        state->fieldsParsed.insert(type.data());
+    files.insert(pf->fullPath, state);
+
+    changeInput(Key(FileSet));
+    changeInput(Key(FileText, pf->fullPath));
+    // the parser is a computed value as of now
+    Slot* tokensSlot = slot(Key(Tokens, pf->fullPath));
+    tokensSlot->computed = true;
+    tokensSlot->fingerprint = QByteArray::number(state->textVersion);
+    tokensSlot->dependencies = QList<Key>() << Key(FileText, pf->fullPath);
+    tokensSlot->changedAt = tokensSlot->verifiedAt = currentRevision;
+    Slot* declarationsSlot = slot(Key(Declarations, pf->fullPath));
+    declarationsSlot->computed = true;
+    declarationsSlot->fingerprint = nextGeneration();
+    declarationsSlot->dependencies = QList<Key>() << Key(Tokens, pf->fullPath);
+    declarationsSlot->changedAt = declarationsSlot->verifiedAt = currentRevision;
+}
+
+void QueryEngine::adoptClassGraph()
+{
+    allTypes = library ? library->types() : QList<QSharedPointer<ZTreeNode>>();
+    Slot* s = slot(Key(ClassGraph));
+    s->dependencies = QList<Key>() << Key(FileSet);
+    for (QHash<QString, FileState*>::const_iterator it = files.constBegin(); it != files.constEnd(); ++it)
+    {
+        s->dependencies.append(Key(Declarations, it.key()));
+        allTypes.append(it.value()->parser->getOwnTypeInformation());
+    }
+    s->fingerprint = classGraphFingerprint();
+    s->computed = true;
+    s->changedAt = s->verifiedAt = currentRevision;
+}
+
+void QueryEngine::addFile(ProjectFile* pf)
+{
+    removeFile(pf->fullPath);
+
+    FileState* state = new FileState();
+    state->text = pf->source ? pf->source->text() : QString();
+    state->textVersion = 1;
+    state->tokensVersion = 0;
+    state->editCount = -1;
+    state->projectFile = pf;
+    state->parser = nullptr;
+    files.insert(pf->fullPath, state);
+
+    changeInput(Key(FileSet));
+    changeInput(Key(FileText, pf->fullPath));
+}
+
+void QueryEngine::setFileText(const QString& file, const QString& text, const TextEdit* edit)
+{
+    FileState* state = files.value(file);
+    if (!state)
+    {
+        state = new FileState();
+        state->textVersion = 0;
+        state->tokensVersion = -1;
+        state->editCount = -1;
+        state->projectFile = nullptr;
+        state->parser = nullptr;
+        files.insert(file, state);
+        changeInput(Key(FileSet));
+    }
+    else if (state->text == text)
+    {
+        return;
+    }
+
+    state->text = text;
+    state->textVersion++;
+    // the cache entry describes the contents the project was loaded with
+    if (state->projectFile)
+        state->projectFile->cacheEntry.reset();
+    if (edit && state->editCount == 0)
+    {
+        state->editCount = 1;
+        state->edit = *edit;
+    }
+    else if (edit && state->editCount == 1)
+    {
+        // not parsed since the previous edit (i.e. that analysis was cancelled)
+        state->edit = mergeEdits(state->edit, *edit);
+    }
+    else state->editCount = -1;
+    changeInput(Key(FileText, file));
+}
+
+QueryEngine::TextEdit QueryEngine::mergeEdits(const TextEdit& first, const TextEdit& second)
+{
+    // union of both changed ranges. second is in the coordinates of the text after first, the result in those
+    // of the text before first: the end of the union moves back by what first added (see zzcheck --selftest)
+    int start = qMin(first.position, second.position);
+    int end = qMax(first.position + first.charsAdded, second.position + second.charsRemoved);
+    TextEdit merged;
+    merged.position = start;
+    merged.charsRemoved = end - (first.charsAdded - first.charsRemoved) - start;
+    merged.charsAdded = end + (second.charsAdded - second.charsRemoved) - start;
+    return merged;
+}
+
+void QueryEngine::removeFile(const QString& file)
+{
+    FileState* state = files.take(file);
+    if (!state)
+        return;
+    if (state->parser)
+        state->parser->setListener(nullptr);
+    if (!state->projectFile)
+        Parser::retire(state->parser);
+    delete state;
+    changeInput(Key(FileSet));
+    changeInput(Key(FileText, file));
+}
+
+void QueryEngine::require(const Key& key)
+{
+    if (!active.isEmpty() && !active.last()->dependencies.contains(key))
+        active.last()->dependencies.append(key);
+    update(key);
+}
+
+void QueryEngine::update(const Key& key)
+{
+    Slot* s = slot(key);
+    if (s->verifiedAt == currentRevision)
+        return;
+
+    if (key.kind == FileText || key.kind == FileSet || key.kind == BodySource)
+    {
+        // inputs only change through changeInput
+        s->verifiedAt = currentRevision;
+        return;
+    }
+    // not verified: whoever asked gets the previous result, and will be asked again without the flag.
+    // tokens are cheap and are needed as they are by the parser
+    if (key.kind != Tokens && isCancelled())
+    {
+        skipped++;
+        return;
+    }
+
+    // green if nothing this query read has changed since it was last verified
+    bool stale = !s->computed || s->interrupted;
+    if (!stale)
+    {
+        int skippedBefore = skipped;
+        QList<Key> dependencies = s->dependencies;
+        for (const Key& dependency : dependencies)
+        {
+            update(dependency);
+            if (slot(dependency)->changedAt > s->verifiedAt)
+            {
+                stale = true;
+                break;
+            }
+        }
+        if (skipped != skippedBefore)
+            return;
+    }
+
+    if (!stale)
+    {
+        s->verifiedAt = currentRevision;
+        reused++;
+        return;
+    }
+
+    s->dependencies.clear();
+    active.append(s);
+    int skippedBefore = skipped;
+    QByteArray fingerprint = compute(key, s);
+    active.removeLast();
+    if (skipped != skippedBefore)
+    {
+        // the result can be incomplete: dependents are told it changed, and it's computed again on the next update
+        s->fingerprint = fingerprint;
+        s->interrupted = true;
+        s->computed = true;
+        s->changedAt = currentRevision;
+        return;
+    }
+    // early cutoff: same result as before means nothing downstream has to be recomputed
+    if (!s->computed || fingerprint != s->fingerprint)
+        s->changedAt = currentRevision;
+    s->fingerprint = fingerprint;
+    s->verifiedAt = currentRevision;
+    s->computed = true;
+    s->interrupted = false;
+    recomputed++;
+}
+
+bool QueryEngine::stopRequested()
+{
+    if (!isCancelled())
+        return false;
+    skipped++;
+    return true;
+}
+
+QByteArray QueryEngine::compute(const Key& key, Slot* slot)
+{
+    switch (key.kind)
+    {
+    case Tokens:
+    {
+        // lexed on demand, see fileTokens
+        require(Key(FileText, key.file));
+        FileState* state = files.value(key.file);
+        return state ? QByteArray::number(state->textVersion) : QByteArray();
+    }
+    case Declarations:
+        return computeDeclarations(key, slot);
+    case ClassGraph:
+        return computeClassGraph();
+    case Members:
+        return computeMembers(key);
+    case Body:
+        return computeBody(key);
+    case SemanticTokens:
+        return computeSemanticTokens(key);
+    default:
+        return QByteArray();
+    }
+}
+
+const QList<Tokenizer::Token>& QueryEngine::fileTokens(FileState* state)
+{
+    if (state->tokensVersion != state->textVersion)
+    {
+        Tokenizer tok(state->text);
+        state->tokens = tok.readAllTokens();
+        state->tokensVersion = state->textVersion;
+    }
+    return state->tokens;
+}
+
+void QueryEngine::setParser(FileState* state, Parser* parser)
+{
+    if (state->parser)
+        state->parser->setListener(nullptr);
+    if (state->projectFile)
+    {
+        Parser::retire(state->projectFile->parser);
+        state->projectFile->parser = parser;
+    }
+    else Parser::retire(state->parser);
+    state->parser = parser;
+    state->fieldsParsed.clear();
+}
+
+QByteArray QueryEngine::computeDeclarations(const Key& key, Slot* slot)
+{
+    require(Key(Tokens, key.file));
+    FileState* state = files.value(key.file);
+    if (!state)
+        return QByteArray();
+
+    // an edit inside one method body: the parser stays, only that body is invalidated
+    bool single = (state->editCount == 1);
+    state->editCount = 0;
+    if (slot->computed && single && state->parser && state->parser->root)
+    {
+        const TextEdit& edit = state->edit;
+        QSharedPointer<ZMethod> method = state->parser->findMethodBody(edit.position, edit.position+edit.charsRemoved);
+        int delta = edit.charsAdded - edit.charsRemoved;
+        // the lexical tokens of the file are left as they are: only a full reparse needs them, and lexes them again
+        if (method && state->parser->prepareMethodBodyEdit(method, state->text, delta))
+        {
+            changeInput(Key(BodySource, key.file, methodKey(method)));
+            return slot->fingerprint;
+        }
+    }
+
+    Parser* parser = new Parser(fileTokens(state));
+    parser->setClassOverlay(classOverlay);
+    parser->setLazyMethodBodies(true);
+    parser->setListener(this);
+    parser->parse();
+    if (parser->root)
+    {
+        parser->root->fullPath = key.file;
+        parser->root->relativePath = state->projectFile ? state->projectFile->relativePath : key.file;
+    }
+    setParser(state, parser);
+    // the nodes are new, everything that points to them has to be redone
+    return nextGeneration();
+}
+
+// true if the class belongs to a parser that was replaced since. Parser::retire clears the parent of its top-level
+// types, the node itself can live on until the reclaim thread gets to it
+static bool isDetached(QSharedPointer<ZClass> cls)
+{
+    return cls && !cls->parent;
+}
+
+static void pruneDetached(QList<QWeakPointer<ZClass>>& edges)
+{
+    for (int i = 0; i < edges.size(); i++)
+    {
+        QSharedPointer<ZClass> cls = edges[i].toStrongRef();
+        if (!cls || isDetached(cls))
+        {
+            edges.removeAt(i);
+            i--;
+        }
+    }
+}
+
+QByteArray QueryEngine::computeClassGraph()
+{
+    require(Key(FileSet));
+    allTypes = library ? library->types() : QList<QSharedPointer<ZTreeNode>>();
+    QList<FileState*> linked;
+    for (QHash<QString, FileState*>::const_iterator it = files.constBegin(); it != files.constEnd(); ++it)
+    {
+        require(Key(Declarations, it.key()));
+        FileState* state = it.value();
+        if (!state->parser || !state->parser->root)
+            continue;
+        allTypes.append(state->parser->getOwnTypeInformation());
+        linked.append(state);
+    }
+    if (stopRequested())
+        return QByteArray();
+
+    // references into replaced parsers are dropped, so that setTypeInformation resolves them again
+    for (QSharedPointer<ZTreeNode> type : allTypes)
+    {
+        if (type->type() != ZTreeNode::Class || (classOverlay && classOverlay->isFrozen(type.data())))
+            continue;
+        QSharedPointer<ZClass> cls = type.dynamicCast<ZClass>();
+        if (isDetached(cls->parentReference.toStrongRef()))
+            cls->parentReference.clear();
+        if (isDetached(cls->extendReference.toStrongRef()))
+            cls->extendReference.clear();
+        if (isDetached(cls->replaceReference.toStrongRef()))
+            cls->replaceReference.clear();
+        pruneDetached(cls->extensions);
+        pruneDetached(cls->childrenReferences);
+        pruneDetached(cls->replacedByReferences);
+    }
+    if (classOverlay)
+    {
+        for (ZClassOverlay::Edges& edges : classOverlay->edges)
+        {
+            pruneDetached(edges.extensions);
+            pruneDetached(edges.childrenReferences);
+            pruneDetached(edges.replacedByReferences);
+        }
+    }
+
+    // member types can point into replaced parsers as well; members(type) sees the result through hashMembers
+    for (FileState* state : linked)
+    {
+        state->parser->setClassOverlay(classOverlay);
+        state->parser->setTypeInformation(allTypes);
+        state->parser->relinkMemberTypes();
+    }
+
+    return classGraphFingerprint();
+}
+
+QByteArray QueryEngine::classGraphFingerprint() const
+{
+    // the graph is the same if the same classes have the same relations, regardless of the nodes
+    QStringList relations;
+    for (QSharedPointer<ZTreeNode> type : allTypes)
+    {
+        if (classOverlay && classOverlay->isFrozen(type.data()))
+            continue;
+        QString relation = QString::number(int(type->type())) + "|" + type->identifier.toLower();
+        if (type->type() == ZTreeNode::Class)
+        {
+            QSharedPointer<ZClass> cls = type.dynamicCast<ZClass>();
+            relation += "|" + cls->parentName.toLower() + "|" + cls->extendName.toLower() + "|" + cls->replaceName.toLower();
+        }
+        relations.append(relation);
+    }
+    relations.sort();
+    return QCryptographicHash::hash(relations.join('\n').toUtf8(), QCryptographicHash::Sha1);
+}
+
+static void hashCompoundType(QCryptographicHash& hash, const ZCompoundType& type)
+{
+    hash.addData(type.type.toLower().toUtf8());
+    hash.addData("<", 1);
+    for (const ZCompoundType& argument : type.arguments)
+        hashCompoundType(hash, argument);
+    hash.addData(">", 1);
+    hash.addData(QByteArray::number(type.arrayDimensions.size()));
+    // a type that became resolved (or stopped being) changes what member lookups through it find
+    hash.addData(type.reference ? "+" : "-", 1);
+}
+
+// declarations of a type: everything that other code can see, but no method bodies
+static void hashMembers(QCryptographicHash& hash, QSharedPointer<ZTreeNode> node)
+{
+    for (QSharedPointer<ZTreeNode> child : node->children)
+    {
+        hash.addData(QByteArray::number(int(child->type())));
+        hash.addData(child->identifier.toLower().toUtf8());
+        switch (child->type())
+        {
+        case ZTreeNode::Field:
+        {
+            QSharedPointer<ZField> field = child.dynamicCast<ZField>();
+            hashCompoundType(hash, field->fieldType);
+            hash.addData(field->flags.join(' ').toUtf8());
+            break;
+        }
+        case ZTreeNode::Method:
+        {
+            QSharedPointer<ZMethod> method = child.dynamicCast<ZMethod>();
+            for (const ZCompoundType& type : method->returnTypes)
+                hashCompoundType(hash, type);
+            for (QSharedPointer<ZLocalVariable> argument : method->arguments)
+            {
+                hash.addData(argument->identifier.toLower().toUtf8());
+                hashCompoundType(hash, argument->varType);
+            }
+            hash.addData(method->flags.join(' ').toUtf8());
+            hash.addData(method->hasEllipsis ? "..." : "", method->hasEllipsis ? 3 : 0);
+            break;
+        }
+        case ZTreeNode::Property:
+            hash.addData(child.dynamicCast<ZProperty>()->fields.join(' ').toUtf8());
+            break;
+        case ZTreeNode::Class:
+        case ZTreeNode::Struct:
+        case ZTreeNode::Enum:
+            hashMembers(hash, child);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+QByteArray QueryEngine::computeMembers(const Key& key)
+{
+    require(Key(Declarations, key.file));
+    require(Key(ClassGraph));
+    FileState* state = files.value(key.file);
+    if (!state || !state->parser || !state->parser->root)
+        return QByteArray();
+    QSharedPointer<ZTreeNode> type = findType(state->parser, key.name);
+    if (!type || stopRequested())
+        return QByteArray();
+
+    // the field pass runs once per parser. after that, only the class references and member types can change,
+    // and those are resolved again by classGraph
+    if (!state->fieldsParsed.contains(type.data()))
+    {
+        state->fieldsParsed.insert(type.data());
+        if (type->type() == ZTreeNode::Class)
+        {
+            state->parser->parseClassFields(type.dynamicCast<ZClass>());
+            state->parser->parseClassMethods(type.dynamicCast<ZClass>());
+        }
+        else if (type->type() == ZTreeNode::Struct)
+        {
+            state->parser->parseStructFields(type.dynamicCast<ZStruct>());
+            state->parser->parseStructMethods(type.dynamicCast<ZStruct>());
+        }
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    if (type->type() == ZTreeNode::Class)
+    {
+        QSharedPointer<ZClass> cls = type.dynamicCast<ZClass>();
+        hash.addData((cls->parentName + "|" + cls->extendName + "|" + cls->replaceName).toLower().toUtf8());
+    }
+    hashMembers(hash, type);
+    return hash.result();
+}
+
+QByteArray QueryEngine::computeBody(const Key& key)
+{
+    require(Key(Declarations, key.file));
+    require(Key(BodySource, key.file, key.name));
+    require(Key(ClassGraph));
+    // the method itself is created by the field pass of its type
+    require(Key(Members, key.file, key.name.section('.', 0, 0)));
+    FileState* state = files.value(key.file);
+    if (!state || !state->parser || !state->parser->root)
+        return QByteArray();
+    QSharedPointer<ZMethod> method = findMethod(state->parser, key.name);
+    if (!method || method->bodyStart < 0 || stopRequested())
+        return QByteArray();
+
+    // types looked into while parsing are recorded through membersUsed. a body that was parsed before the engine
+    // took over (at load) recorded nothing, so it is parsed again as well
+    if (state->parser->isMethodBodyPending(method))
+        state->parser->ensureMethodBody(method);
+    else
+        state->parser->reparseMethodBody(method, state->text);
+    return nextGeneration();
+}
+
+static void collectMethods(QSharedPointer<ZTreeNode> node, QList<QSharedPointer<ZMethod>>& out)
+{
+    for (QSharedPointer<ZTreeNode> child : node->children)
+    {
+        if (child->type() == ZTreeNode::Method)
+            out.append(child.dynamicCast<ZMethod>());
+        else if (child->type() == ZTreeNode::Class || child->type() == ZTreeNode::Struct)
+            collectMethods(child, out);
+    }
+}
+
+QByteArray QueryEngine::computeSemanticTokens(const Key& key)
+{
+    require(Key(Declarations, key.file));
+    require(Key(ClassGraph));
+    FileState* state = files.value(key.file);
+    if (!state || !state->parser || !state->parser->root)
+        return QByteArray();
+
+    QList<QSharedPointer<ZMethod>> methods;
+    for (QSharedPointer<ZTreeNode> type : state->parser->getOwnTypeInformation())
+    {
+        if (type->type() != ZTreeNode::Class && type->type() != ZTreeNode::Struct)
+            continue;
+        require(Key(Members, key.file, typeKey(type)));
+        collectMethods(type, methods);
+    }
+    for (QSharedPointer<ZMethod> method : methods)
+    {
+        if (method->bodyStart >= 0)
+            require(Key(Body, key.file, methodKey(method)));
+    }
+    return nextGeneration();
+}
+
+void QueryEngine::membersUsed(QSharedPointer<ZTreeNode> type)
+{
+    // only dependencies of a query that is being computed are interesting
+    if (active.isEmpty())
+        return;
+    if (classOverlay && classOverlay->isFrozen(type.data()))
+        return; // library types never change
+    QSharedPointer<ZTreeNode> top = topLevelType(type);
+    if (!top || (classOverlay && classOverlay->isFrozen(top.data())))
+        return;
+    QString file = nodeFile(top);
+    if (!files.contains(file))
+        return;
+    require(Key(Members, file, typeKey(top)));
+}
+
+QList<Tokenizer::Token> QueryEngine::tokens(const QString& file)
+{
+    update(Key(Tokens, file));
+    FileState* state = files.value(file);
+    if (!state)
+        return QList<Tokenizer::Token>();
+    return fileTokens(state);
+}
+
+Parser* QueryEngine::declarations(const QString& file)
+{
+    update(Key(Declarations, file));
+    return parser(file);
+}
+
+QList<QSharedPointer<ZTreeNode>> QueryEngine::classGraph()
+{
+    update(Key(ClassGraph));
+    return allTypes;
+}
+
+QList<QSharedPointer<ZTreeNode>> QueryEngine::members(QSharedPointer<ZTreeNode> type)
+{
+    QSharedPointer<ZTreeNode> top = topLevelType(type);
+    if (!top)
+        return QList<QSharedPointer<ZTreeNode>>();
+    update(Key(Members, nodeFile(top), typeKey(top)));
+    return type->children;
+}
+
+bool QueryEngine::updateDeclarations(const QString& file, QSet<QString>* dependents)
+{
+    // a slot changed in this update if its changedAt moved
+    Slot* graph = slot(Key(ClassGraph));
+    quint64 graphChangedAt = graph->changedAt;
+    update(Key(ClassGraph));
+    bool graphChanged = (graph->changedAt != graphChangedAt);
+    bool changed = graphChanged;
+
+    QSet<Key> changedMembers;
+    Parser* p = parser(file);
+    if (p && p->root)
+    {
+        for (QSharedPointer<ZTreeNode> type : p->getOwnTypeInformation())
+        {
+            Key key(Members, file, typeKey(type));
+            Slot* s = slot(key);
+            bool computed = s->computed;
+            quint64 changedAt = s->changedAt;
+            update(key);
+            if (!computed || s->changedAt != changedAt)
+            {
+                changed = true;
+                changedMembers.insert(key);
+            }
+        }
+    }
+    if (!changed || !dependents)
+        return changed;
+
+    // every body reads the class graph. otherwise only the queries that recorded one of the changed members
+    if (graphChanged)
+    {
+        for (const QString& other : files.keys())
+        {
+            if (other != file)
+                dependents->insert(other);
+        }
+        return changed;
+    }
+    for (QHash<Key, Slot*>::const_iterator it = querySlots.constBegin(); it != querySlots.constEnd(); ++it)
+    {
+        const Key& key = it.key();
+        if (key.file.isEmpty() || key.file == file || dependents->contains(key.file))
+            continue;
+        for (const Key& dependency : it.value()->dependencies)
+        {
+            if (changedMembers.contains(dependency))
+            {
+                dependents->insert(key.file);
+                break;
+            }
+        }
+    }
+    return changed;
+}
+
+QSharedPointer<ZTreeNode> QueryEngine::body(QSharedPointer<ZMethod> method)
+{
+    QString file = nodeFile(method);
+    update(Key(Body, file, methodKey(method)));
+    // the method node can be replaced by the update, look it up again
+    Parser* p = parser(file);
+    QSharedPointer<ZMethod> current = p ? findMethod(p, methodKey(method)) : QSharedPointer<ZMethod>();
+    if (!current || current->children.isEmpty())
+        return nullptr;
+    return current->children.first();
+}
+
+QVector<ParserToken> QueryEngine::semanticTokens(const QString& file)
+{
+    update(Key(SemanticTokens, file));
+    Parser* p = parser(file);
+    if (!p)
+        return QVector<ParserToken>();
+    return p->sortedParsedTokens();
+}
+
+Parser* QueryEngine::parser(const QString& file) const
+{
+    FileState* state = files.value(file);
+    return state ? state->parser : nullptr;
+}
+
+ProjectFile* QueryEngine::projectFile(const QString& file) const
+{
+    FileState* state = files.value(file);
+    return state ? state->projectFile : nullptr;
+}
+
+QSharedPointer<ZTreeNode> QueryEngine::topLevelType(QSharedPointer<ZTreeNode> node)
+{
+    while (node)
+    {
+        QSharedPointer<ZTreeNode> parent = node->parent.toStrongRef();
+        if (!parent)
+            return nullptr;
+        if (parent->type() == ZTreeNode::FileRoot)
+            return node;
+        node = parent;
+    }
+    return nullptr;
+}
+
+QString QueryEngine::nodeFile(QSharedPointer<ZTreeNode> node)
+{
+    QSharedPointer<ZTreeNode> top = topLevelType(node);
+    if (!top)
+        return QString();
+    QSharedPointer<ZFileRoot> root = top->parent.toStrongRef().dynamicCast<ZFileRoot>();
+    return root ? root->fullPath : QString();
+}
+
+QString QueryEngine::typeKey(QSharedPointer<ZTreeNode> type)
+{
+    QSharedPointer<ZTreeNode> root = type->parent.toStrongRef();
+    int index = 0;
+    if (root)
+    {
+        for (QSharedPointer<ZTreeNode> node : root->children)
+        {
+            if (node == type)
+                break;
+            if (!node->identifier.compare(type->identifier, Qt::CaseInsensitive))
+                index++;
+        }
+    }
+    return type->identifier.toLower() + "#" + QString::number(index);
+}
+
+QString QueryEngine::methodKey(QSharedPointer<ZMethod> method)
+{
+    // <type key>.<nested struct>...<method>
+    QString path = method->identifier.toLower();
+    QSharedPointer<ZTreeNode> node = method->parent.toStrongRef();
+    while (node)
+    {
+        QSharedPointer<ZTreeNode> parent = node->parent.toStrongRef();
+        if (!parent || parent->type() == ZTreeNode::FileRoot)
+            return typeKey(node) + "." + path;
+        path = node->identifier.toLower() + "." + path;
+        node = parent;
+    }
+    return path;
+}
+
+QSharedPointer<ZTreeNode> QueryEngine::findType(Parser* parser, const QString& key)
+{
+    QString name = key.section('#', 0, 0);
+    int index = key.section('#', 1).toInt();
+    for (QSharedPointer<ZTreeNode> node : parser->root->children)
+    {
+        if (node->identifier.compare(name, Qt::CaseInsensitive))
+            continue;
+        if (!index)
+            return node;
+        index--;
+    }
+    return nullptr;
+}
+
+QSharedPointer<ZMethod> QueryEngine::findMethod(Parser* parser, const QString& key)
+{
+    QStringList parts = key.split('.');
+    QSharedPointer<ZTreeNode> node = findType(parser, parts.takeFirst());
+    while (node && !parts.isEmpty())
+    {
+        QString part = parts.takeFirst();
+        QSharedPointer<ZTreeNode> next;
+        for (QSharedPointer<ZTreeNode> child : node->children)
+        {
+            bool isLast = parts.isEmpty();
+            bool matches = isLast ? (child->type() == ZTreeNode::Method) : (child->type() == ZTreeNode::Struct || child->type() == ZTreeNode::Class);
+            if (matches && !child->identifier.compare(part, Qt::CaseInsensitive))
+            {
+                next = child;
+                break;
+            }
+        }
+        node = next;
+    }
+    return node ? node.dynamicCast<ZMethod>() : QSharedPointer<ZMethod>();
+}
@@ -0,0 +1,199 @@
+#ifndef QUERYENGINE_H
+#define QUERYENGINE_H
+
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QSet>
+#include <QByteArray>
+#include <QSharedPointer>
+#include <QMutex>
+#include <QAtomicInt>
+#include "tokenizer.h"
+#include "parser.h"
+
+struct ProjectFile;
+class LibraryIndex;
+
+// Memoized analysis queries over the files of a project.
+// Every query result is kept together with the revision at which it last changed and the queries it read while computing.
+// When an input changes, a query is recomputed only if one of its dependencies changed since it was last verified;
+// a recomputed query that comes out with the same fingerprint as before does not invalidate anything that depends on it
+// (early cutoff). I.e. an edit that doesn't change the member declarations of a class doesn't reparse any other file.
+//
+// Queries:
+//   tokens(file)         lexical tokens
+//   declarations(file)   parser after the root pass. a new parser is a new value, except for edits inside one method body,
+//                        which are applied to the existing parser (see Parser::prepareMethodBodyEdit)
+//   classGraph()         all types, with class references resolved
+//   members(type)        fields, method signatures and constants of a top-level type. fingerprint is the declarations only
+//   body(method)         parsed method body. depends on the members of every type it looked into
+//   semanticTokens(file) all semantic tokens of a file, every body parsed
+//
+// Parser objects stay the values; the engine only decides which passes to run again.
+//
+// The engine is not thread-safe. Whoever queries it, or reads its parsers, holds mutex() while doing so;
+// background analysis runs with a cancel flag and stops between queries once the flag is set.
+class QueryEngine : public ParserListener
+{
+public:
+    enum QueryKind
+    {
+        // inputs
+        FileText,
+        FileSet,
+        BodySource, // changed when an edit was applied to a method body in place
+        // derived
+        Tokens,
+        Declarations,
+        ClassGraph,
+        Members,
+        Body,
+        SemanticTokens
+    };
+
+    struct Key
+    {
+        QueryKind kind;
+        QString file;
+        QString name;
+
+        Key(QueryKind kind = FileSet, const QString& file = QString(), const QString& name = QString()) : kind(kind), file(file), name(name) {}
+        bool operator==(const Key& other) const { return kind == other.kind && file == other.file && name == other.name; }
+    };
+
+    struct TextEdit
+    {
+        int position;
+        int charsRemoved;
+        int charsAdded;
+    };
+
+    QueryEngine();
+    ~QueryEngine();
+    Q_DISABLE_COPY(QueryEngine)
+
+    void setLibrary(QSharedPointer<const LibraryIndex> library, QSharedPointer<ZClassOverlay> classOverlay);
+    // file already parsed by Project. the parser stays owned by the ProjectFile; when it has to be replaced, pf->parser is updated
+    void adoptFile(ProjectFile* pf);
+    // after all files are adopted: the class references were resolved by Project as well
+    void adoptClassGraph();
+    // file that joined the project after it was parsed (i.e. a new include). it is parsed on the first query,
+    // the parser then goes to pf->parser
+    void addFile(ProjectFile* pf);
+    // new contents of a file. edit, if known, is the only change since the previous text; it allows reparsing one method body
+    void setFileText(const QString& file, const QString& text, const TextEdit* edit = nullptr);
+    // single edit that has the same effect as first followed by second, in the coordinates of the text before first
+    static TextEdit mergeEdits(const TextEdit& first, const TextEdit& second);
+    void removeFile(const QString& file);
+    bool hasFile(const QString& file) const { return files.contains(file); }
+    // text of the file as of the last setFileText (or adoptFile)
+    QString fileText(const QString& file) const { FileState* state = files.value(file); return state ? state->text : QString(); }
+
+    QList<Tokenizer::Token> tokens(const QString& file);
+    Parser* declarations(const QString& file);
+    QList<QSharedPointer<ZTreeNode>> classGraph();
+    QList<QSharedPointer<ZTreeNode>> members(QSharedPointer<ZTreeNode> type);
+    QSharedPointer<ZTreeNode> body(QSharedPointer<ZMethod> method);
+    QVector<ParserToken> semanticTokens(const QString& file);
+    // brings the declarations of file up to date and nothing else: one file is parsed again (or one body, see
+    // declarations). returns true if what other files see of it changed, the class graph or the members of its types.
+    // dependents, if given, receives the other files whose analysis read what changed
+    bool updateDeclarations(const QString& file, QSet<QString>* dependents = nullptr);
+    // parser of the file as of the last query, without recomputing anything. valid until the next query
+    Parser* parser(const QString& file) const;
+    // nullptr if the file was not adopted from a project
+    ProjectFile* projectFile(const QString& file) const;
+
+    QMutex* mutex() { return &lock; }
+    // while set, queries stop at the next query that is not up to date and keep their previous results.
+    // nothing is left half-computed: the next query without the flag picks up from there
+    void setCancelFlag(const QAtomicInt* flag) { cancelFlag = flag; }
+    bool isCancelled() const { return cancelFlag && cancelFlag->loadAcquire(); }
+
+    quint64 revision() const { return currentRevision; }
+    // number of queries recomputed and reused since the last resetStatistics
+    int recomputedCount() const { return recomputed; }
+    int reusedCount() const { return reused; }
+    void resetStatistics() { recomputed = reused = 0; }
+
+    // ParserListener
+    void membersUsed(QSharedPointer<ZTreeNode> type) override;
+
+private:
+    struct FileState
+    {
+        QString text;
+        int textVersion;
+        // tokens are lexed on demand; tokensVersion is the textVersion they were lexed from
+        QList<Tokenizer::Token> tokens;
+        int tokensVersion;
+        // 1 if edit is the only change since the last declarations query (edits are merged), -1 if unknown
+        int editCount;
+        TextEdit edit;
+        ProjectFile* projectFile;
+        Parser* parser;
+        // top-level types whose field and method passes have run on this parser
+        QSet<const ZTreeNode*> fieldsParsed;
+    };
+
+    struct Slot
+    {
+        QByteArray fingerprint;
+        quint64 changedAt;
+        quint64 verifiedAt;
+        bool computed;
+        // a dependency was skipped by cancellation while computing; the result is computed again on the next update
+        bool interrupted;
+        QList<Key> dependencies;
+    };
+
+    QSharedPointer<const LibraryIndex> library;
+    QSharedPointer<ZClassOverlay> classOverlay;
+    QMutex lock;
+    const QAtomicInt* cancelFlag;
+    QHash<QString, FileState*> files;
+    QHash<Key, Slot*> querySlots;
+    QList<Slot*> active;
+    QList<QSharedPointer<ZTreeNode>> allTypes;
+    quint64 currentRevision;
+    quint64 generation;
+    int skipped;
+    int recomputed;
+    int reused;
+
+    Slot* slot(const Key& key);
+    void changeInput(const Key& key);
+    // records key as a dependency of the query being computed, then brings it up to date
+    void require(const Key& key);
+    void update(const Key& key);
+    QByteArray compute(const Key& key, Slot* slot);
+    QByteArray nextGeneration();
+    // true if cancelled; the query being computed is then marked as interrupted
+    bool stopRequested();
+
+    QByteArray computeDeclarations(const Key& key, Slot* slot);
+    QByteArray computeClassGraph();
+    QByteArray classGraphFingerprint() const;
+    QByteArray computeMembers(const Key& key);
+    QByteArray computeBody(const Key& key);
+    QByteArray computeSemanticTokens(const Key& key);
+
+    void setParser(FileState* state, Parser* parser);
+    const QList<Tokenizer::Token>& fileTokens(FileState* state);
+
+    // top-level types are keyed by name and position among the types of the same name, i.e. "actor#0"
+    static QString typeKey(QSharedPointer<ZTreeNode> type);
+    static QString methodKey(QSharedPointer<ZMethod> method);
+    static QSharedPointer<ZTreeNode> topLevelType(QSharedPointer<ZTreeNode> node);
+    static QSharedPointer<ZTreeNode> findType(Parser* parser, const QString& key);
+    static QSharedPointer<ZMethod> findMethod(Parser* parser, const QString& key);
+    static QString nodeFile(QSharedPointer<ZTreeNode> node);
+};
+
+inline uint qHash(const QueryEngine::Key& key, uint seed = 0)
+{
+    return qHash(key.file, seed) ^ qHash(key.name, seed) ^ uint(key.kind);
+}
+
+#endif // QUERYENGINE_H
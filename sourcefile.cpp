@@ -0,0 +1,176 @@
+#include "sourcefile.h"
+
+#include <QFileInfo>
+#include <QMutexLocker>
+
+SourceFile::SourceFile()
+{
+    mapped = nullptr;
+    mappedSize = 0;
+    decoded = false;
+    edited = false;
+}
+
+SourceFile::~SourceFile()
+{
+    unmap();
+}
+
+QSharedPointer<SourceFile> SourceFile::open(QString fullPath)
+{
+    QFileInfo fi(fullPath);
+    if (!fi.isFile())
+        return nullptr;
+
+    QSharedPointer<SourceFile> source = QSharedPointer<SourceFile>(new SourceFile());
+    source->path = fullPath;
+    source->file.setFileName(fullPath);
+    if (!source->file.open(QIODevice::ReadOnly))
+        return nullptr;
+
+    source->mappedSize = source->file.size();
+    if (source->mappedSize > 0)
+    {
+        source->mapped = source->file.map(0, source->mappedSize);
+        if (!source->mapped)
+        {
+            // filesystem does not support mapping. read it normally then
+            qDebug("SourceFile: could not map %s, reading instead", fullPath.toUtf8().data());
+            source->decodedText = QString::fromUtf8(source->file.readAll());
+            source->decodedText.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+            source->decoded = true;
+            source->mappedSize = 0;
+            source->file.close();
+        }
+    }
+    else
+    {
+        source->decoded = true;
+        source->file.close();
+    }
+
+    return source;
+}
+
+QSharedPointer<SourceFile> SourceFile::fromText(QString fullPath, QString text)
+{
+    QSharedPointer<SourceFile> source = QSharedPointer<SourceFile>(new SourceFile());
+    source->path = fullPath;
+    source->decodedText = text;
+    source->decoded = true;
+    return source;
+}
+
+QSharedPointer<SourceFile> SourceFile::fromBytes(QString fullPath, QByteArray bytes)
+{
+    QSharedPointer<SourceFile> source = QSharedPointer<SourceFile>(new SourceFile());
+    source->path = fullPath;
+    source->rawBytes = bytes;
+    return source;
+}
+
+QByteArray SourceFile::bytes() const
+{
+    if (!mapped)
+        return rawBytes;
+    return QByteArray::fromRawData(reinterpret_cast<const char*>(mapped), int(mappedSize));
+}
+
+void SourceFile::decode()
+{
+    if (!decoded)
+    {
+        if (mapped)
+        {
+            decodedText = QString::fromUtf8(reinterpret_cast<const char*>(mapped), int(mappedSize));
+            // same as reading with QIODevice::Text
+            if (decodedText.contains('\r'))
+                decodedText.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+        }
+        else if (!rawBytes.isEmpty())
+        {
+            decodedText = QString::fromUtf8(rawBytes);
+            if (decodedText.contains('\r'))
+                decodedText.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+        }
+        decoded = true;
+    }
+    // only the text is read from now on
+    release();
+}
+
+void SourceFile::release()
+{
+    rawBytes = QByteArray();
+    if (!mapped)
+        return;
+    file.unmap(mapped);
+    file.close();
+    mapped = nullptr;
+    mappedSize = 0;
+}
+
+QString SourceFile::text()
+{
+    QMutexLocker lock(&decodeLock);
+    if (edited)
+        return editBuffer.text();
+    decode();
+    return decodedText;
+}
+
+bool SourceFile::isEdited() const
+{
+    QMutexLocker lock(&decodeLock);
+    return edited;
+}
+
+int SourceFile::length()
+{
+    QMutexLocker lock(&decodeLock);
+    if (edited)
+        return editBuffer.length();
+    decode();
+    return decodedText.length();
+}
+
+QString SourceFile::mid(int position, int n)
+{
+    QMutexLocker lock(&decodeLock);
+    if (edited)
+        return editBuffer.mid(position, n);
+    decode();
+    return decodedText.mid(position, n);
+}
+
+void SourceFile::setText(const QString& newText)
+{
+    QMutexLocker lock(&decodeLock);
+    editBuffer = TextBuffer(newText);
+    // the file contents are not needed anymore
+    decodedText = QString();
+    release();
+    edited = true;
+}
+
+bool SourceFile::replace(int position, int charsRemoved, const QString& added)
+{
+    QMutexLocker lock(&decodeLock);
+    if (!edited)
+    {
+        decode();
+        // the decoded text becomes the original of the buffer. it is shared, not copied
+        editBuffer = TextBuffer(decodedText);
+        decodedText = QString();
+        edited = true;
+    }
+    return editBuffer.replace(position, charsRemoved, added);
+}
+
+void SourceFile::unmap()
+{
+    QMutexLocker lock(&decodeLock);
+    if (!edited)
+        decode();
+    release();
+}
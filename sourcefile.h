@@ -0,0 +1,75 @@
+#ifndef SOURCEFILE_H
+#define SOURCEFILE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QSharedPointer>
+#include "textbuffer.h"
+
+// Source text of a single file. One instance is shared (refcounted) between ProjectFile, Document and the tokenizer.
+// The file is memory-mapped and decoded once, on first request. The mapping (and the file handle) is released as soon as
+// the text is decoded, or when loading is done (see SourceLoader), so files don't stay open and a file that is truncated
+// on disk later can't be read through a stale mapping.
+// An edit buffer is created only when the user actually edits the text; until then everyone reads the decoded file contents.
+// Edits go into the buffer as they are made (see TextBuffer), so the editor never has to hand over the whole text.
+class SourceFile
+{
+public:
+    ~SourceFile();
+
+    // maps the file. returns nullptr if the file cannot be opened
+    static QSharedPointer<SourceFile> open(QString fullPath);
+    // source that does not come from disk (new documents)
+    static QSharedPointer<SourceFile> fromText(QString fullPath, QString text);
+    // raw file contents that were read elsewhere (archive entries). decoded on first request, same as a mapped file
+    static QSharedPointer<SourceFile> fromBytes(QString fullPath, QByteArray bytes);
+
+    QString fullPath() const { return path; }
+
+    // raw file contents. this points into the mapping, no copy is made.
+    // only available until the text is decoded; empty after that, or if the file is neither mapped nor created from bytes
+    QByteArray bytes() const;
+    bool isMapped() const { return mapped != nullptr; }
+
+    // current text: edit buffer if the source was edited, otherwise the decoded file contents.
+    // the returned QString is implicitly shared, so passing it to the tokenizer does not copy it.
+    // after edits, the text is put together here once and then shared until the next edit
+    QString text();
+    bool isEdited() const;
+    int length();
+    // part of the current text, without putting the whole text together
+    QString mid(int position, int n);
+
+    // replaces the current text with edited text. the edit buffer is created on first call.
+    void setText(const QString& newText);
+    // applies one edit. returns false if the range is outside of the text
+    bool replace(int position, int charsRemoved, const QString& added);
+
+    // decodes the text if it was not decoded yet and releases the mapping.
+    // this has to be done before the file is overwritten on disk.
+    void unmap();
+
+private:
+    SourceFile();
+    // decodes the text if that wasn't done yet, then releases the raw contents. decodeLock must be held
+    void decode();
+    void release();
+
+    QString path;
+    QFile file;
+    uchar* mapped;
+    qint64 mappedSize;
+    QByteArray rawBytes; // fromBytes only
+
+    // guards everything below, and the mapping. the edit buffer also changes when the text is requested
+    mutable QMutex decodeLock;
+    bool decoded;
+    QString decodedText;
+
+    bool edited;
+    TextBuffer editBuffer;
+};
+
+#endif // SOURCEFILE_H
@@ -0,0 +1,124 @@
+#include "sourceloader.h"
+#include "profiler.h"
+
+#include <QMutexLocker>
+#include <QThread>
+#include <QtConcurrent>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+SourceLoader::SourceLoader(int threads)
+{
+    if (threads <= 0)
+        threads = qMax(2, QThread::idealThreadCount());
+    pool.setMaxThreadCount(threads);
+}
+
+SourceLoader::~SourceLoader()
+{
+    // batches reference lock and results
+    pool.waitForDone();
+}
+
+void SourceLoader::prefetch(const QStringList& fullPaths)
+{
+    QStringList toLoad;
+    {
+        QMutexLocker locker(&lock);
+        for (const QString& path : fullPaths)
+        {
+            if (queued.contains(path))
+                continue;
+            queued.insert(path);
+            toLoad.append(path);
+        }
+    }
+
+    for (int i = 0; i < toLoad.size(); i += batchSize)
+        QtConcurrent::run(&pool, this, &SourceLoader::loadBatch, toLoad.mid(i, batchSize));
+}
+
+SourceLoader::Result SourceLoader::take(const QString& fullPath)
+{
+    {
+        QMutexLocker locker(&lock);
+        if (queued.contains(fullPath))
+        {
+            while (!results.contains(fullPath))
+                loaded.wait(&lock);
+            queued.remove(fullPath);
+            return results.take(fullPath);
+        }
+    }
+
+    // not prefetched
+    return load(fullPath, archive.data());
+}
+
+SourceLoader::Result SourceLoader::load(const QString& fullPath, Pk3Archive* archive)
+{
+    Result result;
+    if (archive && fullPath.startsWith(archive->path() + "/"))
+    {
+        // only this entry is decompressed. entries of different batches are decompressed in parallel
+        QByteArray bytes;
+        if (!archive->read(fullPath.mid(archive->path().length()+1), bytes))
+            return result;
+        result.source = SourceFile::fromBytes(fullPath, bytes);
+    }
+    else result.source = SourceFile::open(fullPath);
+    if (!result.source)
+        return result;
+    // the cache is keyed by the file contents as stored on disk
+    QByteArray bytes = result.source->bytes();
+    if (bytes.isEmpty())
+        bytes = result.source->text().toUtf8();
+    ZZ_PROFILE_COUNT(SourceBytes, bytes.size());
+    result.contentHash = ParseCache::contentHash(bytes);
+    result.cached = ParseCache::load(result.contentHash);
+    if (result.cached)
+    {
+        ZZ_PROFILE_COUNT(ParseCacheHits, 1);
+        result.tokens = result.cached->tokens;
+    }
+    else
+    {
+        ZZ_PROFILE_COUNT(ParseCacheMisses, 1);
+        Tokenizer t(result.source->text());
+        result.tokens = t.readAllTokens();
+    }
+    // decoded here even on a cache hit: the file is closed and unmapped once it's loaded
+    bytes = QByteArray();
+    result.source->unmap();
+    result.ok = true;
+    return result;
+}
+
+void SourceLoader::loadBatch(QStringList fullPaths)
+{
+#ifdef Q_OS_LINUX
+    // start kernel readahead for the whole batch at once, so reading the next files overlaps with tokenizing this one.
+    // archive entries are read from the archive mapping instead
+    for (const QString& path : fullPaths)
+    {
+        if (archive && path.startsWith(archive->path() + "/"))
+            continue;
+        int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY);
+        if (fd < 0)
+            continue;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        ::close(fd);
+    }
+#endif
+
+    for (const QString& path : fullPaths)
+    {
+        Result result = load(path, archive.data());
+        QMutexLocker locker(&lock);
+        results.insert(path, result);
+        loaded.wakeAll();
+    }
+}
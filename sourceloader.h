@@ -0,0 +1,64 @@
+#ifndef SOURCELOADER_H
+#define SOURCELOADER_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include "sourcefile.h"
+#include "tokenizer.h"
+#include "parsecache.h"
+#include "pk3archive.h"
+
+// Reader stage of project loading.
+// Files are queued for prefetch as soon as they are known (e.g. right after the include that names them is parsed).
+// Worker threads open, decode and tokenize (or look up in the parse cache) them in batches, so that I/O and tokenization of one file
+// overlap with parsing of another on the calling thread.
+class SourceLoader
+{
+public:
+    struct Result
+    {
+        QSharedPointer<SourceFile> source;
+        QList<Tokenizer::Token> tokens;
+        QByteArray contentHash;
+        // set if the file was found in the parse cache. tokens then come from the cache and the tokenizer is not run
+        QSharedPointer<ParseCacheEntry> cached;
+        bool ok;
+
+        Result() { ok = false; }
+    };
+
+    explicit SourceLoader(int threads = 0);
+    ~SourceLoader();
+
+    // files with paths inside the archive (<archive path>/<entry>) are read from it instead of the filesystem
+    void setArchive(QSharedPointer<Pk3Archive> archive) { this->archive = archive; }
+
+    // queues files that were not queued yet. files are split into batches of batchSize
+    void prefetch(const QStringList& fullPaths);
+    // waits until the file is loaded and removes it from the loader.
+    // if the file was never queued, it's loaded on the calling thread
+    Result take(const QString& fullPath);
+
+    static const int batchSize = 8;
+
+    // loads and tokenizes (or reads from the parse cache) a single file on the calling thread
+    static Result load(const QString& fullPath, Pk3Archive* archive = nullptr);
+
+private:
+    void loadBatch(QStringList fullPaths);
+
+    QSharedPointer<Pk3Archive> archive;
+    QThreadPool pool;
+    QMutex lock;
+    QWaitCondition loaded;
+    QSet<QString> queued;
+    QHash<QString, Result> results;
+};
+
+#endif // SOURCELOADER_H
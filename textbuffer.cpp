@@ -0,0 +1,110 @@
+#include "textbuffer.h"
+
+TextBuffer::TextBuffer(const QString& original) : original(original)
+{
+    totalLength = original.length();
+    if (totalLength)
+    {
+        Piece piece = { false, 0, totalLength };
+        pieces.append(piece);
+    }
+}
+
+int TextBuffer::findPiece(int position, int& offset) const
+{
+    // linear: there are few pieces, they are joined back into one whenever the whole text is requested
+    int pieceStart = 0;
+    for (int i = 0; i < pieces.size(); i++)
+    {
+        if (position < pieceStart + pieces[i].length)
+        {
+            offset = position - pieceStart;
+            return i;
+        }
+        pieceStart += pieces[i].length;
+    }
+    offset = 0;
+    return pieces.size();
+}
+
+int TextBuffer::split(int position)
+{
+    int offset;
+    int index = findPiece(position, offset);
+    if (!offset)
+        return index;
+    Piece tail = pieces[index];
+    tail.start += offset;
+    tail.length -= offset;
+    pieces[index].length = offset;
+    pieces.insert(index+1, tail);
+    return index+1;
+}
+
+bool TextBuffer::replace(int position, int charsRemoved, const QString& added)
+{
+    if (position < 0 || charsRemoved < 0 || position+charsRemoved > totalLength)
+        return false;
+
+    int first = split(position);
+    int last = split(position+charsRemoved);
+    pieces.remove(first, last-first);
+
+    if (!added.isEmpty())
+    {
+        // typing extends the piece of the previous insertion instead of adding a piece per character
+        if (first > 0 && pieces[first-1].added && pieces[first-1].start+pieces[first-1].length == addBuffer.length())
+        {
+            pieces[first-1].length += added.length();
+        }
+        else
+        {
+            Piece piece = { true, addBuffer.length(), added.length() };
+            pieces.insert(first, piece);
+        }
+        addBuffer += added;
+    }
+
+    totalLength += added.length() - charsRemoved;
+    return true;
+}
+
+QString TextBuffer::mid(int position, int n) const
+{
+    if (position < 0)
+        position = 0;
+    if (n < 0 || position+n > totalLength)
+        n = totalLength-position;
+    if (n <= 0)
+        return QString();
+
+    QString out;
+    out.reserve(n);
+    int offset;
+    for (int i = findPiece(position, offset); i < pieces.size() && out.length() < n; i++)
+    {
+        const Piece& piece = pieces[i];
+        const QString& buffer = piece.added ? addBuffer : original;
+        int count = qMin(piece.length-offset, n-out.length());
+        out.append(buffer.constData()+piece.start+offset, count);
+        offset = 0;
+    }
+    return out;
+}
+
+QString TextBuffer::text()
+{
+    if (pieces.size() == 1 && !pieces[0].added && pieces[0].start == 0 && pieces[0].length == original.length())
+        return original;
+
+    // the joined text replaces the original and the inserted text. the old original is freed unless someone still holds it
+    original = mid(0, totalLength);
+    addBuffer = QString();
+    pieces.clear();
+    if (totalLength)
+    {
+        Piece piece = { false, 0, totalLength };
+        pieces.append(piece);
+    }
+    return original;
+}
@@ -0,0 +1,43 @@
+#ifndef TEXTBUFFER_H
+#define TEXTBUFFER_H
+
+#include <QString>
+#include <QVector>
+
+// Edited text as a piece table: the text is a list of pieces of the original text and of an append-only buffer
+// of inserted text. An edit costs the inserted text plus a walk over the pieces, not a copy of the whole text.
+// The whole text is put together only when someone asks for it; it then becomes the new original, with one piece,
+// so the buffer never holds more than one copy of the text plus what was typed since.
+class TextBuffer
+{
+public:
+    TextBuffer(const QString& original = QString());
+
+    int length() const { return totalLength; }
+    // replaces charsRemoved characters at position with added. returns false, and changes nothing, if the range is outside of the text
+    bool replace(int position, int charsRemoved, const QString& added);
+    // copy of a part of the text
+    QString mid(int position, int n) const;
+    // whole text. implicitly shared with the buffer, so it stays valid (and is not copied) until the next edit
+    QString text();
+
+private:
+    struct Piece
+    {
+        bool added; // in addBuffer, otherwise in original
+        int start;
+        int length;
+    };
+
+    QString original;
+    QString addBuffer;
+    QVector<Piece> pieces;
+    int totalLength;
+
+    // index of the piece that contains position and the offset of position in it. pieces.size() at the end of the text
+    int findPiece(int position, int& offset) const;
+    // makes position the start of a piece and returns its index
+    int split(int position);
+};
+
+#endif // TEXTBUFFER_H
@@ -1,4 +1,6 @@
 #include "tokenizer.h"
+#include "profiler.h"
+#include <algorithm>
 
 #include <QTime>
 
@@ -10,26 +12,32 @@ bool Tokenizer::compareTokenLength(const Tokenizer::TokenInfo& a, const Tokenize
     return (a.content.length() > b.content.length());
 }
 
-Tokenizer::Tokenizer(QString input) : data(input)
+bool Tokenizer::initTokenInfos()
 {
-    if (!TokenInfos.size())
+    // initialize the list.
+    #define DEFINE_TOKEN1(num, token) TokenInfos.append({ name: #token, number: num, content: "" });
+    #define DEFINE_TOKEN2(num, token, c) TokenInfos.append({ name: #token, number: num, content: c });
+    #include "tokens.h"
+    #undef DEFINE_TOKEN2
+    #undef DEFINE_TOKEN1
+
+    // sort tokens by content length
+    std::sort(TokenInfos.begin(), TokenInfos.end(), compareTokenLength);
+    for (QList<TokenInfo>::iterator it = TokenInfos.begin(); it != TokenInfos.end(); ++it)
     {
-        // initialize the list.
-        #define DEFINE_TOKEN1(num, token) TokenInfos.append({ name: #token, number: num, content: "" });
-        #define DEFINE_TOKEN2(num, token, c) TokenInfos.append({ name: #token, number: num, content: c });
-        #include "tokens.h"
-        #undef DEFINE_TOKEN2
-        #undef DEFINE_TOKEN1
-
-        // sort tokens by content length
-        std::sort(TokenInfos.begin(), TokenInfos.end(), compareTokenLength);
-        for (QList<TokenInfo>::iterator it = TokenInfos.begin(); it != TokenInfos.end(); ++it)
-        {
-            TokenInfo* info = &(*it);
-            TokenInfosByNum[info->number] = info;
-        }
+        TokenInfo* info = &(*it);
+        TokenInfosByNum[info->number] = info;
     }
 
+    return true;
+}
+
+Tokenizer::Tokenizer(QString input) : data(input)
+{
+    // tokenizers are created from loader threads too. static local initialization happens exactly once
+    static const bool tokenInfosReady = initTokenInfos();
+    Q_UNUSED(tokenInfosReady);
+
     dataPos = 0;
     lastPos = 0;
     maxLine = 1;
@@ -531,23 +539,20 @@ bool Tokenizer::readToken(Token& out, bool shortCircuit)
 
 QList<Tokenizer::Token> Tokenizer::readAllTokens()
 {
+    ZZ_PROFILE_SCOPE(Tokenize);
     QList<Token> tokens;
     Token tok;
     while (readToken(tok))
         tokens.append(tok);
+    ZZ_PROFILE_COUNT(TokensLexed, tokens.size());
     return tokens;
 }
 
 int Tokenizer::line()
 {
-    int lineNo = 0;
-    for (int& lineidx : dataLineNumbers)
-    {
-        lineNo++;
-        if (lineidx > dataPos)
-            break;
-    }
-    return lineNo;
+    // dataLineNumbers is sorted: binary search for the number of line ends before the current position.
+    // (this is called for every token, a linear scan made tokenizing quadratic in the number of lines)
+    return int(std::lower_bound(dataLineNumbers.begin(), dataLineNumbers.end(), dataPos) - dataLineNumbers.begin()) + 1;
 }
 
 TokenStream::TokenStream(QList<Tokenizer::Token>& toklst) : _tokens(toklst)
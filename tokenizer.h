@@ -90,6 +90,7 @@ private:
     static QList<TokenInfo> TokenInfos;
     static QMap<int, TokenInfo*> TokenInfosByNum;
     static bool compareTokenLength(const Tokenizer::TokenInfo& a, const Tokenizer::TokenInfo& b);
+    static bool initTokenInfos();
 
     //
     bool tryReadWhitespace(Token& out);
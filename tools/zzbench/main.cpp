@@ -0,0 +1,448 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QDir>
+#include <QVector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "project.h"
+#include "libraryindex.h"
+#include "tokenizer.h"
+#include "parser.h"
+
+// zzbench [--root <dir>] [--library <path>] [--repeat N] [--warmup N] [--cache none|warm] [--cold]
+//         [--synthetic] [--scales 1,2,4,...] [--format text|json] [--label <text>] [<project>...]
+// Times every phase of a project load on its own: tokenizer, root pass (Parser::parse), type linking (setTypeInformation),
+// field pass and method pass, all on source that is already in memory, then Project::parseProject end to end.
+// Without projects, runs on Reference (on its own) and Ref2 (with Reference as the library) under --root.
+// Projects written by zzgen need no library; the same zzgen options give the same project, so those results compare too.
+// Each phase is run warmup times without recording, then repeat times; median and p95 are reported.
+
+struct Corpus
+{
+    QString name;
+    QString path;
+    QSharedPointer<const LibraryIndex> library;
+    // include closure of the project, as parseProject finds it
+    QStringList files;
+    QStringList texts;
+    QList<QList<Tokenizer::Token>> tokens;
+    qint64 bytes;
+    qint64 tokenCount;
+};
+
+struct BenchResult
+{
+    QString corpus;
+    QString phase;
+    qint64 bytes;
+    qint64 tokens;
+    QVector<double> samples; // milliseconds
+
+    double percentile(double p) const
+    {
+        QVector<double> sorted = samples;
+        std::sort(sorted.begin(), sorted.end());
+        int index = qBound(0, int(std::ceil(p * sorted.size())) - 1, sorted.size()-1);
+        return sorted.isEmpty() ? 0.0 : sorted[index];
+    }
+    double median() const { return percentile(0.5); }
+};
+
+static bool verbose = false;
+static QString cacheDir;
+
+static void messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& message)
+{
+    Q_UNUSED(context);
+    // the parser reports every diagnostic through qDebug
+    if (type == QtDebugMsg && !verbose)
+        return;
+    fprintf(stderr, "%s\n", message.toLocal8Bit().constData());
+}
+
+static double elapsedMs(QElapsedTimer& timer)
+{
+    double ms = timer.nsecsElapsed() / 1000000.0;
+    timer.restart();
+    return ms;
+}
+
+// the parse cache would make every load after the first one a cached load
+static void clearParseCache()
+{
+    QDir(cacheDir).removeRecursively();
+    QDir().mkpath(cacheDir);
+}
+
+// evicts the files from the page cache, so that the next load reads them from disk
+static void dropPageCache(const QStringList& paths)
+{
+#ifdef Q_OS_LINUX
+    for (const QString& path : paths)
+    {
+        int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY);
+        if (fd < 0)
+            continue;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    }
+#else
+    Q_UNUSED(paths);
+#endif
+}
+
+static bool loadCorpus(Corpus& corpus)
+{
+    Project project(corpus.path, corpus.library);
+    project.lazyMethodBodies = true;
+    project.parseProject();
+    corpus.bytes = 0;
+    corpus.tokenCount = 0;
+    for (const ProjectFile& f : project.files)
+    {
+        if (!f.parser || !f.source)
+            continue;
+        corpus.files.append(f.fullPath);
+        corpus.texts.append(f.source->text());
+        corpus.bytes += corpus.texts.last().toUtf8().size();
+        Tokenizer t(corpus.texts.last());
+        corpus.tokens.append(t.readAllTokens());
+        corpus.tokenCount += corpus.tokens.last().size();
+    }
+    return !corpus.files.isEmpty();
+}
+
+// one run of every in-memory phase, on new parsers. samples are added if record is set
+static void runPhases(const Corpus& corpus, QHash<QString, BenchResult>& results, bool record)
+{
+    QElapsedTimer timer;
+    QHash<QString, double> times;
+
+    timer.start();
+    for (const QString& text : corpus.texts)
+    {
+        Tokenizer t(text);
+        t.readAllTokens();
+    }
+    times["tokenize"] = elapsedMs(timer);
+
+    QList<Parser*> parsers;
+    for (const QList<Tokenizer::Token>& tokens : corpus.tokens)
+    {
+        Parser* parser = new Parser(tokens);
+        parser->parse();
+        if (parser->root)
+            parsers.append(parser);
+        else delete parser;
+    }
+    times["parse"] = elapsedMs(timer);
+
+    QList<QSharedPointer<ZTreeNode>> allTypes;
+    QSharedPointer<ZClassOverlay> classOverlay;
+    if (corpus.library)
+    {
+        allTypes = corpus.library->types();
+        classOverlay = corpus.library->classOverlay();
+    }
+    for (Parser* parser : parsers)
+        allTypes.append(parser->getOwnTypeInformation());
+    for (Parser* parser : parsers)
+    {
+        parser->setClassOverlay(classOverlay);
+        parser->setTypeInformation(allTypes);
+    }
+    times["link"] = elapsedMs(timer);
+
+    for (Parser* parser : parsers)
+    {
+        for (QSharedPointer<ZTreeNode> node : parser->root->children)
+        {
+            if (node->type() == ZTreeNode::Class)
+                parser->parseClassFields(node.dynamicCast<ZClass>());
+            else if (node->type() == ZTreeNode::Struct)
+                parser->parseStructFields(node.dynamicCast<ZStruct>());
+        }
+    }
+    times["fields"] = elapsedMs(timer);
+
+    for (Parser* parser : parsers)
+    {
+        parser->setLazyMethodBodies(false);
+        for (QSharedPointer<ZTreeNode> node : parser->root->children)
+        {
+            if (node->type() == ZTreeNode::Class)
+                parser->parseClassMethods(node.dynamicCast<ZClass>());
+            else if (node->type() == ZTreeNode::Struct)
+                parser->parseStructMethods(node.dynamicCast<ZStruct>());
+        }
+    }
+    times["methods"] = elapsedMs(timer);
+
+    qDeleteAll(parsers);
+    if (!record)
+        return;
+    for (QHash<QString, double>::const_iterator it = times.constBegin(); it != times.constEnd(); ++it)
+    {
+        BenchResult& result = results[it.key()];
+        result.corpus = corpus.name;
+        result.phase = it.key();
+        result.bytes = corpus.bytes;
+        result.tokens = corpus.tokenCount;
+        result.samples.append(it.value());
+    }
+}
+
+// whole load from disk: scan, read, tokenize and every pass
+static double runProject(const Corpus& corpus, bool warmCache, bool cold)
+{
+    if (!warmCache)
+        clearParseCache();
+    if (cold)
+        dropPageCache(corpus.files);
+    QElapsedTimer timer;
+    timer.start();
+    Project* project = new Project(corpus.path, corpus.library);
+    project->parseProject();
+    double ms = elapsedMs(timer);
+    delete project;
+    return ms;
+}
+
+// the corpus put together into one text, repeated scale times. shows whether the tokenizer and the root pass
+// stay linear in the size of a file
+static void runSynthetic(const Corpus& corpus, int scale, int warmup, int repeat, QList<BenchResult>& out)
+{
+    QString unit = corpus.texts.join("\n");
+    QString text;
+    text.reserve((unit.size()+1) * scale);
+    for (int i = 0; i < scale; i++)
+    {
+        text.append(unit);
+        text.append('\n');
+    }
+
+    BenchResult tokenize;
+    BenchResult parse;
+    tokenize.corpus = parse.corpus = QString("%1 x%2").arg(corpus.name).arg(scale);
+    tokenize.phase = "tokenize";
+    parse.phase = "parse";
+    tokenize.bytes = parse.bytes = text.toUtf8().size();
+    for (int i = 0; i < warmup + repeat; i++)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        Tokenizer t(text);
+        QList<Tokenizer::Token> tokens = t.readAllTokens();
+        double tokenizeMs = elapsedMs(timer);
+        Parser* parser = new Parser(tokens);
+        parser->parse();
+        double parseMs = elapsedMs(timer);
+        delete parser;
+        tokenize.tokens = parse.tokens = tokens.size();
+        if (i < warmup)
+            continue;
+        tokenize.samples.append(tokenizeMs);
+        parse.samples.append(parseMs);
+    }
+    out.append(tokenize);
+    out.append(parse);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("zzbench");
+    qInstallMessageHandler(messageHandler);
+
+    QCommandLineParser args;
+    args.setApplicationDescription("Times the tokenizer, the parser passes and whole project loads.");
+    args.addHelpOption();
+    args.addPositionalArgument("projects", "Project directories or archives. Default: Reference and Ref2 under --root.", "[<project>...]");
+    QCommandLineOption rootOption("root", "Directory with the Reference and Ref2 corpora.", "dir", ".");
+    QCommandLineOption libraryOption("library", "Library for the projects given on the command line.", "path");
+    QCommandLineOption repeatOption("repeat", "Recorded runs of each phase.", "count", "10");
+    QCommandLineOption warmupOption("warmup", "Runs before recording.", "count", "2");
+    QCommandLineOption cacheOption("cache", "Parse cache for the project loads: none (cleared before every load) or warm.", "mode", "none");
+    QCommandLineOption coldOption("cold", "Evict the project files from the page cache before every project load (Linux).");
+    QCommandLineOption syntheticOption("synthetic", "Also time the tokenizer and root pass on the first corpus repeated --scales times, as one file.");
+    QCommandLineOption scalesOption("scales", "Comma separated scales for --synthetic.", "list", "1,2,4,8,16");
+    QCommandLineOption formatOption("format", "Output format: text or json.", "format", "text");
+    QCommandLineOption labelOption("label", "Label stored with the results, i.e. the commit.", "text");
+    QCommandLineOption verboseOption("verbose", "Print the parser's debug output.");
+    args.addOption(rootOption);
+    args.addOption(libraryOption);
+    args.addOption(repeatOption);
+    args.addOption(warmupOption);
+    args.addOption(cacheOption);
+    args.addOption(coldOption);
+    args.addOption(syntheticOption);
+    args.addOption(scalesOption);
+    args.addOption(formatOption);
+    args.addOption(labelOption);
+    args.addOption(verboseOption);
+    args.process(app);
+
+    verbose = args.isSet(verboseOption);
+    int repeat = args.value(repeatOption).toInt();
+    int warmup = args.value(warmupOption).toInt();
+    QString cacheMode = args.value(cacheOption);
+    QString format = args.value(formatOption);
+    QList<int> scales;
+    for (const QString& scale : args.value(scalesOption).split(',', QString::SkipEmptyParts))
+        scales.append(scale.toInt());
+    if (repeat < 1 || warmup < 0 || (cacheMode != "none" && cacheMode != "warm") || (format != "text" && format != "json") || scales.contains(0))
+    {
+        fprintf(stderr, "%s", args.helpText().toLocal8Bit().constData());
+        return 2;
+    }
+    bool warmCache = (cacheMode == "warm");
+    bool cold = args.isSet(coldOption);
+#ifndef Q_OS_LINUX
+    if (cold)
+        fprintf(stderr, "zzbench: --cold is only supported on Linux, ignored\n");
+#endif
+
+    // results must not depend on what an earlier run left in the user's parse cache.
+    // the cache directory is resolved once, so this goes before anything is parsed
+    QTemporaryDir tempDir;
+    cacheDir = tempDir.path() + "/parsecache";
+    qputenv("ZZSCRIPT_CACHE_DIR", QFile::encodeName(cacheDir));
+    clearParseCache();
+
+    QList<Corpus> corpora;
+    QStringList paths = args.positionalArguments();
+    if (paths.isEmpty())
+    {
+        QString root = args.value(rootOption);
+        QSharedPointer<const LibraryIndex> reference = LibraryIndex::load(root + "/Reference");
+        if (!reference)
+        {
+            fprintf(stderr, "zzbench: %s/Reference could not be loaded\n", root.toLocal8Bit().constData());
+            return 2;
+        }
+        Corpus referenceCorpus;
+        referenceCorpus.name = "Reference";
+        referenceCorpus.path = root + "/Reference";
+        corpora.append(referenceCorpus);
+        Corpus zforms;
+        zforms.name = "Ref2";
+        zforms.path = root + "/Ref2";
+        zforms.library = reference;
+        corpora.append(zforms);
+    }
+    else
+    {
+        QSharedPointer<const LibraryIndex> library;
+        if (args.isSet(libraryOption))
+        {
+            library = LibraryIndex::load(args.value(libraryOption));
+            if (!library)
+            {
+                fprintf(stderr, "zzbench: library %s could not be loaded\n", args.value(libraryOption).toLocal8Bit().constData());
+                return 2;
+            }
+        }
+        for (const QString& path : paths)
+        {
+            Corpus corpus;
+            corpus.name = QDir::cleanPath(path).section('/', -1);
+            corpus.path = path;
+            corpus.library = library;
+            corpora.append(corpus);
+        }
+    }
+
+    QList<BenchResult> results;
+    for (Corpus& corpus : corpora)
+    {
+        if (!loadCorpus(corpus))
+        {
+            fprintf(stderr, "zzbench: %s has no zscript.txt or no files\n", corpus.path.toLocal8Bit().constData());
+            return 2;
+        }
+
+        QHash<QString, BenchResult> phases;
+        for (int i = 0; i < warmup + repeat; i++)
+            runPhases(corpus, phases, i >= warmup);
+        for (const char* phase : { "tokenize", "parse", "link", "fields", "methods" })
+            results.append(phases.value(phase));
+
+        BenchResult project;
+        project.corpus = corpus.name;
+        project.phase = "project";
+        project.bytes = corpus.bytes;
+        project.tokens = corpus.tokenCount;
+        for (int i = 0; i < warmup + repeat; i++)
+        {
+            double ms = runProject(corpus, warmCache, cold);
+            if (i >= warmup)
+                project.samples.append(ms);
+        }
+        results.append(project);
+    }
+
+    if (args.isSet(syntheticOption))
+    {
+        for (int scale : scales)
+            runSynthetic(corpora.first(), scale, warmup, repeat, results);
+    }
+
+    if (format == "json")
+    {
+        QJsonArray benchmarks;
+        for (const BenchResult& result : results)
+        {
+            double seconds = result.median() / 1000.0;
+            QJsonArray samples;
+            for (double sample : result.samples)
+                samples.append(sample);
+            QJsonObject b;
+            b.insert("corpus", result.corpus);
+            b.insert("phase", result.phase);
+            b.insert("bytes", double(result.bytes));
+            b.insert("tokens", double(result.tokens));
+            b.insert("median_ms", result.median());
+            b.insert("p95_ms", result.percentile(0.95));
+            b.insert("mb_per_s", seconds > 0 ? result.bytes / seconds / 1000000.0 : 0.0);
+            b.insert("tokens_per_s", seconds > 0 ? result.tokens / seconds : 0.0);
+            b.insert("samples", samples);
+            benchmarks.append(b);
+        }
+        QJsonObject config;
+        config.insert("repeat", repeat);
+        config.insert("warmup", warmup);
+        config.insert("cache", cacheMode);
+        config.insert("cold", cold);
+        QJsonObject out;
+        if (args.isSet(labelOption))
+            out.insert("label", args.value(labelOption));
+        out.insert("config", config);
+        out.insert("benchmarks", benchmarks);
+        fprintf(stdout, "%s\n", QJsonDocument(out).toJson(QJsonDocument::Indented).constData());
+        return 0;
+    }
+
+    if (args.isSet(labelOption))
+        fprintf(stdout, "%s\n", args.value(labelOption).toLocal8Bit().constData());
+    fprintf(stdout, "%-16s %-9s %10s %10s %10s %14s\n", "corpus", "phase", "median ms", "p95 ms", "MB/s", "tokens/s");
+    for (const BenchResult& result : results)
+    {
+        double seconds = result.median() / 1000.0;
+        fprintf(stdout, "%-16s %-9s %10.2f %10.2f %10.1f %14.0f\n", result.corpus.toLocal8Bit().constData(), result.phase.toLocal8Bit().constData(),
+                result.median(), result.percentile(0.95),
+                seconds > 0 ? result.bytes / seconds / 1000000.0 : 0.0, seconds > 0 ? result.tokens / seconds : 0.0);
+    }
+    return 0;
+}
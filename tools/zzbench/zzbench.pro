@@ -0,0 +1,20 @@
+#-------------------------------------------------
+#
+# zzbench: parser and project load benchmarks over the Reference and Ref2 corpora
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = zzbench
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../../zzscript.pri)
+
+SOURCES += \
+        main.cpp
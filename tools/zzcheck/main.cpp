@@ -0,0 +1,294 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <functional>
+#include <algorithm>
+#include <cstdio>
+
+#include "project.h"
+#include "libraryindex.h"
+#include "profiler.h"
+#include "selftest.h"
+
+// zzcheck [--library <path>] [--format text|json] [--jobs N] [--timings] [--verbose] <project>...
+// zzcheck --selftest <seed>
+// Checks every project the same way the editor loads it: declarations, class passes, then every method body.
+// Projects are checked in parallel, each one also reads and tokenizes its files on the loader threads.
+// --timings also prints the parser's phase timers and counters, summed over all projects and threads.
+// Exit code is 0 if there were no errors, 1 if any project has errors or could not be loaded, 2 on bad arguments.
+// --selftest checks the incremental edit paths against full reparses instead (see selftest.h), 1 if any differ.
+
+struct CheckDiagnostic
+{
+    QString file;
+    int line;
+    ParserDiagnostic::Severity severity;
+    QString message;
+};
+
+struct CheckResult
+{
+    QString path;
+    bool loaded;
+    // why the project is not loaded
+    QString error;
+    int errors;
+    int warnings;
+    QList<CheckDiagnostic> diagnostics;
+    // phase name and milliseconds, in the order the phases ran
+    QList<QPair<QString, qint64>> timings;
+
+    CheckResult()
+    {
+        loaded = false;
+        errors = warnings = 0;
+    }
+};
+
+// the parser reports every diagnostic through qDebug as well
+static bool verbose = false;
+
+static void messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& message)
+{
+    Q_UNUSED(context);
+    if (type == QtDebugMsg && !verbose)
+        return;
+    fprintf(stderr, "%s\n", message.toLocal8Bit().constData());
+}
+
+static CheckResult checkProject(const QString& path, QSharedPointer<const LibraryIndex> library)
+{
+    CheckResult result;
+    result.path = path;
+    QElapsedTimer timer;
+    timer.start();
+
+    Project project(path, library);
+    result.timings.append(qMakePair(QString("scan"), timer.restart()));
+    if (!project.findFile(project.projectName + "/zscript.txt"))
+    {
+        result.error = "zscript.txt not found";
+        return result;
+    }
+
+    // bodies are parsed separately, so that they get their own timing
+    project.lazyMethodBodies = true;
+    // files that could not be read or included fail the load. what was parsed is still checked
+    result.loaded = project.parseProject();
+    if (!result.loaded)
+        result.error = "some files could not be read or included (see --verbose)";
+    result.timings.append(qMakePair(QString("parse"), timer.restart()));
+    while (!project.parseMethodBodies(1024));
+    result.timings.append(qMakePair(QString("bodies"), timer.restart()));
+
+    for (const ProjectFile& f : project.files)
+    {
+        if (!f.parser)
+            continue;
+        QList<CheckDiagnostic> fileDiagnostics;
+        for (const ParserDiagnostic& diag : f.parser->diagnostics)
+        {
+            CheckDiagnostic out;
+            out.file = f.fullPath;
+            out.line = diag.line;
+            out.severity = diag.severity;
+            out.message = diag.message;
+            fileDiagnostics.append(out);
+            if (diag.severity == ParserDiagnostic::Error)
+                result.errors++;
+            else result.warnings++;
+        }
+        // passes report in their own order
+        std::stable_sort(fileDiagnostics.begin(), fileDiagnostics.end(), [](const CheckDiagnostic& a, const CheckDiagnostic& b) { return a.line < b.line; });
+        result.diagnostics.append(fileDiagnostics);
+    }
+    return result;
+}
+
+static QJsonObject timingsToJson(const QList<QPair<QString, qint64>>& timings)
+{
+    QJsonObject out;
+    for (const QPair<QString, qint64>& timing : timings)
+        out.insert(timing.first, double(timing.second));
+    return out;
+}
+
+static QJsonObject profileToJson()
+{
+    QJsonObject out;
+    if (!Profiler::isEnabled())
+        return out;
+    Profiler::Totals totals = Profiler::totals();
+    QJsonObject timers;
+    for (int i = 0; i < Profiler::TimerCount; i++)
+    {
+        QJsonObject timer;
+        timer.insert("ms", totals.timerNsecs[i] / 1000000.0);
+        timer.insert("calls", double(totals.timerCalls[i]));
+        timers.insert(Profiler::timerName(Profiler::Timer(i)), timer);
+    }
+    QJsonObject counters;
+    for (int i = 0; i < Profiler::CounterCount; i++)
+        counters.insert(Profiler::counterName(Profiler::Counter(i)), double(totals.counters[i]));
+    out.insert("timers", timers);
+    out.insert("counters", counters);
+    return out;
+}
+
+static QString timingsToText(const QList<QPair<QString, qint64>>& timings)
+{
+    QStringList parts;
+    for (const QPair<QString, qint64>& timing : timings)
+        parts.append(QString("%1 %2 ms").arg(timing.first).arg(timing.second));
+    return parts.join(", ");
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("zzcheck");
+    qInstallMessageHandler(messageHandler);
+
+    QCommandLineParser args;
+    args.setApplicationDescription("Checks ZScript projects (directories or pk3 archives) and prints their diagnostics.");
+    args.addHelpOption();
+    args.addPositionalArgument("projects", "Project directories or archives to check.", "<project>...");
+    QCommandLineOption libraryOption("library", "Library the projects are checked against, i.e. the gzdoom zscript Reference.", "path");
+    QCommandLineOption formatOption("format", "Output format: text or json.", "format", "text");
+    QCommandLineOption jobsOption("jobs", "Number of projects checked at once. Default is one per core.", "count");
+    QCommandLineOption timingsOption("timings", "Print the time spent in each phase and the parser counters (text output; json always has them).");
+    QCommandLineOption verboseOption("verbose", "Print the parser's debug output.");
+    QCommandLineOption selfTestOption("selftest", "Compare incremental edits with full reparses on random edits from this seed, then exit.", "seed");
+    args.addOption(libraryOption);
+    args.addOption(formatOption);
+    args.addOption(jobsOption);
+    args.addOption(timingsOption);
+    args.addOption(verboseOption);
+    args.addOption(selfTestOption);
+    args.process(app);
+
+    verbose = args.isSet(verboseOption);
+    if (args.isSet(selfTestOption))
+    {
+        bool ok = false;
+        quint64 seed = args.value(selfTestOption).toULongLong(&ok);
+        if (!ok)
+        {
+            fprintf(stderr, "zzcheck: bad --selftest seed\n");
+            return 2;
+        }
+        return (runSelfTest(seed, 20) > 0) ? 1 : 0;
+    }
+
+    QStringList paths = args.positionalArguments();
+    QString format = args.value(formatOption);
+    if (paths.isEmpty() || (format != "text" && format != "json"))
+    {
+        fprintf(stderr, "%s", args.helpText().toLocal8Bit().constData());
+        return 2;
+    }
+    if (args.isSet(jobsOption))
+    {
+        int jobs = args.value(jobsOption).toInt();
+        if (jobs < 1)
+        {
+            fprintf(stderr, "zzcheck: bad --jobs value\n");
+            return 2;
+        }
+        QThreadPool::globalInstance()->setMaxThreadCount(jobs);
+    }
+
+    QElapsedTimer totalTimer;
+    totalTimer.start();
+    QList<QPair<QString, qint64>> timings;
+
+    // the library is parsed once and shared by all projects; it's never modified by them
+    QSharedPointer<const LibraryIndex> library;
+    if (args.isSet(libraryOption))
+    {
+        QElapsedTimer libraryTimer;
+        libraryTimer.start();
+        library = LibraryIndex::load(args.value(libraryOption));
+        if (!library)
+        {
+            fprintf(stderr, "zzcheck: library %s could not be loaded\n", args.value(libraryOption).toLocal8Bit().constData());
+            return 2;
+        }
+        timings.append(qMakePair(QString("library"), libraryTimer.elapsed()));
+    }
+
+    std::function<CheckResult(const QString&)> check = [library](const QString& path) { return checkProject(path, library); };
+    QList<CheckResult> results = QtConcurrent::blockingMapped<QList<CheckResult>>(paths, check);
+    timings.append(qMakePair(QString("total"), totalTimer.elapsed()));
+
+    bool failed = false;
+    for (const CheckResult& result : results)
+        failed |= !result.loaded || result.errors > 0;
+
+    if (format == "json")
+    {
+        QJsonArray projects;
+        for (const CheckResult& result : results)
+        {
+            QJsonArray diagnostics;
+            for (const CheckDiagnostic& diag : result.diagnostics)
+            {
+                QJsonObject d;
+                d.insert("file", diag.file);
+                d.insert("line", diag.line);
+                d.insert("severity", (diag.severity == ParserDiagnostic::Error) ? "error" : "warning");
+                d.insert("message", diag.message);
+                diagnostics.append(d);
+            }
+            QJsonObject p;
+            p.insert("path", result.path);
+            p.insert("loaded", result.loaded);
+            if (!result.loaded)
+                p.insert("error", result.error);
+            p.insert("errors", result.errors);
+            p.insert("warnings", result.warnings);
+            p.insert("timings", timingsToJson(result.timings));
+            p.insert("diagnostics", diagnostics);
+            projects.append(p);
+        }
+        QJsonObject out;
+        out.insert("projects", projects);
+        out.insert("timings", timingsToJson(timings));
+        out.insert("profile", profileToJson());
+        fprintf(stdout, "%s\n", QJsonDocument(out).toJson(QJsonDocument::Indented).constData());
+        return failed ? 1 : 0;
+    }
+
+    // same layout as compiler output, so editors and CI can pick up file:line
+    for (const CheckResult& result : results)
+    {
+        if (!result.loaded)
+            fprintf(stdout, "%s: error: %s\n", result.path.toLocal8Bit().constData(), result.error.toLocal8Bit().constData());
+        for (const CheckDiagnostic& diag : result.diagnostics)
+        {
+            fprintf(stdout, "%s:%d: %s: %s\n", diag.file.toLocal8Bit().constData(), diag.line,
+                    (diag.severity == ParserDiagnostic::Error) ? "error" : "warning", diag.message.toLocal8Bit().constData());
+        }
+        if (args.isSet(timingsOption))
+            fprintf(stderr, "%s: %s\n", result.path.toLocal8Bit().constData(), timingsToText(result.timings).toLocal8Bit().constData());
+    }
+    int errors = 0;
+    int warnings = 0;
+    for (const CheckResult& result : results)
+    {
+        errors += result.errors;
+        warnings += result.warnings;
+    }
+    fprintf(stderr, "%d projects, %d errors, %d warnings\n", results.size(), errors, warnings);
+    if (args.isSet(timingsOption))
+    {
+        fprintf(stderr, "%s\n", timingsToText(timings).toLocal8Bit().constData());
+        fprintf(stderr, "%s", Profiler::report().toLocal8Bit().constData());
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,283 @@
+#include "selftest.h"
+
+#include <QString>
+#include <QStringList>
+#include <algorithm>
+#include <cstdio>
+
+#include "textbuffer.h"
+#include "queryengine.h"
+
+// splitmix64, same as zzgen. the same edits on every platform
+class SelfTestRandom
+{
+public:
+    explicit SelfTestRandom(quint64 seed) : state(seed) {}
+
+    quint64 next()
+    {
+        quint64 z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    // uniform in [0, n)
+    int below(int n) { return (n > 0) ? int(next() % quint64(n)) : 0; }
+    bool chance(int percent) { return below(100) < percent; }
+
+private:
+    quint64 state;
+};
+
+// parses without a library. every kind of member lookup the body reparse has to get right: fields of the class and its
+// parent, a struct field, a method call, enum and global constants, locals and loop variables
+static const char* const sampleText =
+    "const GLOBAL_LIMIT = 16;\n"
+    "\n"
+    "enum ETestFlags\n"
+    "{\n"
+    "    TF_NONE,\n"
+    "    TF_FIRST = 2,\n"
+    "    TF_SECOND\n"
+    "};\n"
+    "\n"
+    "struct TestPoint\n"
+    "{\n"
+    "    int x;\n"
+    "    int y;\n"
+    "\n"
+    "    int Sum()\n"
+    "    {\n"
+    "        return x + y;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "class TestBase\n"
+    "{\n"
+    "    int counter;\n"
+    "    double scale;\n"
+    "\n"
+    "    int Step(int a, int b)\n"
+    "    {\n"
+    "        int total = a * b;\n"
+    "        for (int i = 0; i < GLOBAL_LIMIT; i++)\n"
+    "        {\n"
+    "            total += i * TF_FIRST;\n"
+    "        }\n"
+    "        counter = total;\n"
+    "        return total;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "class TestChild : TestBase\n"
+    "{\n"
+    "    TestPoint point;\n"
+    "\n"
+    "    int Run(int a)\n"
+    "    {\n"
+    "        let value = Step(a, TF_SECOND);\n"
+    "        if (value > counter)\n"
+    "            value = point.Sum();\n"
+    "        return value + counter;\n"
+    "    }\n"
+    "\n"
+    "    void Reset()\n"
+    "    {\n"
+    "        counter = 0;\n"
+    "        scale = 1.5;\n"
+    "    }\n"
+    "}\n";
+
+// no braces, quotes or slashes: edits change what is inside a body, not where bodies end
+static const char editAlphabet[] = "abcdexyzTF_01239 \n\t+-*=<>;(),.";
+
+static QString randomText(SelfTestRandom& random, int maxLength)
+{
+    QString out;
+    int length = random.below(maxLength + 1);
+    for (int i = 0; i < length; i++)
+        out.append(QChar(editAlphabet[random.below(int(sizeof(editAlphabet)) - 1)]));
+    return out;
+}
+
+// random edit of a text of the given length: mostly typing and deleting a few characters, sometimes a larger range
+static QueryEngine::TextEdit randomEdit(SelfTestRandom& random, int length, QString& added)
+{
+    QueryEngine::TextEdit edit;
+    edit.position = random.below(length + 1);
+    int maxRemoved = qMin(random.chance(10) ? 40 : 3, length - edit.position);
+    edit.charsRemoved = random.below(maxRemoved + 1);
+    added = randomText(random, random.chance(10) ? 20 : 3);
+    edit.charsAdded = added.length();
+    return edit;
+}
+
+static QString applyEdit(const QString& text, const QueryEngine::TextEdit& edit, const QString& added)
+{
+    return text.left(edit.position) + added + text.mid(edit.position + edit.charsRemoved);
+}
+
+static void report(quint64 seed, int round, int step, const QString& message)
+{
+    fprintf(stderr, "selftest: seed %llu, round %d, edit %d: %s\n", static_cast<unsigned long long>(seed), round, step,
+            message.toLocal8Bit().constData());
+}
+
+static int testTextBuffer(SelfTestRandom& random, quint64 seed, int round)
+{
+    QString expected = sampleText;
+    TextBuffer buffer(expected);
+    for (int step = 0; step < 200; step++)
+    {
+        QString added;
+        QueryEngine::TextEdit edit = randomEdit(random, expected.length(), added);
+        if (!buffer.replace(edit.position, edit.charsRemoved, added))
+        {
+            report(seed, round, step, QString("TextBuffer::replace(%1, %2) rejected an edit inside the text").arg(edit.position).arg(edit.charsRemoved));
+            return 1;
+        }
+        expected = applyEdit(expected, edit, added);
+
+        int position = random.below(expected.length() + 1);
+        int n = random.below(expected.length() - position + 1);
+        if (buffer.length() != expected.length() || buffer.mid(position, n) != expected.mid(position, n))
+        {
+            report(seed, round, step, QString("TextBuffer::mid(%1, %2) differs from the edited text").arg(position).arg(n));
+            return 1;
+        }
+        // text() puts the pieces together, the next edits start from one piece again
+        if (random.chance(5) && buffer.text() != expected)
+        {
+            report(seed, round, step, "TextBuffer::text() differs from the edited text");
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int testMergeEdits(SelfTestRandom& random, quint64 seed, int round)
+{
+    for (int step = 0; step < 100; step++)
+    {
+        QString original = sampleText;
+        QString text = original;
+        QueryEngine::TextEdit merged;
+        int count = 2 + random.below(4);
+        for (int i = 0; i < count; i++)
+        {
+            QString added;
+            QueryEngine::TextEdit edit = randomEdit(random, text.length(), added);
+            text = applyEdit(text, edit, added);
+            merged = i ? QueryEngine::mergeEdits(merged, edit) : edit;
+        }
+        // the merged edit is in the coordinates of the original text: everything outside of it is unchanged
+        bool valid = merged.position >= 0 && merged.charsRemoved >= 0 && merged.charsAdded >= 0 &&
+                merged.position + merged.charsRemoved <= original.length() &&
+                original.length() - merged.charsRemoved + merged.charsAdded == text.length() &&
+                original.left(merged.position) == text.left(merged.position) &&
+                original.mid(merged.position + merged.charsRemoved) == text.mid(merged.position + merged.charsAdded);
+        if (!valid)
+        {
+            report(seed, round, step, QString("mergeEdits of %1 edits gives position %2, %3 removed, %4 added, which doesn't describe the change")
+                   .arg(count).arg(merged.position).arg(merged.charsRemoved).arg(merged.charsAdded));
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static QString tokenText(const Tokenizer::Token& tok)
+{
+    return QString("%1 \"%2\" at %3-%4 line %5").arg(int(tok.type)).arg(tok.value).arg(tok.startsAt).arg(tok.endsAt).arg(tok.line);
+}
+
+static QString semanticTokenText(const ParserToken& tok, Parser* parser)
+{
+    QString path = (tok.symbol && int(tok.symbol) <= parser->symbols.size()) ? parser->symbols[tok.symbol-1].referencePath : QString();
+    return QString("%1 at %2+%3 modifiers %4 symbol \"%5\"").arg(int(tok.type)).arg(tok.startsAt).arg(tok.length).arg(int(tok.modifiers)).arg(path);
+}
+
+static QStringList diagnosticTexts(Parser* parser)
+{
+    QStringList out;
+    for (const ParserDiagnostic& diag : parser->diagnostics)
+        out.append(QString("%1:%2: %3").arg(diag.line).arg(int(diag.severity)).arg(diag.message));
+    // passes report in their own order, and a body reparse reports its body last
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+// what the incremental engine has for the file, against a new engine that parses the text from scratch
+static QString compareWithFullParse(QueryEngine& incremental, const QString& file, const QString& text)
+{
+    QueryEngine full;
+    full.setFileText(file, text);
+    QVector<ParserToken> expectedSemantic = full.semanticTokens(file);
+    QList<Tokenizer::Token> expectedTokens = full.tokens(file);
+    QVector<ParserToken> semantic = incremental.semanticTokens(file);
+    QList<Tokenizer::Token> tokens = incremental.tokens(file);
+    Parser* fullParser = full.parser(file);
+    Parser* parser = incremental.parser(file);
+    if (!fullParser || !parser)
+        return "no parser";
+
+    for (int i = 0; i < qMax(tokens.size(), expectedTokens.size()); i++)
+    {
+        QString got = (i < tokens.size()) ? tokenText(tokens[i]) : QString("nothing");
+        QString expected = (i < expectedTokens.size()) ? tokenText(expectedTokens[i]) : QString("nothing");
+        if (got != expected)
+            return QString("lexical token %1 is %2, a full relex gives %3").arg(i).arg(got, expected);
+    }
+    for (int i = 0; i < qMax(semantic.size(), expectedSemantic.size()); i++)
+    {
+        QString got = (i < semantic.size()) ? semanticTokenText(semantic[i], parser) : QString("nothing");
+        QString expected = (i < expectedSemantic.size()) ? semanticTokenText(expectedSemantic[i], fullParser) : QString("nothing");
+        if (got != expected)
+            return QString("semantic token %1 is %2, a full reparse gives %3").arg(i).arg(got, expected);
+    }
+    QStringList diagnostics = diagnosticTexts(parser);
+    QStringList expectedDiagnostics = diagnosticTexts(fullParser);
+    if (diagnostics != expectedDiagnostics)
+        return QString("diagnostics are [%1], a full reparse gives [%2]").arg(diagnostics.join("; "), expectedDiagnostics.join("; "));
+    return QString();
+}
+
+static int testIncrementalParse(SelfTestRandom& random, quint64 seed, int round)
+{
+    static const QString file = "selftest.zs";
+    QueryEngine incremental;
+    QString text = sampleText;
+    incremental.setFileText(file, text);
+    incremental.semanticTokens(file);
+    for (int step = 0; step < 50; step++)
+    {
+        QString added;
+        QueryEngine::TextEdit edit = randomEdit(random, text.length(), added);
+        text = applyEdit(text, edit, added);
+        incremental.setFileText(file, text, &edit);
+        // not analyzed in between, i.e. a cancelled analysis: the engine merges this edit with the next one
+        if (random.chance(30))
+            continue;
+        QString mismatch = compareWithFullParse(incremental, file, text);
+        if (!mismatch.isEmpty())
+        {
+            report(seed, round, step, mismatch);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int runSelfTest(quint64 seed, int rounds)
+{
+    SelfTestRandom random(seed);
+    int failures = 0;
+    for (int round = 0; round < rounds; round++)
+    {
+        failures += testTextBuffer(random, seed, round);
+        failures += testMergeEdits(random, seed, round);
+        failures += testIncrementalParse(random, seed, round);
+    }
+    fprintf(stderr, "selftest: seed %llu, %d rounds, %d failed\n", static_cast<unsigned long long>(seed), rounds, failures);
+    return failures;
+}
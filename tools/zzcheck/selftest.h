@@ -0,0 +1,14 @@
+#ifndef SELFTEST_H
+#define SELFTEST_H
+
+#include <QtGlobal>
+
+// zzcheck --selftest <seed>
+// Applies random edit sequences and compares every incremental path with doing the same from scratch:
+//   TextBuffer::replace and mid/text      against QString::replace
+//   QueryEngine::mergeEdits               the merged edit leaves the same prefix and suffix as the edits it replaces
+//   QueryEngine::setFileText with edits   lexical tokens, semantic tokens and diagnostics against a new engine
+// The same seed gives the same edits. Returns the number of mismatches, each one is printed to stderr.
+int runSelfTest(quint64 seed, int rounds);
+
+#endif // SELFTEST_H
@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# zzcheck: parses ZScript projects without a display and prints their diagnostics
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = zzcheck
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../../zzscript.pri)
+
+SOURCES += \
+        main.cpp \
+        selftest.cpp
+
+HEADERS += \
+        selftest.h
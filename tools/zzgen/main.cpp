@@ -0,0 +1,449 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QVector>
+#include <cstdio>
+
+// zzgen [options] <output dir>
+// Writes a synthetic ZScript project that parses without errors and without a library: zscript.txt, and files under gen/
+// that include each other as a tree. Every size is an option, see --help. The same options and seed always give the
+// same project, byte for byte, so benchmark results on it can be compared across commits.
+//
+// What the generated code exercises:
+//   inheritance chains up to --depth, with methods using fields and calling methods of their ancestors (member lookup)
+//   --extends "extend class" blocks per class, in other files than the class
+//   a field of another class type per class, read through it (resolveSymbol into another type)
+//   nested expressions up to --nesting, enum constants, locals, ifs and for loops in --statements long methods
+
+// splitmix64. the same sequence on every platform and Qt version
+class Random
+{
+public:
+    explicit Random(quint64 seed) : state(seed) {}
+
+    quint64 next()
+    {
+        quint64 z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    // uniform in [0, n)
+    int below(int n) { return (n > 0) ? int(next() % quint64(n)) : 0; }
+    bool chance(int percent) { return below(100) < percent; }
+
+private:
+    quint64 state;
+};
+
+struct Settings
+{
+    quint64 seed;
+    int classes;
+    int depth;
+    int fields;
+    int methods;
+    int statements;
+    int nesting;
+    int extends;
+    int enums;
+    int enumSize;
+    int classesPerFile;
+    int includes;
+};
+
+struct GenClass
+{
+    QString name;
+    int parent; // -1 for none
+    int depth;
+    int file;
+    // all fields are ints, all methods are int(int a, int b)
+    QStringList fields;
+    QStringList methods;
+    // class of the "link" field, -1 if there is none
+    int link;
+    QString linkField;
+    // files with an extend block for this class
+    QList<int> extendFiles;
+};
+
+class Generator
+{
+public:
+    explicit Generator(const Settings& settings) : settings(settings), random(settings.seed) {}
+
+    void plan();
+    QString fileText(int file);
+    int fileCount() const { return files; }
+    static QString filePath(int file) { return QString("gen/f%1.zs").arg(file); }
+
+private:
+    Settings settings;
+    Random random;
+    int files;
+    QList<GenClass> classes;
+    QStringList enumNames;
+    QList<QStringList> enumValues;
+    QList<int> enumFiles;
+
+    QStringList visibleFields(const GenClass& cls) const;
+    QStringList visibleMethods(const GenClass& cls) const;
+    QString expression(int depth, const QStringList& locals, const QStringList& fields, const QStringList& methods);
+    QString method(const GenClass& cls, const QString& name, const QString& indent);
+};
+
+void Generator::plan()
+{
+    files = qMax(1, (settings.classes + settings.classesPerFile - 1) / settings.classesPerFile);
+    for (int c = 0; c < settings.classes; c++)
+    {
+        GenClass cls;
+        cls.name = QString("Gen_C%1").arg(c);
+        cls.parent = -1;
+        cls.depth = 0;
+        cls.file = c / settings.classesPerFile;
+        // parents are always declared earlier, so there are no cycles
+        if (c > 0 && random.chance(80))
+        {
+            int parent = random.below(c);
+            if (classes[parent].depth < settings.depth)
+            {
+                cls.parent = parent;
+                cls.depth = classes[parent].depth + 1;
+            }
+        }
+        for (int i = 0; i < settings.fields; i++)
+            cls.fields.append(QString("F%1_%2").arg(c).arg(i));
+        for (int i = 0; i < settings.methods; i++)
+            cls.methods.append(QString("M%1_%2").arg(c).arg(i));
+        cls.link = (settings.fields > 0) ? random.below(settings.classes) : -1;
+        cls.linkField = QString("L%1").arg(c);
+        for (int i = 0; i < settings.extends; i++)
+            cls.extendFiles.append(random.below(files));
+        classes.append(cls);
+    }
+
+    for (int e = 0; e < settings.enums; e++)
+    {
+        enumNames.append(QString("Gen_E%1").arg(e));
+        QStringList values;
+        for (int i = 0; i < settings.enumSize; i++)
+            values.append(QString("GEN_E%1_%2").arg(e).arg(i));
+        enumValues.append(values);
+        enumFiles.append(e % files);
+    }
+}
+
+QStringList Generator::visibleFields(const GenClass& cls) const
+{
+    QStringList out = cls.fields;
+    for (int p = cls.parent; p >= 0; p = classes[p].parent)
+        out.append(classes[p].fields);
+    return out;
+}
+
+QStringList Generator::visibleMethods(const GenClass& cls) const
+{
+    QStringList out = cls.methods;
+    for (int p = cls.parent; p >= 0; p = classes[p].parent)
+        out.append(classes[p].methods);
+    return out;
+}
+
+QString Generator::expression(int depth, const QStringList& locals, const QStringList& fields, const QStringList& methods)
+{
+    if (depth <= 0 || random.chance(25))
+    {
+        switch (random.below(4))
+        {
+            case 0:
+                if (!locals.isEmpty())
+                    return locals[random.below(locals.size())];
+                break;
+            case 1:
+                if (!fields.isEmpty())
+                    return fields[random.below(fields.size())];
+                break;
+            case 2:
+                if (!enumValues.isEmpty())
+                {
+                    const QStringList& values = enumValues[random.below(enumValues.size())];
+                    if (!values.isEmpty())
+                        return values[random.below(values.size())];
+                }
+                break;
+            default:
+                break;
+        }
+        return QString::number(random.below(100));
+    }
+
+    switch (random.below(5))
+    {
+        case 0:
+        case 1:
+        {
+            static const char* const operators[] = { "+", "-", "*", "&", "|" };
+            QString left = expression(depth-1, locals, fields, methods);
+            QString right = expression(depth-1, locals, fields, methods);
+            return QString("(%1 %2 %3)").arg(left, operators[random.below(5)], right);
+        }
+        case 2:
+            return QString("-(%1)").arg(expression(depth-1, locals, fields, methods));
+        case 3:
+        {
+            QString left = expression(depth-1, locals, fields, methods);
+            QString right = expression(depth-1, locals, fields, methods);
+            QString yes = expression(depth-1, locals, fields, methods);
+            QString no = expression(depth-1, locals, fields, methods);
+            return QString("(%1 > %2 ? %3 : %4)").arg(left, right, yes, no);
+        }
+        default:
+        {
+            if (methods.isEmpty())
+                return expression(depth-1, locals, fields, methods);
+            QString name = methods[random.below(methods.size())];
+            QString a = expression(depth-1, locals, fields, methods);
+            QString b = expression(depth-1, locals, fields, methods);
+            return QString("%1(%2, %3)").arg(name, a, b);
+        }
+    }
+}
+
+QString Generator::method(const GenClass& cls, const QString& name, const QString& indent)
+{
+    QStringList fields = visibleFields(cls);
+    QStringList methods = visibleMethods(cls);
+    QStringList locals;
+    locals << "a" << "b";
+    QString in = indent + "    ";
+    QString out;
+    out += QString("%1int %2(int a, int b)\n%1{\n").arg(indent, name);
+    for (int s = 0; s < settings.statements; s++)
+    {
+        QString target = locals[random.below(locals.size())];
+        switch (random.below(7))
+        {
+            case 0:
+            case 1:
+            {
+                QString local = QString("v%1").arg(s);
+                out += QString("%1int %2 = %3;\n").arg(in, local, expression(settings.nesting, locals, fields, methods));
+                locals.append(local);
+                break;
+            }
+            case 2:
+                out += QString("%1%2 = %3;\n").arg(in, target, expression(settings.nesting, locals, fields, methods));
+                break;
+            case 3:
+            {
+                QString left = expression(settings.nesting, locals, fields, methods);
+                QString right = expression(settings.nesting, locals, fields, methods);
+                out += QString("%1if (%2 > %3)\n%1{\n").arg(in, left, right);
+                out += QString("%1    %2 = %3;\n").arg(in, target, expression(settings.nesting, locals, fields, methods));
+                out += QString("%1}\n%1else\n%1{\n").arg(in);
+                out += QString("%1    %2 = %3;\n").arg(in, target, expression(settings.nesting, locals, fields, methods));
+                out += QString("%1}\n").arg(in);
+                break;
+            }
+            case 4:
+            {
+                QString counter = QString("i%1").arg(s);
+                out += QString("%1for (int %2 = 0; %2 < %3; %2++)\n%1{\n").arg(in, counter).arg(random.below(16)+1);
+                out += QString("%1    %2 += %3;\n").arg(in, target, expression(settings.nesting, locals + QStringList(counter), fields, methods));
+                out += QString("%1}\n").arg(in);
+                break;
+            }
+            case 5:
+                if (!fields.isEmpty())
+                {
+                    QString field = fields[random.below(fields.size())];
+                    out += QString("%1%2 = %3;\n").arg(in, field, expression(settings.nesting, locals, fields, methods));
+                    break;
+                }
+                // fall through
+            default:
+            {
+                // member of another class, through the link field
+                const GenClass* linked = (cls.link >= 0) ? &classes[cls.link] : nullptr;
+                if (linked && !linked->fields.isEmpty())
+                {
+                    QString field = linked->fields[random.below(linked->fields.size())];
+                    out += QString("%1if (%2 != null)\n%1    %3 = %2.%4;\n").arg(in, cls.linkField, target, field);
+                }
+                else out += QString("%1%2 = %3;\n").arg(in, target, expression(settings.nesting, locals, fields, methods));
+                break;
+            }
+        }
+    }
+    out += QString("%1return %2;\n").arg(in, expression(settings.nesting, locals, fields, methods));
+    out += QString("%1}\n").arg(indent);
+    return out;
+}
+
+QString Generator::fileText(int file)
+{
+    QString out;
+    out += QString("// generated by zzgen, seed %1\n\n").arg(settings.seed);
+
+    // the files form a tree, --includes children per file
+    for (int i = 0; i < settings.includes; i++)
+    {
+        int child = file * settings.includes + i + 1;
+        if (child < files)
+            out += QString("#include \"%1\"\n").arg(filePath(child));
+    }
+    out += "\n";
+
+    for (int e = 0; e < enumNames.size(); e++)
+    {
+        if (enumFiles[e] != file)
+            continue;
+        out += QString("enum %1\n{\n").arg(enumNames[e]);
+        for (int i = 0; i < enumValues[e].size(); i++)
+        {
+            // some values are explicit, the others follow from the previous one
+            if (random.chance(30))
+                out += QString("    %1 = %2,\n").arg(enumValues[e][i]).arg(i * 4);
+            else out += QString("    %1,\n").arg(enumValues[e][i]);
+        }
+        out += "}\n\n";
+    }
+
+    for (int c = 0; c < classes.size(); c++)
+    {
+        const GenClass& cls = classes[c];
+        if (cls.file != file)
+            continue;
+        if (cls.parent >= 0)
+            out += QString("class %1 : %2\n{\n").arg(cls.name, classes[cls.parent].name);
+        else out += QString("class %1\n{\n").arg(cls.name);
+        for (const QString& field : cls.fields)
+            out += QString("    int %1;\n").arg(field);
+        if (cls.link >= 0)
+            out += QString("    %1 %2;\n").arg(classes[cls.link].name, cls.linkField);
+        out += "\n";
+        for (const QString& name : cls.methods)
+        {
+            out += method(cls, name, "    ");
+            out += "\n";
+        }
+        out += "}\n\n";
+    }
+
+    for (int c = 0; c < classes.size(); c++)
+    {
+        const GenClass& cls = classes[c];
+        for (int x = 0; x < cls.extendFiles.size(); x++)
+        {
+            if (cls.extendFiles[x] != file)
+                continue;
+            out += QString("extend class %1\n{\n").arg(cls.name);
+            out += QString("    int X%1_%2;\n\n").arg(c).arg(x);
+            out += method(cls, QString("XM%1_%2").arg(c).arg(x), "    ");
+            out += "}\n\n";
+        }
+    }
+    return out;
+}
+
+static bool writeFile(const QString& path, const QString& text)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly|QIODevice::Truncate))
+        return false;
+    QByteArray bytes = text.toUtf8();
+    return f.write(bytes) == bytes.size();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("zzgen");
+
+    QCommandLineParser args;
+    args.setApplicationDescription("Writes a synthetic ZScript project. The same options always give the same project.");
+    args.addHelpOption();
+    args.addPositionalArgument("output", "Project directory to write. The project is named after it.");
+    QCommandLineOption seedOption("seed", "Random seed.", "n", "1");
+    QCommandLineOption classesOption("classes", "Number of classes.", "n", "100");
+    QCommandLineOption depthOption("depth", "Maximum inheritance depth.", "n", "4");
+    QCommandLineOption fieldsOption("fields", "Fields per class.", "n", "4");
+    QCommandLineOption methodsOption("methods", "Methods per class.", "n", "5");
+    QCommandLineOption statementsOption("statements", "Statements per method.", "n", "10");
+    QCommandLineOption nestingOption("nesting", "Maximum expression nesting.", "n", "3");
+    QCommandLineOption extendsOption("extends", "\"extend class\" blocks per class.", "n", "1");
+    QCommandLineOption enumsOption("enums", "Number of enums.", "n", "10");
+    QCommandLineOption enumSizeOption("enum-size", "Values per enum.", "n", "16");
+    QCommandLineOption perFileOption("classes-per-file", "Classes per file.", "n", "10");
+    QCommandLineOption includesOption("includes", "Files included by each file.", "n", "4");
+    args.addOption(seedOption);
+    args.addOption(classesOption);
+    args.addOption(depthOption);
+    args.addOption(fieldsOption);
+    args.addOption(methodsOption);
+    args.addOption(statementsOption);
+    args.addOption(nestingOption);
+    args.addOption(extendsOption);
+    args.addOption(enumsOption);
+    args.addOption(enumSizeOption);
+    args.addOption(perFileOption);
+    args.addOption(includesOption);
+    args.process(app);
+
+    Settings settings;
+    settings.seed = args.value(seedOption).toULongLong();
+    settings.classes = args.value(classesOption).toInt();
+    settings.depth = args.value(depthOption).toInt();
+    settings.fields = args.value(fieldsOption).toInt();
+    settings.methods = args.value(methodsOption).toInt();
+    settings.statements = args.value(statementsOption).toInt();
+    settings.nesting = args.value(nestingOption).toInt();
+    settings.extends = args.value(extendsOption).toInt();
+    settings.enums = args.value(enumsOption).toInt();
+    settings.enumSize = args.value(enumSizeOption).toInt();
+    settings.classesPerFile = args.value(perFileOption).toInt();
+    settings.includes = args.value(includesOption).toInt();
+    if (args.positionalArguments().size() != 1 || settings.classes < 0 || settings.depth < 0 || settings.fields < 0 ||
+        settings.methods < 0 || settings.statements < 0 || settings.nesting < 0 || settings.extends < 0 || settings.enums < 0 ||
+        settings.enumSize < 0 || settings.classesPerFile < 1 || settings.includes < 1)
+    {
+        fprintf(stderr, "%s", args.helpText().toLocal8Bit().constData());
+        return 2;
+    }
+
+    QString output = args.positionalArguments().first();
+    if (!QDir().mkpath(output + "/gen"))
+    {
+        fprintf(stderr, "zzgen: cannot create %s\n", output.toLocal8Bit().constData());
+        return 1;
+    }
+
+    Generator generator(settings);
+    generator.plan();
+    qint64 bytes = 0;
+    int lines = 0;
+    QString root = QString("// generated by zzgen, seed %1\n\n#include \"%2\"\n").arg(settings.seed).arg(Generator::filePath(0));
+    if (!writeFile(output + "/zscript.txt", root))
+    {
+        fprintf(stderr, "zzgen: cannot write %s/zscript.txt\n", output.toLocal8Bit().constData());
+        return 1;
+    }
+    for (int file = 0; file < generator.fileCount(); file++)
+    {
+        QString text = generator.fileText(file);
+        QString path = output + "/" + Generator::filePath(file);
+        if (!writeFile(path, text))
+        {
+            fprintf(stderr, "zzgen: cannot write %s\n", path.toLocal8Bit().constData());
+            return 1;
+        }
+        bytes += text.toUtf8().size();
+        lines += text.count('\n');
+    }
+    fprintf(stderr, "zzgen: %d files, %d classes, %d lines, %lld bytes in %s\n", generator.fileCount(), settings.classes, lines, bytes,
+            output.toLocal8Bit().constData());
+    return 0;
+}
@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# zzgen: writes synthetic ZScript projects of a given size, for scaling tests
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = zzgen
+TEMPLATE = app
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += \
+        main.cpp
@@ -0,0 +1,44 @@
+# Parser, project and analysis code. Shared by the editor (ZZscript.pro) and the command-line tools in tools/,
+# needs nothing but QtCore and QtConcurrent.
+
+QT += concurrent
+CONFIG += c++11
+INCLUDEPATH += $$PWD
+
+# zlib, for reading pk3 archives
+LIBS += -lz
+
+SOURCES += \
+    $$PWD/tokenizer.cpp \
+    $$PWD/parser.cpp \
+    $$PWD/parser_expression.cpp \
+    $$PWD/parser_root.cpp \
+    $$PWD/parser_fields.cpp \
+    $$PWD/parser_methods.cpp \
+    $$PWD/project.cpp \
+    $$PWD/sourcefile.cpp \
+    $$PWD/sourceloader.cpp \
+    $$PWD/includegraph.cpp \
+    $$PWD/parsecache.cpp \
+    $$PWD/libraryindex.cpp \
+    $$PWD/pk3archive.cpp \
+    $$PWD/queryengine.cpp \
+    $$PWD/parsesnapshot.cpp \
+    $$PWD/textbuffer.cpp \
+    $$PWD/profiler.cpp
+
+HEADERS += \
+    $$PWD/tokenizer.h \
+    $$PWD/tokens.h \
+    $$PWD/parser.h \
+    $$PWD/project.h \
+    $$PWD/sourcefile.h \
+    $$PWD/sourceloader.h \
+    $$PWD/includegraph.h \
+    $$PWD/parsecache.h \
+    $$PWD/libraryindex.h \
+    $$PWD/pk3archive.h \
+    $$PWD/queryengine.h \
+    $$PWD/parsesnapshot.h \
+    $$PWD/textbuffer.h \
+    $$PWD/profiler.h